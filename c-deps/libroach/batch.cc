@@ -424,25 +424,29 @@ class DBBatchInserter : public rocksdb::WriteBatch::Handler {
 }  // namespace
 
 DBBatch::DBBatch(DBEngine* db)
-    : DBEngine(db->rep, db->iters), updates(0), has_delete_range(false), batch(&kComparator) {}
+    : DBEngine(db->rep, db->iters, db->timebound_cache, db->tombstone_compactor),
+      updates(0),
+      has_delete_range(false),
+      batch(&kComparator) {}
 
 DBBatch::~DBBatch() {}
 
 DBStatus DBBatch::Put(DBKey key, DBSlice value) {
   ++updates;
-  batch.Put(EncodeKey(key), ToSlice(value));
+  batch.Put(EncodedKey(key), ToSlice(value));
   return kSuccess;
 }
 
 DBStatus DBBatch::Merge(DBKey key, DBSlice value) {
   ++updates;
-  batch.Merge(EncodeKey(key), ToSlice(value));
+  batch.Merge(EncodedKey(key), ToSlice(value));
   return kSuccess;
 }
 
 DBStatus DBBatch::Get(DBKey key, DBString* value) {
   rocksdb::ReadOptions read_opts;
-  DBGetter base(rep, read_opts, EncodeKey(key));
+  const EncodedKey enc_key(key);
+  DBGetter base(rep, read_opts, enc_key);
   if (updates == 0) {
     return base.Get(value);
   }
@@ -458,14 +462,14 @@ DBStatus DBBatch::Get(DBKey key, DBString* value) {
 
 DBStatus DBBatch::Delete(DBKey key) {
   ++updates;
-  batch.Delete(EncodeKey(key));
+  batch.Delete(EncodedKey(key));
   return kSuccess;
 }
 
 DBStatus DBBatch::DeleteRange(DBKey start, DBKey end) {
   ++updates;
   has_delete_range = true;
-  batch.DeleteRange(EncodeKey(start), EncodeKey(end));
+  batch.DeleteRange(EncodedKey(start), EncodedKey(end));
   return kSuccess;
 }
 
@@ -497,7 +501,7 @@ DBStatus DBBatch::ApplyBatchRepr(DBSlice repr, bool sync) {
 DBSlice DBBatch::BatchRepr() { return ToDBSlice(batch.GetWriteBatch()->Data()); }
 
 DBIterator* DBBatch::NewIter(rocksdb::ReadOptions* read_opts) {
-  DBIterator* iter = new DBIterator(iters);
+  DBIterator* iter = new DBIterator(iters, tombstone_compactor);
   if (has_delete_range) {
     // TODO(peter): We don't support iterators when the batch contains
     // delete range entries.
@@ -515,6 +519,10 @@ DBString DBBatch::GetCompactionStats() { return ToDBString("unsupported"); }
 
 DBStatus DBBatch::GetEnvStats(DBEnvStatsResult* stats) { return FmtStatus("unsupported"); }
 
+DBStatus DBBatch::GetWriteStallStats(DBWriteStallStats* stats) {
+  return FmtStatus("unsupported");
+}
+
 DBStatus DBBatch::EnvWriteFile(DBSlice path, DBSlice contents) { return FmtStatus("unsupported"); }
 
 DBStatus DBBatch::EnvOpenFile(DBSlice path, rocksdb::WritableFile** file) {
@@ -535,19 +543,21 @@ DBStatus DBBatch::EnvDeleteFile(DBSlice path) { return FmtStatus("unsupported");
 
 DBStatus DBBatch::EnvDeleteDirAndFiles(DBSlice dir) { return FmtStatus("unsupported"); }
 
-DBWriteOnlyBatch::DBWriteOnlyBatch(DBEngine* db) : DBEngine(db->rep, db->iters), updates(0) {}
+DBWriteOnlyBatch::DBWriteOnlyBatch(DBEngine* db)
+    : DBEngine(db->rep, db->iters, db->timebound_cache, db->tombstone_compactor),
+      updates(0) {}
 
 DBWriteOnlyBatch::~DBWriteOnlyBatch() {}
 
 DBStatus DBWriteOnlyBatch::Put(DBKey key, DBSlice value) {
   ++updates;
-  batch.Put(EncodeKey(key), ToSlice(value));
+  batch.Put(EncodedKey(key), ToSlice(value));
   return kSuccess;
 }
 
 DBStatus DBWriteOnlyBatch::Merge(DBKey key, DBSlice value) {
   ++updates;
-  batch.Merge(EncodeKey(key), ToSlice(value));
+  batch.Merge(EncodedKey(key), ToSlice(value));
   return kSuccess;
 }
 
@@ -555,13 +565,13 @@ DBStatus DBWriteOnlyBatch::Get(DBKey key, DBString* value) { return FmtStatus("u
 
 DBStatus DBWriteOnlyBatch::Delete(DBKey key) {
   ++updates;
-  batch.Delete(EncodeKey(key));
+  batch.Delete(EncodedKey(key));
   return kSuccess;
 }
 
 DBStatus DBWriteOnlyBatch::DeleteRange(DBKey start, DBKey end) {
   ++updates;
-  batch.DeleteRange(EncodeKey(start), EncodeKey(end));
+  batch.DeleteRange(EncodedKey(start), EncodedKey(end));
   return kSuccess;
 }
 
@@ -600,6 +610,10 @@ DBString DBWriteOnlyBatch::GetCompactionStats() { return ToDBString("unsupported
 
 DBStatus DBWriteOnlyBatch::GetEnvStats(DBEnvStatsResult* stats) { return FmtStatus("unsupported"); }
 
+DBStatus DBWriteOnlyBatch::GetWriteStallStats(DBWriteStallStats* stats) {
+  return FmtStatus("unsupported");
+}
+
 DBStatus DBWriteOnlyBatch::EnvWriteFile(DBSlice path, DBSlice contents) {
   return FmtStatus("unsupported");
 }
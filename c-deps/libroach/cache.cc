@@ -14,10 +14,48 @@
 
 #include "cache.h"
 
-DBCache* DBNewCache(uint64_t size) {
-  const int num_cache_shard_bits = 4;
+namespace cockroach {
+
+int CacheShardBits(uint64_t size, int num_cpu) {
+  // Aim for 4 shards per CPU which makes it unlikely that concurrent
+  // lookups hash to the same shard. We always use at least 16 shards
+  // and cap the number of shards at 1024 as the per-shard overhead is
+  // not free.
+  const int kMinShardBits = 4;
+  const int kMaxShardBits = 10;
+  // Shards smaller than this risk evicting blocks prematurely because
+  // the cache capacity is split evenly between the shards.
+  const uint64_t kMinShardSize = 512 << 10;  // 512 KB
+
+  int bits = kMinShardBits;
+  while (bits < kMaxShardBits && (1 << bits) < 4 * num_cpu &&
+         (size >> (bits + 1)) >= kMinShardSize) {
+    bits++;
+  }
+  return bits;
+}
+
+}  // namespace cockroach
+
+DBCache* DBNewCache(DBCacheOptions opts) {
+  const int num_cache_shard_bits = cockroach::CacheShardBits(opts.size, opts.num_cpu);
+  std::shared_ptr<rocksdb::Cache> rep;
+  if (opts.use_clock_cache) {
+    // NewClockCache returns nullptr if RocksDB was built without
+    // CLOCK cache support (which requires TBB).
+    rep = rocksdb::NewClockCache(opts.size, num_cache_shard_bits);
+    if (rep == nullptr) {
+      return nullptr;
+    }
+  } else {
+    rocksdb::LRUCacheOptions cache_opts;
+    cache_opts.capacity = opts.size;
+    cache_opts.num_shard_bits = num_cache_shard_bits;
+    cache_opts.high_pri_pool_ratio = opts.high_pri_pool_ratio;
+    rep = rocksdb::NewLRUCache(cache_opts);
+  }
   DBCache* cache = new DBCache;
-  cache->rep = rocksdb::NewLRUCache(size, num_cache_shard_bits);
+  cache->rep = rep;
   return cache;
 }
 
@@ -23,3 +23,12 @@ struct DBCache {
   std::mutex mu;
   std::shared_ptr<rocksdb::Cache> rep;
 };
+
+namespace cockroach {
+
+// CacheShardBits returns the log2 of the number of shards to split a
+// cache of the specified size into when it is accessed by num_cpu
+// CPUs.
+int CacheShardBits(uint64_t size, int num_cpu);
+
+}  // namespace cockroach
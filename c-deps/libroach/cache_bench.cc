@@ -0,0 +1,103 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cache.h"
+#include "include/libroach.h"
+
+using namespace cockroach;
+
+namespace {
+
+void noopDeleter(const rocksdb::Slice& key, void* value) {}
+
+// lookupNanos measures the average time per cache lookup when
+// num_threads threads concurrently look up keys which are all present
+// in the cache.
+double lookupNanos(rocksdb::Cache* cache, int num_threads) {
+  const int kKeys = 4096;
+  const int kLookups = 200000;
+  std::vector<std::string> keys;
+  for (int i = 0; i < kKeys; i++) {
+    keys.push_back("block" + std::to_string(i));
+    cache->Insert(keys.back(), nullptr, 1, noopDeleter);
+  }
+
+  std::atomic<int64_t> misses(0);
+  std::vector<std::thread> threads;
+  const auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kLookups; i++) {
+        rocksdb::Cache::Handle* h = cache->Lookup(keys[(i * 7 + t) % kKeys]);
+        if (h == nullptr) {
+          misses++;
+          continue;
+        }
+        cache->Release(h);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  if (misses.load() != 0) {
+    fprintf(stderr, "unexpected cache misses: %lld\n", (long long)misses.load());
+  }
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) /
+         (int64_t(kLookups) * num_threads);
+}
+
+}  // namespace
+
+// Compares lookup throughput of the previous fixed 16 shard LRU cache with
+// the caches created by DBNewCache when many threads share the cache.
+int main() {
+  const uint64_t kSize = 1 << 30;
+  const int num_threads = std::max<int>(std::thread::hardware_concurrency(), 4);
+
+  // The previous fixed configuration of 16 shards.
+  std::shared_ptr<rocksdb::Cache> fixed = rocksdb::NewLRUCache(kSize, 4);
+  printf("%d threads\n", num_threads);
+  printf("%-10s %4d shards: %6.1f ns/op\n", fixed->Name(), 16,
+         lookupNanos(fixed.get(), num_threads));
+
+  DBCacheOptions opts;
+  opts.size = kSize;
+  opts.num_cpu = num_threads;
+  opts.high_pri_pool_ratio = 0;
+  opts.use_clock_cache = false;
+  DBCache* lru = DBNewCache(opts);
+  printf("%-10s %4d shards: %6.1f ns/op\n", lru->rep->Name(),
+         1 << CacheShardBits(kSize, num_threads), lookupNanos(lru->rep.get(), num_threads));
+  DBReleaseCache(lru);
+
+  opts.use_clock_cache = true;
+  DBCache* clock = DBNewCache(opts);
+  if (clock == nullptr) {
+    printf("%-10s skipped: RocksDB was built without CLOCK cache support\n", "ClockCache");
+    return 0;
+  }
+  printf("%-10s %4d shards: %6.1f ns/op\n", clock->rep->Name(),
+         1 << CacheShardBits(kSize, num_threads), lookupNanos(clock->rep.get(), num_threads));
+  DBReleaseCache(clock);
+  return 0;
+}
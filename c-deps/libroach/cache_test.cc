@@ -0,0 +1,102 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <gtest/gtest.h>
+#include <string>
+#include "cache.h"
+#include "include/libroach.h"
+
+using namespace cockroach;
+
+namespace {
+
+void noopDeleter(const rocksdb::Slice& key, void* value) {}
+
+DBCacheOptions cacheOptions(uint64_t size, int num_cpu) {
+  DBCacheOptions opts;
+  opts.size = size;
+  opts.num_cpu = num_cpu;
+  opts.high_pri_pool_ratio = 0;
+  opts.use_clock_cache = false;
+  return opts;
+}
+
+}  // namespace
+
+TEST(Libroach, CacheShardBits) {
+  struct TestCase {
+    uint64_t size;
+    int num_cpu;
+    int expected;
+  };
+
+  std::vector<TestCase> testCases = {
+      // Never fewer than 16 shards.
+      {0, 1, 4},
+      {1 << 20, 64, 4},
+      {1 << 30, 1, 4},
+      {1 << 30, 4, 4},
+      // 4 shards per CPU.
+      {1 << 30, 8, 5},
+      {1 << 30, 16, 6},
+      {1 << 30, 64, 8},
+      {1 << 30, 65, 9},
+      // Shards are at least 512 KB.
+      {64 << 20, 64, 7},
+      // Never more than 1024 shards.
+      {uint64_t(64) << 30, 1024, 10},
+  };
+
+  for (const auto& c : testCases) {
+    EXPECT_EQ(c.expected, CacheShardBits(c.size, c.num_cpu)) << c.size << " " << c.num_cpu;
+  }
+}
+
+TEST(Libroach, CacheHighPriPool) {
+  const uint64_t kSize = 16 << 20;
+  const int kCharge = 1 << 10;
+
+  for (const double ratio : {0.0, 0.5}) {
+    DBCacheOptions opts = cacheOptions(kSize, 1);
+    opts.high_pri_pool_ratio = ratio;
+    DBCache* cache = DBNewCache(opts);
+    EXPECT_EQ(kSize, cache->rep->GetCapacity());
+
+    // Insert a few high priority blocks, then flood the cache with many
+    // more low priority blocks than it can hold.
+    for (int i = 0; i < 100; i++) {
+      EXPECT_TRUE(cache->rep
+                      ->Insert("index" + std::to_string(i), nullptr, kCharge, noopDeleter, nullptr,
+                               rocksdb::Cache::Priority::HIGH)
+                      .ok());
+    }
+    for (int i = 0; i < 4 * kSize / kCharge; i++) {
+      const std::string key = "data" + std::to_string(i);
+      EXPECT_TRUE(cache->rep->Insert(key, nullptr, kCharge, noopDeleter).ok());
+    }
+
+    // The high priority blocks are only protected by the high priority
+    // pool.
+    int found = 0;
+    for (int i = 0; i < 100; i++) {
+      rocksdb::Cache::Handle* h = cache->rep->Lookup("index" + std::to_string(i));
+      if (h != nullptr) {
+        found++;
+        cache->rep->Release(h);
+      }
+    }
+    EXPECT_EQ(ratio > 0 ? 100 : 0, found) << ratio;
+    DBReleaseCache(cache);
+  }
+}
@@ -13,39 +13,332 @@
 // permissions and limitations under the License.
 
 #include "comparator.h"
+#include <algorithm>
+#include <string.h>
 #include "encoding.h"
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 namespace cockroach {
 
+namespace {
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+// MismatchWord returns the index of the first differing byte of the words
+// loaded from a and b, or -1 if they are equal.
+template <typename T> inline int MismatchWord(const char* a, const char* b) {
+  T wa, wb;
+  memcpy(&wa, a, sizeof(T));
+  memcpy(&wb, b, sizeof(T));
+  if (wa == wb) {
+    return -1;
+  }
+  const T x = wa ^ wb;
+  return (sizeof(T) == 8 ? __builtin_ctzll(x) : __builtin_ctz(x)) >> 3;
+}
+
+// FindMismatchShort handles arrays shorter than 16 bytes with a pair of
+// (possibly overlapping) word loads rather than a byte loop, whose exit
+// branch is poorly predicted.
+inline size_t FindMismatchShort(const char* a, const char* b, size_t n) {
+  if (n >= 8) {
+    int m = MismatchWord<uint64_t>(a, b);
+    if (m >= 0) {
+      return m;
+    }
+    m = MismatchWord<uint64_t>(a + n - 8, b + n - 8);
+    return m >= 0 ? n - 8 + m : n;
+  }
+  if (n >= 4) {
+    int m = MismatchWord<uint32_t>(a, b);
+    if (m >= 0) {
+      return m;
+    }
+    m = MismatchWord<uint32_t>(a + n - 4, b + n - 4);
+    return m >= 0 ? n - 4 + m : n;
+  }
+  size_t i = 0;
+  for (; i < n && a[i] == b[i]; i++) {
+  }
+  return i;
+}
+
+// FindMismatchPortable compares 8 bytes at a time using unaligned scalar
+// loads.
+size_t FindMismatchPortable(const char* a, const char* b, size_t n) {
+  if (n < 16) {
+    return FindMismatchShort(a, b, n);
+  }
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const int m = MismatchWord<uint64_t>(a + i, b + i);
+    if (m >= 0) {
+      return i + m;
+    }
+  }
+  if (i < n) {
+    const int m = MismatchWord<uint64_t>(a + n - 8, b + n - 8);
+    return m >= 0 ? n - 8 + m : n;
+  }
+  return n;
+}
+
+#else  // !little endian
+
+size_t FindMismatchPortable(const char* a, const char* b, size_t n) {
+  size_t i = 0;
+  for (; i < n && a[i] == b[i]; i++) {
+  }
+  return i;
+}
+
+#endif  // little endian
+
+#if defined(__x86_64__)
+
+// MismatchSSE2 returns the index of the first differing byte of the 16 byte
+// vectors at a and b, or -1 if they are equal.
+inline int MismatchSSE2(const char* a, const char* b) {
+  const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+  const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+  const unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) ^ 0xffff;
+  return mask == 0 ? -1 : __builtin_ctz(mask);
+}
+
+// FindMismatchSSE2 compares 16 bytes at a time, finishing with a final
+// overlapping load rather than a scalar tail. SSE2 is part of the x86-64
+// baseline so this variant needs no runtime check. A byte-wise equality
+// compare and movemask is cheaper than the SSE4.2 string instructions
+// (pcmpestri) for this purpose.
+size_t FindMismatchSSE2(const char* a, const char* b, size_t n) {
+  if (n < 16) {
+    return FindMismatchShort(a, b, n);
+  }
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const int m = MismatchSSE2(a + i, b + i);
+    if (m >= 0) {
+      return i + m;
+    }
+  }
+  if (i < n) {
+    const int m = MismatchSSE2(a + n - 16, b + n - 16);
+    return m >= 0 ? n - 16 + m : n;
+  }
+  return n;
+}
+
+// MismatchAVX2 is the 32 byte analog of MismatchSSE2.
+__attribute__((target("avx2"))) inline int MismatchAVX2(const char* a, const char* b) {
+  const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+  const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+  const unsigned mask = ~unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+  return mask == 0 ? -1 : __builtin_ctz(mask);
+}
+
+// FindMismatchAVX2 compares 32 bytes at a time. Keys shorter than 32 bytes,
+// which are the majority, are handled by the SSE2 code.
+__attribute__((target("avx2"))) size_t FindMismatchAVX2(const char* a, const char* b, size_t n) {
+  if (n < 32) {
+    return FindMismatchSSE2(a, b, n);
+  }
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const int m = MismatchAVX2(a + i, b + i);
+    if (m >= 0) {
+      return i + m;
+    }
+  }
+  if (i < n) {
+    const int m = MismatchAVX2(a + n - 32, b + n - 32);
+    return m >= 0 ? n - 32 + m : n;
+  }
+  return n;
+}
+
+#endif  // defined(__x86_64__)
+
+typedef size_t (*FindMismatchFunc)(const char* a, const char* b, size_t n);
+
+FindMismatchFunc GetFindMismatchFunc(KeyCompareImpl impl) {
+  switch (impl) {
+  case kKeyComparePortable:
+    return FindMismatchPortable;
+#if defined(__x86_64__)
+  case kKeyCompareSSE2:
+    return FindMismatchSSE2;
+  case kKeyCompareAVX2:
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return FindMismatchAVX2;
+    }
+    return nullptr;
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+KeyCompareImpl SelectKeyCompareImpl() {
+  if (GetFindMismatchFunc(kKeyCompareAVX2) != nullptr) {
+    return kKeyCompareAVX2;
+  }
+  if (GetFindMismatchFunc(kKeyCompareSSE2) != nullptr) {
+    return kKeyCompareSSE2;
+  }
+  return kKeyComparePortable;
+}
+
+// DefaultFindMismatch returns the FindMismatchFunc of
+// DefaultKeyCompareImpl. The CPU features are detected on first use rather
+// than during static initialization, as comparators may be used by static
+// initializers in other translation units.
+FindMismatchFunc DefaultFindMismatch() {
+  static const FindMismatchFunc find_mismatch = GetFindMismatchFunc(DefaultKeyCompareImpl());
+  return find_mismatch;
+}
+
+}  // namespace
+
+KeyCompareImpl DefaultKeyCompareImpl() {
+  static const KeyCompareImpl impl = SelectKeyCompareImpl();
+  return impl;
+}
+
+bool KeyCompareImplSupported(KeyCompareImpl impl) { return GetFindMismatchFunc(impl) != nullptr; }
+
+size_t FindMismatch(const char* a, const char* b, size_t n, KeyCompareImpl impl) {
+  return GetFindMismatchFunc(impl)(a, b, n);
+}
+
+// Compare is equivalent to splitting both keys with SplitKey, comparing the
+// user keys and then the timestamps in reverse order, but avoids the
+// intermediate slices: the user key lengths are read from the trailing
+// timestamp length bytes and the common prefix of the user keys is scanned
+// with the widest vector loads the CPU supports. Only keys with equal user
+// keys, which are frequent as versions of a key are adjacent, go on to
+// compare timestamps.
 int DBComparator::Compare(const rocksdb::Slice& a, const rocksdb::Slice& b) const {
-  rocksdb::Slice key_a, key_b;
-  rocksdb::Slice ts_a, ts_b;
-  if (!SplitKey(a, &key_a, &ts_a) || !SplitKey(b, &key_b, &ts_b)) {
+  if (a.empty() || b.empty()) {
     // This should never happen unless there is some sort of corruption of
     // the keys.
     return a.compare(b);
   }
+  // The timestamp lengths are read as char, as SplitKey does. Where char is
+  // signed, keys ending in a byte >= 0x80 are not split and compare bytewise.
+  const char ts_size_a = a[a.size() - 1];
+  const char ts_size_b = b[b.size() - 1];
+  if (ts_size_a >= a.size() || ts_size_b >= b.size()) {
+    return a.compare(b);
+  }
+  const size_t key_size_a = a.size() - 1 - ts_size_a;
+  const size_t key_size_b = b.size() - 1 - ts_size_b;
 
-  const int c = key_a.compare(key_b);
-  if (c != 0) {
-    return c;
+  const size_t min_size = std::min(key_size_a, key_size_b);
+  const size_t i = DefaultFindMismatch()(a.data(), b.data(), min_size);
+  if (i < min_size) {
+    return uint8_t(a[i]) < uint8_t(b[i]) ? -1 : +1;
+  }
+  if (key_size_a != key_size_b) {
+    return key_size_a < key_size_b ? -1 : +1;
   }
-  if (ts_a.empty()) {
-    if (ts_b.empty()) {
+
+  if (ts_size_a == 0) {
+    if (ts_size_b == 0) {
       return 0;
     }
     return -1;
-  } else if (ts_b.empty()) {
+  } else if (ts_size_b == 0) {
     return +1;
   }
-  return ts_b.compare(ts_a);
+  return CompareTimestamps(rocksdb::Slice(b.data() + key_size_b, ts_size_b),
+                           rocksdb::Slice(a.data() + key_size_a, ts_size_a));
+}
+
+bool DBComparator::Equal(const rocksdb::Slice& a, const rocksdb::Slice& b) const {
+  if (a == b) {
+    return true;
+  }
+  // The same timestamp has a different encoding in the legacy and varint
+  // logical formats (see EncodeVarintTimestamp). Such keys have a different
+  // timestamp length unless the logical value requires 4 bytes in both.
+  if (a.empty() || b.empty() || a[a.size() - 1] <= 9 || b[b.size() - 1] <= 9) {
+    return false;
+  }
+  return Compare(a, b) == 0;
 }
 
-bool DBComparator::Equal(const rocksdb::Slice& a, const rocksdb::Slice& b) const { return a == b; }
+// FindShortestSeparator shortens the separators stored in index blocks. The
+// result must be a valid MVCC key as it is compared using Compare. When start
+// and limit have different user keys we can replace start with the metadata
+// (unversioned) key of any user key k where start.key < k < limit.key, as that
+// sorts after all versions of start.key and before all versions of
+// limit.key. Two candidates are considered: start.key truncated after the
+// first differing byte with that byte incremented, and the immediate successor
+// start.key+"\x00".
+void DBComparator::FindShortestSeparator(std::string* start, const rocksdb::Slice& limit) const {
+  rocksdb::Slice key_s, key_l;
+  rocksdb::Slice ts_s, ts_l;
+  if (!SplitKey(*start, &key_s, &ts_s) || !SplitKey(limit, &key_l, &ts_l)) {
+    return;
+  }
+  if (key_s.compare(key_l) >= 0) {
+    // Versions of the same user key cannot be separated by a shorter key.
+    return;
+  }
+
+  // The metadata key for a user key k is encoded as k+"\x00" (see EncodeKey),
+  // and is thus one byte longer than k.
+  const size_t min_length = std::min(key_s.size(), key_l.size());
+  size_t diff = 0;
+  while (diff < min_length && key_s[diff] == key_l[diff]) {
+    diff++;
+  }
+  if (diff < min_length) {
+    // The incremented byte must remain below limit.key's byte, or equal it if
+    // limit.key continues past it, for the candidate to sort before limit.key.
+    const int b = uint8_t(key_s[diff]);
+    const int l = uint8_t(key_l[diff]);
+    if ((b + 1 < l || (b + 1 == l && diff + 1 < key_l.size())) && diff + 2 < start->size()) {
+      start->resize(diff + 1);
+      (*start)[diff]++;
+      start->push_back(0);
+      return;
+    }
+  }
 
-// The RocksDB docs say it is safe to leave these two methods unimplemented.
-void DBComparator::FindShortestSeparator(std::string* start, const rocksdb::Slice& limit) const {}
+  // Fall back to the immediate successor of start.key, which is only shorter
+  // if start is a versioned key, and is only a separator if limit.key is not
+  // the successor itself.
+  if (!ts_s.empty() &&
+      !(key_l.size() == key_s.size() + 1 && key_l[key_s.size()] == 0 && key_l.starts_with(key_s))) {
+    start->resize(key_s.size());
+    start->push_back(0);
+    start->push_back(0);
+  }
+}
 
-void DBComparator::FindShortSuccessor(std::string* key) const {}
+// FindShortSuccessor replaces key with the metadata key of the shortest user
+// key greater than key's user key, which sorts after all versions of key.
+void DBComparator::FindShortSuccessor(std::string* key) const {
+  rocksdb::Slice k, ts;
+  if (!SplitKey(*key, &k, &ts)) {
+    return;
+  }
+  for (size_t i = 0; i < k.size(); i++) {
+    if (uint8_t(k[i]) != 0xff) {
+      if (i + 2 < key->size()) {
+        key->resize(i + 1);
+        (*key)[i]++;
+        key->push_back(0);
+      }
+      return;
+    }
+  }
+  // The user key is a run of 0xff bytes; leave it alone.
+}
 
 }  // namespace cockroach
@@ -33,4 +33,24 @@ class DBComparator : public rocksdb::Comparator {
 
 const DBComparator kComparator;
 
+// KeyCompareImpl identifies the implementations used by DBComparator::Compare
+// to find the first differing byte of two user keys.
+enum KeyCompareImpl {
+  kKeyComparePortable,
+  kKeyCompareSSE2,
+  kKeyCompareAVX2,
+};
+
+// DefaultKeyCompareImpl returns the implementation used by
+// DBComparator::Compare, which is the widest one supported by the CPU.
+KeyCompareImpl DefaultKeyCompareImpl();
+
+// KeyCompareImplSupported returns true if impl can be used on this CPU.
+bool KeyCompareImplSupported(KeyCompareImpl impl);
+
+// FindMismatch returns the length of the common prefix of the n byte arrays a
+// and b using the specified (supported) implementation. Exposed for testing
+// and benchmarking.
+size_t FindMismatch(const char* a, const char* b, size_t n, KeyCompareImpl impl);
+
 }  // namespace cockroach
@@ -0,0 +1,118 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "comparator.h"
+#include "encoding.h"
+
+using namespace cockroach;
+
+namespace {
+
+// makeKeys returns sorted keys modeled on SQL table data: a shared
+// table/index prefix, a primary key of varying length and a handful of
+// versions per key in both logical formats. Iterators and compactions mostly
+// compare adjacent keys in sorted order, which often share long prefixes or
+// the entire user key.
+std::vector<std::string> makeKeys(int min_key_len, int max_key_len) {
+  std::mt19937 rng;
+  std::uniform_int_distribution<int> lenDist(min_key_len, max_key_len);
+  std::uniform_int_distribution<int> byteDist(0, 3);
+  std::uniform_int_distribution<int> versionDist(0, 3);
+  std::uniform_int_distribution<int64_t> wallDist(1, 1000);
+  std::uniform_int_distribution<int32_t> logicalDist(0, 2);
+  std::vector<std::string> keys;
+  while (keys.size() < 4096) {
+    std::string key = "\xbd\x89\x88";
+    for (int j = lenDist(rng); j > 0; j--) {
+      key.push_back(char(byteDist(rng)));
+    }
+    keys.push_back(EncodeKey(key, 0, 0));
+    for (int j = versionDist(rng); j > 0; j--) {
+      const int64_t wall_time = wallDist(rng);
+      const int32_t logical = logicalDist(rng);
+      keys.push_back(EncodeKey(key, wall_time, logical));
+      keys.push_back(EncodeKeyVarintLogical(key, wall_time, logical));
+    }
+  }
+  std::sort(keys.begin(), keys.end(), [](const std::string& a, const std::string& b) {
+    return kComparator.Compare(a, b) < 0;
+  });
+  return keys;
+}
+
+// timeAdjacent reports the time per call of cmp on adjacent keys.
+template <typename Cmp>
+void timeAdjacent(const char* name, const std::vector<std::string>& keys, Cmp cmp) {
+  const int kIters = 500;
+  int64_t sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIters; i++) {
+    for (size_t j = 1; j < keys.size(); j++) {
+      sink += cmp(keys[j - 1], keys[j]);
+    }
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const double ops = double(kIters) * (keys.size() - 1);
+  printf("  %-24s %6.1f ns/op (%lld)\n", name,
+         std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / ops,
+         (long long)sink);
+}
+
+}  // namespace
+
+// Times DBComparator::Compare and the FindMismatch implementations it
+// chooses between, using rocksdb::Slice::compare as the baseline.
+int main() {
+  static const struct {
+    KeyCompareImpl impl;
+    const char* name;
+  } impls[] = {
+      {kKeyComparePortable, "FindMismatch/portable"},
+      {kKeyCompareSSE2, "FindMismatch/sse2"},
+      {kKeyCompareAVX2, "FindMismatch/avx2"},
+  };
+  static const struct {
+    int min_key_len;
+    int max_key_len;
+  } sizes[] = {{0, 16}, {16, 48}, {64, 256}};
+
+  printf("default implementation: %d\n", int(DefaultKeyCompareImpl()));
+  for (const auto& size : sizes) {
+    printf("user keys of %d-%d bytes:\n", size.min_key_len, size.max_key_len);
+    const std::vector<std::string> keys = makeKeys(size.min_key_len, size.max_key_len);
+    timeAdjacent("Slice::compare", keys, [](const rocksdb::Slice& a, const rocksdb::Slice& b) {
+      return a.compare(b);
+    });
+    timeAdjacent("DBComparator::Compare", keys,
+                 [](const rocksdb::Slice& a, const rocksdb::Slice& b) {
+                   return kComparator.Compare(a, b);
+                 });
+    for (const auto& i : impls) {
+      if (!KeyCompareImplSupported(i.impl)) {
+        continue;
+      }
+      const KeyCompareImpl impl = i.impl;
+      timeAdjacent(i.name, keys, [impl](const rocksdb::Slice& a, const rocksdb::Slice& b) {
+        return FindMismatch(a.data(), b.data(), std::min(a.size(), b.size()), impl);
+      });
+    }
+  }
+  return 0;
+}
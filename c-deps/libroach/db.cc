@@ -14,11 +14,14 @@
 
 #include "db.h"
 #include <algorithm>
+#include <mutex>
 #include <rocksdb/convenience.h>
+#include <rocksdb/iostats_context.h>
 #include <rocksdb/perf_context.h>
 #include <rocksdb/sst_file_writer.h>
 #include <rocksdb/table.h>
 #include <stdarg.h>
+#include <thread>
 #include "batch.h"
 #include "cache.h"
 #include "comparator.h"
@@ -28,13 +31,17 @@
 #include "env_manager.h"
 #include "eventlistener.h"
 #include "fmt.h"
+#include "gc_filter.h"
 #include "getter.h"
 #include "godefs.h"
+#include "histogram.h"
 #include "iterator.h"
 #include "merge.h"
 #include "options.h"
 #include "snapshot.h"
 #include "status.h"
+#include "timebound.h"
+#include "tombstone_compactor.h"
 
 using namespace cockroach;
 
@@ -61,21 +68,89 @@ DBKey ToDBKey(const rocksdb::Slice& s) {
   return key;
 }
 
-ScopedStats::ScopedStats(DBIterator* iter)
-    : iter_(iter),
-      internal_delete_skipped_count_base_(
-          rocksdb::get_perf_context()->internal_delete_skipped_count) {
+namespace {
+
+// readPerfStats sets the fields of stats which mirror the perf and IO
+// stats context counters of the calling thread.
+void readPerfStats(IteratorStats* stats) {
+  const rocksdb::PerfContext* perf = rocksdb::get_perf_context();
+  const rocksdb::IOStatsContext* io = rocksdb::get_iostats_context();
+  stats->internal_delete_skipped_count = perf->internal_delete_skipped_count;
+  stats->block_cache_hit_count = perf->block_cache_hit_count;
+  stats->block_read_count = perf->block_read_count;
+  stats->block_read_bytes = perf->block_read_byte;
+  stats->block_read_nanos = perf->block_read_time;
+  stats->block_decompress_nanos = perf->block_decompress_time;
+  stats->bloom_sst_hit_count = perf->bloom_sst_hit_count;
+  stats->bloom_sst_miss_count = perf->bloom_sst_miss_count;
+  stats->seek_nanos = perf->seek_internal_seek_time;
+  stats->next_nanos = perf->find_next_user_entry_time;
+  stats->bytes_read = io->bytes_read;
+}
+
+// addPerfStats adds the perf and IO stats counters in cur - base to
+// stats.
+void addPerfStats(const IteratorStats& base, const IteratorStats& cur, IteratorStats* stats) {
+  stats->internal_delete_skipped_count +=
+      cur.internal_delete_skipped_count - base.internal_delete_skipped_count;
+  stats->block_cache_hit_count += cur.block_cache_hit_count - base.block_cache_hit_count;
+  stats->block_read_count += cur.block_read_count - base.block_read_count;
+  stats->block_read_bytes += cur.block_read_bytes - base.block_read_bytes;
+  stats->block_read_nanos += cur.block_read_nanos - base.block_read_nanos;
+  stats->block_decompress_nanos += cur.block_decompress_nanos - base.block_decompress_nanos;
+  stats->bloom_sst_hit_count += cur.bloom_sst_hit_count - base.bloom_sst_hit_count;
+  stats->bloom_sst_miss_count += cur.bloom_sst_miss_count - base.bloom_sst_miss_count;
+  stats->seek_nanos += cur.seek_nanos - base.seek_nanos;
+  stats->next_nanos += cur.next_nanos - base.next_nanos;
+  stats->bytes_read += cur.bytes_read - base.bytes_read;
+}
+
+}  // namespace
+
+ScopedStats::ScopedStats(DBIterator* iter, DBSlice seek_key, DBSlice bound)
+    : iter_(iter), seek_key_(seek_key), bound_(bound), base_() {
   if (iter_->stats != nullptr) {
+    readPerfStats(&base_);
     rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableTimeExceptForMutex);
+  } else if (iter_->tombstone_compactor != nullptr) {
+    // Counting is enough to track skipped tombstones and is cheap.
+    base_.internal_delete_skipped_count =
+        rocksdb::get_perf_context()->internal_delete_skipped_count;
+    rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableCount);
   }
 }
 ScopedStats::~ScopedStats() {
+  uint64_t skipped = 0;
   if (iter_->stats != nullptr) {
-    iter_->stats->internal_delete_skipped_count +=
-        (rocksdb::get_perf_context()->internal_delete_skipped_count -
-         internal_delete_skipped_count_base_);
-    rocksdb::SetPerfLevel(rocksdb::PerfLevel::kDisable);
+    IteratorStats cur = {};
+    readPerfStats(&cur);
+    addPerfStats(base_, cur, iter_->stats.get());
+    skipped = cur.internal_delete_skipped_count - base_.internal_delete_skipped_count;
+  } else if (iter_->tombstone_compactor != nullptr) {
+    skipped = rocksdb::get_perf_context()->internal_delete_skipped_count -
+              base_.internal_delete_skipped_count;
+  } else {
+    return;
+  }
+  if (iter_->tombstone_compactor != nullptr && skipped > 0) {
+    cockroach::TombstoneSpan* span = &iter_->tombstones;
+    span->skipped += skipped;
+    if (seek_key_.data != nullptr) {
+      span->Extend(ToSlice(seek_key_));
+    }
+    // The tombstones were skipped on the way to the key the iterator
+    // stopped at, not necessarily up to the bound of the operation.
+    rocksdb::Slice key;
+    rocksdb::Slice ts;
+    if (iter_->rep->Valid()) {
+      if (SplitKey(iter_->rep->key(), &key, &ts)) {
+        span->Extend(key);
+      }
+    } else if (bound_.data != nullptr) {
+      span->Extend(ToSlice(bound_));
+    }
   }
+  rocksdb::SetPerfLevel(rocksdb::PerfLevel::kDisable);
 }
 
 void BatchSSTablesForCompaction(const std::vector<rocksdb::SstFileMetaData>& sst,
@@ -120,6 +195,65 @@ void BatchSSTablesForCompaction(const std::vector<rocksdb::SstFileMetaData>& sst
   }
 }
 
+rocksdb::Status CompactFilesInParallel(
+    rocksdb::DB* db, const rocksdb::CompactionOptions& options,
+    const std::vector<std::vector<rocksdb::SstFileMetaData>>& file_sets, int output_level,
+    int num_threads) {
+  const std::shared_ptr<rocksdb::Logger> info_log = db->GetOptions().info_log;
+  std::mutex mu;
+  size_t next = 0;
+  size_t done = 0;
+  rocksdb::Status result;
+
+  auto compact = [&](const std::vector<rocksdb::SstFileMetaData>& files) {
+    std::vector<std::string> names;
+    for (const auto& f : files) {
+      names.push_back(f.name);
+    }
+    rocksdb::Status status = db->CompactFiles(options, names, output_level);
+    if (status.IsAborted() && !files.empty()) {
+      // CompactFiles refuses to compact sstables which an automatic
+      // compaction is compacting, while CompactRange waits for it.
+      rocksdb::CompactRangeOptions range_options;
+      range_options.exclusive_manual_compaction = false;
+      range_options.bottommost_level_compaction = rocksdb::BottommostLevelCompaction::kForce;
+      const rocksdb::Slice start(files.front().smallestkey);
+      const rocksdb::Slice end(files.back().largestkey);
+      status = db->CompactRange(range_options, &start, &end);
+    }
+    return status;
+  };
+
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> lock(mu);
+    while (result.ok() && next < file_sets.size()) {
+      const std::vector<rocksdb::SstFileMetaData>& files = file_sets[next++];
+      lock.unlock();
+      rocksdb::Status status = compact(files);
+      lock.lock();
+      if (!status.ok()) {
+        if (result.ok()) {
+          result = status;
+        }
+        break;
+      }
+      ++done;
+      rocksdb::Info(info_log, "manual compaction: compacted %d of %d sets of sstables", int(done),
+                    int(file_sets.size()));
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < std::min<int>(num_threads, file_sets.size()); i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : threads) {
+    t.join();
+  }
+  return result;
+}
+
 }  // namespace cockroach
 
 namespace {
@@ -231,8 +365,36 @@ DBStatus DBOpen(DBEngine** db, DBSlice dir, DBOptions db_opts) {
   if (!status.ok()) {
     return ToDBStatus(status);
   }
+  // Seed the write stall stats with the state of the existing sstables
+  // and let stall condition changes refresh them.
+  event_listener->SetDB(db_ptr);
+  event_listener->UpdateWriteStallStats(db_ptr);
+
+  // Compact the spans in which iterators skip many deletion tombstones.
+  std::unique_ptr<cockroach::TombstoneCompactor> tombstone_compactor;
+  if (db_opts.compact_tombstones && !db_opts.read_only) {
+    std::shared_ptr<rocksdb::Logger> info_log = options.info_log;
+    auto compact = [db_ptr, info_log](const std::string& start, const std::string& end) {
+      rocksdb::CompactRangeOptions compact_opts;
+      compact_opts.exclusive_manual_compaction = false;
+      compact_opts.bottommost_level_compaction = rocksdb::BottommostLevelCompaction::kSkip;
+      // The meta key sorts before all versions of a key.
+      const std::string start_key = EncodeKey(start, 0, 0);
+      const std::string end_key = EncodeKey(end, 0, 0);
+      const rocksdb::Slice start_slice(start_key);
+      const rocksdb::Slice end_slice(end_key);
+      rocksdb::Status status = db_ptr->CompactRange(compact_opts, &start_slice, &end_slice);
+      rocksdb::Info(info_log, "compacted tombstones in %s - %s: %s",
+                    rocksdb::Slice(start).ToString(true).c_str(),
+                    rocksdb::Slice(end).ToString(true).c_str(), status.ToString().c_str());
+      return status;
+    };
+    tombstone_compactor.reset(
+        new cockroach::TombstoneCompactor(compact, cockroach::TombstoneCompactor::Options()));
+  }
   *db = new DBImpl(db_ptr, std::move(env_mgr),
-                   db_opts.cache != nullptr ? db_opts.cache->rep : nullptr, event_listener);
+                   db_opts.cache != nullptr ? db_opts.cache->rep : nullptr, event_listener,
+                   std::move(tombstone_compactor));
   return kSuccess;
 }
 
@@ -284,10 +446,11 @@ DBStatus DBCompact(DBEngine* db) {
 DBStatus DBCompactRange(DBEngine* db, DBSlice start, DBSlice end, bool force_bottommost) {
   rocksdb::CompactRangeOptions options;
   // By default, RocksDB doesn't recompact the bottom level (unless
-  // there is a compaction filter, which we don't use). However,
-  // recompacting the bottom layer is necessary to pick up changes to
-  // settings like bloom filter configurations, and to fully reclaim
-  // space after dropping, truncating, or migrating tables.
+  // there is a compaction filter, which we only use if the GC
+  // compaction filter is enabled). However, recompacting the bottom
+  // layer is necessary to pick up changes to settings like bloom filter
+  // configurations, and to fully reclaim space after dropping,
+  // truncating, or migrating tables.
   if (force_bottommost) {
     options.bottommost_level_compaction = rocksdb::BottommostLevelCompaction::kForce;
   }
@@ -382,20 +545,179 @@ DBStatus DBCompactRange(DBEngine* db, DBSlice start, DBSlice end, bool force_bot
   std::vector<rocksdb::Range> ranges;
   BatchSSTablesForCompaction(sst, start_key, end_key, target_size, &ranges);
 
-  for (auto r : ranges) {
-    rocksdb::Status status = db->rep->CompactRange(options, r.start.empty() ? nullptr : &r.start,
-                                                   r.limit.empty() ? nullptr : &r.limit);
-    if (!status.ok()) {
-      return ToDBStatus(status);
+  // RocksDB runs one manual compaction of a column family at a time, so
+  // compacting the ranges concurrently would not speed anything up. If
+  // the bottom-most level is to be rewritten, these compactions only
+  // move the data of the higher levels down and the bottom-most
+  // sstables are rewritten below, several at a time.
+  if (force_bottommost) {
+    options.bottommost_level_compaction = rocksdb::BottommostLevelCompaction::kSkip;
+  }
+  if (!force_bottommost || sst.size() < metadata.size()) {
+    for (const auto& r : ranges) {
+      rocksdb::Status status = db->rep->CompactRange(
+          options, r.start.empty() ? nullptr : &r.start, r.limit.empty() ? nullptr : &r.limit);
+      if (!status.ok()) {
+        return ToDBStatus(status);
+      }
     }
   }
+  if (!force_bottommost) {
+    return kSuccess;
+  }
+
+  // CompactFiles runs the compaction in the calling thread and only
+  // conflicts with compactions of the same sstables, so disjoint sets of
+  // bottom-most sstables can be rewritten concurrently. The sets are
+  // batched like the ranges above.
+  std::vector<rocksdb::SstFileMetaData> bottommost;
+  db->rep->GetLiveFilesMetaData(&all_metadata);
+  for (const auto& f : all_metadata) {
+    if (f.level == max_level && (start_key.empty() || f.largestkey >= start_key) &&
+        (end_key.empty() || f.smallestkey < end_key)) {
+      bottommost.push_back(f);
+    }
+  }
+  std::sort(bottommost.begin(), bottommost.end(),
+            [](const rocksdb::SstFileMetaData& a, const rocksdb::SstFileMetaData& b) -> bool {
+              return a.smallestkey < b.smallestkey;
+            });
+  std::vector<std::vector<rocksdb::SstFileMetaData>> file_sets;
+  uint64_t size = target_size;
+  for (const auto& f : bottommost) {
+    if (size >= target_size) {
+      file_sets.emplace_back();
+      size = 0;
+    }
+    file_sets.back().push_back(f);
+    size += f.size;
+  }
+
+  // CompactFiles does not pick the compression and the size of its
+  // output sstables by level, so use those of the bottom-most level.
+  const rocksdb::Options db_options = db->rep->GetOptions();
+  rocksdb::CompactionOptions compact_options;
+  if (db_options.bottommost_compression != rocksdb::kDisableCompressionOption) {
+    compact_options.compression = db_options.bottommost_compression;
+  } else if (!db_options.compression_per_level.empty()) {
+    compact_options.compression = db_options.compression_per_level.back();
+  } else {
+    compact_options.compression = db_options.compression;
+  }
+  compact_options.output_file_size_limit = db_options.target_file_size_base;
+  for (int level = 1; level < max_level; level++) {
+    compact_options.output_file_size_limit *= db_options.target_file_size_multiplier;
+  }
+
+  // We use half of the background compaction threads, leaving the rest
+  // for automatic compactions, and thus need temporary disk space for
+  // at most that many sets of sstables at a time. The compactions go
+  // through the rate limiter, if any, like automatic compactions.
+  const int num_threads =
+      std::max(db->rep->GetEnv()->GetBackgroundThreads(rocksdb::Env::LOW) / 2, 1);
+  return ToDBStatus(
+      CompactFilesInParallel(db->rep, compact_options, file_sets, max_level, num_threads));
+}
+
+namespace {
+
+// ParseOptionsMap parses a "key1=value1;key2=value2" options string.
+DBStatus ParseOptionsMap(DBSlice options, std::unordered_map<std::string, std::string>* opts_map) {
+  rocksdb::Status status = rocksdb::StringToMap(ToString(options), opts_map);
+  if (!status.ok()) {
+    return ToDBStatus(status);
+  }
+  if (opts_map->empty()) {
+    return FmtStatus("no options specified");
+  }
+  return kSuccess;
+}
+
+}  // namespace
+
+DBStatus DBSetOptions(DBEngine* db, DBSlice options) {
+  std::unordered_map<std::string, std::string> opts_map;
+  DBStatus status = ParseOptionsMap(options, &opts_map);
+  if (status.data != NULL) {
+    return status;
+  }
+
+  // Apply the changes to a copy of the current options to reject
+  // unknown options, malformed values and inconsistent combinations
+  // before any change is made. RocksDB itself rejects immutable
+  // options.
+  rocksdb::ColumnFamilyOptions cf_opts;
+  rocksdb::Status s =
+      rocksdb::GetColumnFamilyOptionsFromMap(db->rep->GetOptions(), opts_map, &cf_opts);
+  if (!s.ok()) {
+    return ToDBStatus(s);
+  }
+  if (cf_opts.level0_file_num_compaction_trigger > cf_opts.level0_slowdown_writes_trigger ||
+      cf_opts.level0_slowdown_writes_trigger > cf_opts.level0_stop_writes_trigger) {
+    return FmtStatus("level0_file_num_compaction_trigger (%d) <= level0_slowdown_writes_trigger "
+                     "(%d) <= level0_stop_writes_trigger (%d) must hold",
+                     cf_opts.level0_file_num_compaction_trigger,
+                     cf_opts.level0_slowdown_writes_trigger, cf_opts.level0_stop_writes_trigger);
+  }
+  if (cf_opts.soft_pending_compaction_bytes_limit > cf_opts.hard_pending_compaction_bytes_limit &&
+      cf_opts.hard_pending_compaction_bytes_limit > 0) {
+    return FmtStatus("soft_pending_compaction_bytes_limit must not exceed "
+                     "hard_pending_compaction_bytes_limit");
+  }
+  return ToDBStatus(db->rep->SetOptions(opts_map));
+}
+
+DBStatus DBSetDBOptions(DBEngine* db, DBSlice options) {
+  std::unordered_map<std::string, std::string> opts_map;
+  DBStatus status = ParseOptionsMap(options, &opts_map);
+  if (status.data != NULL) {
+    return status;
+  }
+
+  rocksdb::DBOptions db_opts;
+  rocksdb::Status s = rocksdb::GetDBOptionsFromMap(db->rep->GetDBOptions(), opts_map, &db_opts);
+  if (!s.ok()) {
+    return ToDBStatus(s);
+  }
+  // Mirror DBMakeOptions which always uses at least 2 background
+  // threads so that compactions and flushes do not starve each other.
+  if (db_opts.max_background_jobs < 2) {
+    return FmtStatus("max_background_jobs must be at least 2");
+  }
+  return ToDBStatus(db->rep->SetDBOptions(opts_map));
+}
 
+DBStatus DBSetRateLimit(DBEngine* db, int64_t bytes_per_sec) {
+  const std::shared_ptr<rocksdb::RateLimiter>& limiter = db->rep->GetDBOptions().rate_limiter;
+  if (limiter == nullptr) {
+    return FmtStatus("rate limiting is not enabled");
+  }
+  if (bytes_per_sec <= 0) {
+    return FmtStatus("rate limit must be positive: %lld", (long long)bytes_per_sec);
+  }
+  limiter->SetBytesPerSecond(bytes_per_sec);
   return kSuccess;
 }
 
+DBStatus DBSetGCThresholds(DBEngine* db, const DBGCThreshold* thresholds, int len) {
+  const std::shared_ptr<rocksdb::CompactionFilterFactory> factory =
+      db->rep->GetOptions().compaction_filter_factory;
+  if (factory == nullptr || strcmp(factory->Name(), GCCompactionFilterFactory::kName) != 0) {
+    return FmtStatus("GC compaction filter is not enabled");
+  }
+  std::vector<GCThreshold> gc_thresholds;
+  for (int i = 0; i < len; i++) {
+    gc_thresholds.push_back(
+        GCThreshold{ToString(thresholds[i].start), ToString(thresholds[i].end),
+                    thresholds[i].threshold});
+  }
+  return ToDBStatus(
+      static_cast<GCCompactionFilterFactory*>(factory.get())->SetThresholds(gc_thresholds));
+}
+
 DBStatus DBApproximateDiskBytes(DBEngine* db, DBKey start, DBKey end, uint64_t* size) {
-  const std::string start_key(EncodeKey(start));
-  const std::string end_key(EncodeKey(end));
+  const EncodedKey start_key(start);
+  const EncodedKey end_key(end);
   const rocksdb::Range r(start_key, end_key);
   const uint8_t flags = rocksdb::DB::SizeApproximationFlags::INCLUDE_FILES;
 
@@ -407,16 +729,48 @@ DBStatus DBPut(DBEngine* db, DBKey key, DBSlice value) { return db->Put(key, val
 
 DBStatus DBMerge(DBEngine* db, DBKey key, DBSlice value) { return db->Merge(key, value); }
 
-DBStatus DBGet(DBEngine* db, DBKey key, DBString* value) { return db->Get(key, value); }
+DBStatus DBGet(DBEngine* db, DBKey key, DBString* value) {
+  ScopedLatency latency(kHistogramGet);
+  return db->Get(key, value);
+}
 
 DBStatus DBDelete(DBEngine* db, DBKey key) { return db->Delete(key); }
 
 DBStatus DBDeleteRange(DBEngine* db, DBKey start, DBKey end) { return db->DeleteRange(start, end); }
 
+DBStatus DBDeleteFilesAndRange(DBEngine* db, DBKey start, DBKey end) {
+  const EncodedKey start_key(start);
+  const EncodedKey end_key(end);
+  const rocksdb::Slice start_slice(start_key);
+  const rocksdb::Slice end_slice(end_key);
+  rocksdb::ColumnFamilyHandle* const cf = db->rep->DefaultColumnFamily();
+
+  // Drop the sstables which lie entirely within the span, freeing their
+  // space without reading or rewriting them. The end of the span is
+  // exclusive.
+  rocksdb::Status status =
+      rocksdb::DeleteFilesInRange(db->rep, cf, &start_slice, &end_slice, false /* include_end */);
+  if (!status.ok()) {
+    return ToDBStatus(status);
+  }
+
+  // Delete the remaining keys, which are in the memtables, in L0 and in
+  // the sstables straddling the boundaries of the span.
+  status = db->rep->DeleteRange(rocksdb::WriteOptions(), cf, start_slice, end_slice);
+  if (!status.ok()) {
+    return ToDBStatus(status);
+  }
+
+  // Mark the sstables overlapping the span for compaction, so that the
+  // space of the remaining keys is reclaimed soon. The compactions run in
+  // the background.
+  return ToDBStatus(db->rep->SuggestCompactRange(cf, &start_slice, &end_slice));
+}
+
 DBStatus DBDeleteIterRange(DBEngine* db, DBIterator* iter, DBKey start, DBKey end) {
   rocksdb::Iterator* const iter_rep = iter->rep.get();
-  iter_rep->Seek(EncodeKey(start));
-  const std::string end_key = EncodeKey(end);
+  iter_rep->Seek(EncodedKey(start));
+  const EncodedKey end_key(end);
   for (; iter_rep->Valid() && kComparator.Compare(iter_rep->key(), end_key) < 0; iter_rep->Next()) {
     DBStatus status = db->Delete(ToDBKey(iter_rep->key()));
     if (status.data != NULL) {
@@ -427,7 +781,11 @@ DBStatus DBDeleteIterRange(DBEngine* db, DBIterator* iter, DBKey start, DBKey en
 }
 
 DBStatus DBCommitAndCloseBatch(DBEngine* db, bool sync) {
-  DBStatus status = db->CommitBatch(sync);
+  DBStatus status;
+  {
+    ScopedLatency latency(kHistogramCommitBatch);
+    status = db->CommitBatch(sync);
+  }
   if (status.data == NULL) {
     DBClose(db);
   }
@@ -435,6 +793,7 @@ DBStatus DBCommitAndCloseBatch(DBEngine* db, bool sync) {
 }
 
 DBStatus DBApplyBatchRepr(DBEngine* db, DBSlice repr, bool sync) {
+  ScopedLatency latency(kHistogramApplyBatchRepr);
   return db->ApplyBatchRepr(repr, sync);
 }
 
@@ -501,34 +860,42 @@ DBIterator* DBNewTimeBoundIter(DBEngine* db, DBTimestamp min_ts, DBTimestamp max
 
   const std::string min = EncodeTimestamp(min_ts);
   const std::string max = EncodeTimestamp(max_ts);
+  TimeBoundCache* cache = db->timebound_cache;
   rocksdb::ReadOptions opts;
   opts.total_order_seek = true;
-  opts.table_filter = [min, max, stats](const rocksdb::TableProperties& props) {
-    auto userprops = props.user_collected_properties;
-    auto tbl_min = userprops.find("crdb.ts.min");
-    if (tbl_min == userprops.end() || tbl_min->second.empty()) {
-      if (stats != nullptr) {
-        ++stats->timebound_num_ssts;
-      }
-      return true;
-    }
-    auto tbl_max = userprops.find("crdb.ts.max");
-    if (tbl_max == userprops.end() || tbl_max->second.empty()) {
-      if (stats != nullptr) {
+  opts.table_filter = [min_ts, max_ts, min, max, cache,
+                       stats](const rocksdb::TableProperties& props) {
+    // If the timestamp range of the table overlaps with the timestamp range we
+    // want to iterate, the table might contain timestamps we care about. The
+    // decoded bounds are usually cached for the properties held by the table
+    // reader.
+    const auto bounds = cache->Get(props);
+    bool used = bounds != nullptr
+                    ? bounds->bounds.Overlaps(min_ts, max_ts)
+                    : TimeBoundTableOverlaps(props.user_collected_properties, min, max);
+    if (stats != nullptr) {
+      if (used) {
         ++stats->timebound_num_ssts;
+      } else {
+        ++stats->timebound_num_ssts_pruned;
       }
-      return true;
-    }
-    // If the timestamp range of the table overlaps with the timestamp range we
-    // want to iterate, the table might contain timestamps we care about.
-    bool used = max.compare(tbl_min->second) >= 0 && min.compare(tbl_max->second) <= 0;
-    if (used && stats != nullptr) {
-      ++stats->timebound_num_ssts;
     }
     return used;
   };
 
-  auto db_iter = db->NewIter(&opts);
+  // Within the tables that are used, skip the segments whose timestamp range
+  // does not overlap.
+  auto new_iter = [db](rocksdb::ReadOptions* read_opts) -> rocksdb::Iterator* {
+    std::unique_ptr<DBIterator> iter(db->NewIter(read_opts));
+    return iter == nullptr ? nullptr : iter->rep.release();
+  };
+  rocksdb::Iterator* rep = NewTimeBoundIterator(db->rep, cache, new_iter, opts, min_ts, max_ts);
+  if (rep == nullptr) {
+    delete stats;
+    return nullptr;
+  }
+  DBIterator* db_iter = new DBIterator(db->iters, db->tombstone_compactor);
+  db_iter->rep.reset(rep);
   if (stats != nullptr) {
     db_iter->stats.reset(stats);
   }
@@ -546,8 +913,8 @@ IteratorStats DBIterStats(DBIterator* iter) {
 }
 
 DBIterState DBIterSeek(DBIterator* iter, DBKey key) {
-  ScopedStats stats(iter);
-  iter->rep->Seek(EncodeKey(key));
+  ScopedStats stats(iter, key.key);
+  iter->rep->Seek(EncodedKey(key));
   return DBIterGetState(iter);
 }
 
@@ -599,7 +966,7 @@ DBIterState DBIterNext(DBIterator* iter, bool skip_current_key_versions) {
       db_key.key = ToDBSlice(old_key);
       db_key.wall_time = 0;
       db_key.logical = 0;
-      iter->rep->Seek(EncodeKey(db_key));
+      iter->rep->Seek(EncodedKey(db_key));
     }
   }
 
@@ -633,7 +1000,7 @@ DBIterState DBIterPrev(DBIterator* iter, bool skip_current_key_versions) {
         db_key.key = ToDBSlice(old_key);
         db_key.wall_time = 0;
         db_key.logical = 0;
-        iter->rep->Seek(EncodeKey(db_key));
+        iter->rep->Seek(EncodedKey(db_key));
         if (iter->rep->Valid()) {
           iter->rep->Prev();
         }
@@ -681,12 +1048,28 @@ DBString DBGetCompactionStats(DBEngine* db) { return db->GetCompactionStats(); }
 
 DBStatus DBGetEnvStats(DBEngine* db, DBEnvStatsResult* stats) { return db->GetEnvStats(stats); }
 
+DBStatus DBGetWriteStallStats(DBEngine* db, DBWriteStallStats* stats) {
+  return db->GetWriteStallStats(stats);
+}
+
+DBStatus DBGetHistograms(DBHistogramsResult* result) {
+  GetHistogram(kHistogramGet, &result->get);
+  GetHistogram(kHistogramMVCCGet, &result->mvcc_get);
+  GetHistogram(kHistogramMVCCScan, &result->mvcc_scan);
+  GetHistogram(kHistogramCommitBatch, &result->commit_batch);
+  GetHistogram(kHistogramApplyBatchRepr, &result->apply_batch_repr);
+  GetHistogram(kHistogramIngestExternalFiles, &result->ingest_external_files);
+  GetHistogram(kHistogramSstFileWriterFinish, &result->sst_file_writer_finish);
+  return kSuccess;
+}
+
 DBSSTable* DBGetSSTables(DBEngine* db, int* n) { return db->GetSSTables(n); }
 
 DBString DBGetUserProperties(DBEngine* db) { return db->GetUserProperties(); }
 
 DBStatus DBIngestExternalFiles(DBEngine* db, char** paths, size_t len, bool move_files,
                                bool allow_file_modifications) {
+  ScopedLatency latency(kHistogramIngestExternalFiles);
   std::vector<std::string> paths_vec;
   for (size_t i = 0; i < len; i++) {
     paths_vec.push_back(paths[i]);
@@ -763,7 +1146,7 @@ DBStatus DBSstFileWriterOpen(DBSstFileWriter* fw) {
 }
 
 DBStatus DBSstFileWriterAdd(DBSstFileWriter* fw, DBKey key, DBSlice val) {
-  rocksdb::Status status = fw->rep.Put(EncodeKey(key), ToSlice(val));
+  rocksdb::Status status = fw->rep.Put(EncodedKey(key), ToSlice(val));
   if (!status.ok()) {
     return ToDBStatus(status);
   }
@@ -771,6 +1154,7 @@ DBStatus DBSstFileWriterAdd(DBSstFileWriter* fw, DBKey key, DBSlice val) {
 }
 
 DBStatus DBSstFileWriterFinish(DBSstFileWriter* fw, DBString* data) {
+  ScopedLatency latency(kHistogramSstFileWriterFinish);
   rocksdb::Status status = fw->rep.Finish();
   if (!status.ok()) {
     return ToDBStatus(status);
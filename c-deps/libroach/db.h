@@ -74,15 +74,24 @@ MVCCStatsResult MVCCComputeStatsInternal(::rocksdb::Iterator* const iter_rep, DB
 
 // ScopedStats wraps an iterator and, if that iterator has the stats
 // member populated, aggregates a subset of the RocksDB perf counters
-// into it (while the ScopedStats is live).
+// into it (while the ScopedStats is live). If the iterator has a
+// tombstone compactor, the deletion tombstones skipped are added to the
+// iterator's tombstone span, which is widened to include the user key
+// the operation seeks to (if not empty) and the key the iterator is
+// positioned at afterwards. If the iterator is exhausted afterwards, it
+// moved past bound (if not empty), which is used instead.
 class ScopedStats {
  public:
-  ScopedStats(DBIterator*);
+  ScopedStats(DBIterator*, DBSlice seek_key = DBSlice(), DBSlice bound = DBSlice());
   ~ScopedStats();
 
  private:
   DBIterator* const iter_;
-  uint64_t internal_delete_skipped_count_base_;
+  const DBSlice seek_key_;
+  const DBSlice bound_;
+  // The perf and IO stats context counters when the ScopedStats was
+  // created.
+  IteratorStats base_;
 };
 
 // BatchSStables batches the supplied sstable metadata into chunks of
@@ -94,4 +103,16 @@ void BatchSSTablesForCompaction(const std::vector<rocksdb::SstFileMetaData>& sst
                                 rocksdb::Slice start_key, rocksdb::Slice end_key,
                                 uint64_t target_size, std::vector<rocksdb::Range>* ranges);
 
+// CompactFilesInParallel compacts each of the specified sets of
+// sstables into output_level, with up to num_threads compactions
+// running concurrently. The sets must cover disjoint key ranges. A set
+// some of whose sstables are already being compacted is compacted with
+// CompactRange instead. Progress is logged to the DB's info log. Once a
+// compaction fails no further compactions are started and the first
+// error is returned.
+rocksdb::Status CompactFilesInParallel(
+    rocksdb::DB* db, const rocksdb::CompactionOptions& options,
+    const std::vector<std::vector<rocksdb::SstFileMetaData>>& file_sets, int output_level,
+    int num_threads);
+
 }  // namespace cockroach
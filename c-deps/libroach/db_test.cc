@@ -11,8 +11,11 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
 // implied.  See the License for the specific language governing
 // permissions and limitations under the License.
+#include <algorithm>
 
 #include "db.h"
+#include "encoding.h"
+#include "engine.h"
 #include "include/libroach.h"
 #include "status.h"
 #include "testutils.h"
@@ -49,6 +52,320 @@ TEST(Libroach, DBOpen) {
   DBClose(db);
 }
 
+TEST(Libroach, DBPartitionedIndexFilters) {
+  for (const bool partitioned : {false, true}) {
+    DBOptions db_opts = defaultDBOptions();
+    db_opts.partitioned_index_filters = partitioned;
+    DBEngine* db;
+
+    EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+    for (int i = 0; i < 1000; i++) {
+      const std::string key = "key" + std::to_string(i);
+      DBKey k = {ToDBSlice(key), 1, 0};
+      EXPECT_STREQ(DBPut(db, k, ToDBSlice("value")).data, NULL);
+    }
+    EXPECT_STREQ(DBFlush(db).data, NULL);
+
+    int n;
+    DBSSTable* tables = DBGetSSTables(db, &n);
+    ASSERT_EQ(1, n);
+    EXPECT_GT(tables[0].index_size, 0);
+    EXPECT_GT(tables[0].filter_size, 0);
+    if (partitioned) {
+      EXPECT_GT(tables[0].top_level_index_size, 0);
+    } else {
+      EXPECT_EQ(0, tables[0].top_level_index_size);
+    }
+    free(tables[0].start_key.key.data);
+    free(tables[0].end_key.key.data);
+    free(tables);
+
+    DBClose(db);
+  }
+}
+
+TEST(Libroach, DBTieredCompression) {
+  DBOptions db_opts = defaultDBOptions();
+  db_opts.tiered_compression = true;
+  DBEngine* db;
+
+  // Without ZSTD the DB does not open rather than leaving sstables
+  // uncompressed.
+  DBStatus status = DBOpen(&db, DBSlice(), db_opts);
+  if (status.data != NULL) {
+    EXPECT_NE(std::string::npos, ToString(status).find("ZSTD")) << ToString(status);
+    free(status.data);
+    return;
+  }
+  const rocksdb::Options opts = db->rep->GetOptions();
+  EXPECT_EQ(rocksdb::kNoCompression, opts.compression_per_level[0]);
+  EXPECT_EQ(rocksdb::kSnappyCompression, opts.compression_per_level[1]);
+  EXPECT_EQ(rocksdb::kZSTD, opts.compression_per_level.back());
+  EXPECT_EQ(rocksdb::kZSTD, opts.bottommost_compression);
+  EXPECT_GT(opts.compression_opts.max_dict_bytes, 0);
+
+  // Push the data to the bottommost level and read it back.
+  for (int i = 0; i < 1000; i++) {
+    const std::string key = "key" + std::to_string(i);
+    DBKey k = {ToDBSlice(key), 1, 0};
+    EXPECT_STREQ(DBPut(db, k, ToDBSlice("value" + std::to_string(i))).data, NULL);
+  }
+  EXPECT_STREQ(DBFlush(db).data, NULL);
+  EXPECT_STREQ(DBCompact(db).data, NULL);
+  DBKey k = {ToDBSlice("key500"), 1, 0};
+  DBString value;
+  EXPECT_STREQ(DBGet(db, k, &value).data, NULL);
+  EXPECT_EQ("value500", ToString(value));
+  free(value.data);
+
+  DBClose(db);
+}
+
+TEST(Libroach, DBSetOptions) {
+  DBOptions db_opts = defaultDBOptions();
+  DBEngine* db;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+
+  auto errorOf = [](DBStatus status) {
+    std::string err = ToString(status);
+    free(status.data);
+    return err;
+  };
+
+  EXPECT_STREQ(DBSetOptions(db, ToDBSlice("level0_slowdown_writes_trigger=24")).data, NULL);
+  EXPECT_EQ(24, db->rep->GetOptions().level0_slowdown_writes_trigger);
+  EXPECT_EQ("no options specified", errorOf(DBSetOptions(db, ToDBSlice(""))));
+  EXPECT_NE("", errorOf(DBSetOptions(db, ToDBSlice("unknown_option=1"))));
+  // Invalid combinations are rejected without applying any change.
+  const std::string err = errorOf(DBSetOptions(
+      db, ToDBSlice("level0_slowdown_writes_trigger=30;level0_stop_writes_trigger=25")));
+  EXPECT_NE(std::string::npos, err.find("must hold")) << err;
+  EXPECT_EQ(24, db->rep->GetOptions().level0_slowdown_writes_trigger);
+
+  EXPECT_STREQ(DBSetDBOptions(db, ToDBSlice("max_background_jobs=8")).data, NULL);
+  EXPECT_EQ(8, db->rep->GetDBOptions().max_background_jobs);
+  EXPECT_NE(std::string::npos, errorOf(DBSetDBOptions(db, ToDBSlice("max_background_jobs=1")))
+                                   .find("must be at least 2"));
+
+  DBClose(db);
+}
+
+TEST(Libroach, DBSetRateLimit) {
+  DBOptions db_opts = defaultDBOptions();
+  DBEngine* db;
+
+  // Without a rate limiter the limit cannot be changed.
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+  DBStatus status = DBSetRateLimit(db, 1 << 20);
+  EXPECT_EQ("rate limiting is not enabled", ToString(status));
+  free(status.data);
+  DBStatsResult stats;
+  EXPECT_STREQ(DBGetStats(db, &stats).data, NULL);
+  EXPECT_EQ(0, stats.rate_limit_bytes_per_sec);
+  DBClose(db);
+
+  db_opts.rate_limit_bytes_per_sec = 64 << 20;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+  EXPECT_NE(nullptr, db->rep->GetDBOptions().rate_limiter);
+
+  // Flushes are written through the limiter at high priority.
+  for (int i = 0; i < 100; i++) {
+    const std::string key = "key" + std::to_string(i);
+    DBKey k = {ToDBSlice(key), 1, 0};
+    EXPECT_STREQ(DBPut(db, k, ToDBSlice("value")).data, NULL);
+  }
+  EXPECT_STREQ(DBFlush(db).data, NULL);
+  EXPECT_STREQ(DBGetStats(db, &stats).data, NULL);
+  EXPECT_GT(stats.rate_limit_bytes_per_sec, 0);
+  EXPECT_LE(stats.rate_limit_bytes_per_sec, 64 << 20);
+  EXPECT_GT(stats.rate_limiter_flush_bytes, 0);
+
+  EXPECT_STREQ(DBSetRateLimit(db, 16 << 20).data, NULL);
+  EXPECT_GT(db->rep->GetDBOptions().rate_limiter->GetBytesPerSecond(), 0);
+  EXPECT_LE(db->rep->GetDBOptions().rate_limiter->GetBytesPerSecond(), 16 << 20);
+  status = DBSetRateLimit(db, 0);
+  EXPECT_EQ("rate limit must be positive: 0", ToString(status));
+  free(status.data);
+
+  DBClose(db);
+}
+
+TEST(Libroach, DBDeleteFilesAndRange) {
+  DBOptions db_opts = defaultDBOptions();
+  DBEngine* db;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+
+  auto put = [&](const std::string& prefix) {
+    for (int i = 0; i < 100; i++) {
+      const std::string key = prefix + std::to_string(i);
+      DBKey k = {ToDBSlice(key), 1, 0};
+      EXPECT_STREQ(DBPut(db, k, ToDBSlice("value")).data, NULL);
+    }
+  };
+  auto numFiles = [&]() {
+    std::vector<rocksdb::LiveFileMetaData> files;
+    db->rep->GetLiveFilesMetaData(&files);
+    return files.size();
+  };
+  auto count = [&](const std::string& prefix) {
+    DBIterator* iter = DBNewIter(db, false /* prefix */, false /* stats */);
+    int n = 0;
+    for (DBIterState state = DBIterSeek(iter, DBKey{ToDBSlice(prefix), 0, 0});
+         state.valid && ToString(state.key.key).compare(0, prefix.size(), prefix) == 0;
+         state = DBIterNext(iter, false /* skip_current_key_versions */)) {
+      n++;
+    }
+    DBIterDestroy(iter);
+    return n;
+  };
+
+  // An sstable containing only keys within the span, followed by an
+  // sstable straddling the span and some keys in the memtable.
+  put("b");
+  EXPECT_STREQ(DBCompact(db).data, NULL);
+  put("a");
+  put("c");
+  EXPECT_STREQ(DBFlush(db).data, NULL);
+  put("b1");
+  EXPECT_EQ(2, numFiles());
+
+  DBKey start = {ToDBSlice("b"), 0, 0};
+  DBKey end = {ToDBSlice("c"), 0, 0};
+  EXPECT_STREQ(DBDeleteFilesAndRange(db, start, end).data, NULL);
+  EXPECT_EQ(1, numFiles());
+  EXPECT_EQ(100, count("a"));
+  EXPECT_EQ(0, count("b"));
+  EXPECT_EQ(100, count("c"));
+
+  DBClose(db);
+}
+
+TEST(Libroach, DBGetWriteStallStats) {
+  DBOptions db_opts = defaultDBOptions();
+  DBEngine* db;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+
+  DBWriteStallStats stats;
+  EXPECT_STREQ(DBGetWriteStallStats(db, &stats).data, NULL);
+  EXPECT_EQ(0, stats.l0_file_count);
+  EXPECT_EQ(0, stats.immutable_memtable_count);
+  EXPECT_EQ(0, stats.stall_condition);
+  EXPECT_EQ(0, stats.stall_condition_nanos);
+
+  DBKey k = {ToDBSlice("a"), 1, 0};
+  EXPECT_STREQ(DBPut(db, k, ToDBSlice("value")).data, NULL);
+  EXPECT_STREQ(DBFlush(db).data, NULL);
+  EXPECT_STREQ(DBGetWriteStallStats(db, &stats).data, NULL);
+  EXPECT_EQ(1, stats.l0_file_count);
+  EXPECT_EQ(0, stats.immutable_memtable_count);
+
+  EXPECT_STREQ(DBCompact(db).data, NULL);
+  EXPECT_STREQ(DBGetWriteStallStats(db, &stats).data, NULL);
+  EXPECT_EQ(0, stats.l0_file_count);
+
+  // Stall condition changes refresh the counts, which may have changed
+  // without a flush or compaction completing.
+  EXPECT_STREQ(DBPut(db, k, ToDBSlice("value")).data, NULL);
+  EXPECT_STREQ(DBFlush(db).data, NULL);
+  DBEventListener listener;
+  listener.SetDB(db->rep);
+  listener.GetWriteStallStats(&stats);
+  EXPECT_EQ(0, stats.l0_file_count);
+  rocksdb::WriteStallInfo info;
+  info.condition.cur = rocksdb::WriteStallCondition::kDelayed;
+  info.condition.prev = rocksdb::WriteStallCondition::kNormal;
+  listener.OnStallConditionsChanged(info);
+  listener.GetWriteStallStats(&stats);
+  EXPECT_EQ(1, stats.l0_file_count);
+  EXPECT_EQ(1, stats.stall_condition);
+  EXPECT_EQ(1, stats.slowdowns);
+
+  // Batches don't have a write stall state.
+  DBEngine* batch = DBNewBatch(db, false /* writeOnly */);
+  DBStatus status = DBGetWriteStallStats(batch, &stats);
+  EXPECT_STREQ("unsupported", ToString(status).c_str());
+  free(status.data);
+  DBClose(batch);
+
+  DBClose(db);
+}
+
+TEST(Libroach, CompactFilesInParallel) {
+  DBOptions db_opts = defaultDBOptions();
+  DBEngine* db;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+  const int output_level = db->rep->NumberLevels() - 1;
+
+  // Write sstables with disjoint keys and compact each of them by
+  // itself. If fail is not negative, the fail-th set names a
+  // nonexistent sstable.
+  const int kSets = 8;
+  auto compact = [&](int num_threads, int fail) {
+    for (int i = 0; i < kSets; i++) {
+      for (int j = 0; j < 100; j++) {
+        const std::string key = std::to_string(i) + "/" + std::to_string(j);
+        DBKey k = {ToDBSlice(key), 1, 0};
+        EXPECT_STREQ(DBPut(db, k, ToDBSlice("value")).data, NULL);
+      }
+      EXPECT_STREQ(DBFlush(db).data, NULL);
+    }
+    std::vector<rocksdb::LiveFileMetaData> files;
+    db->rep->GetLiveFilesMetaData(&files);
+    std::sort(files.begin(), files.end(),
+              [](const rocksdb::LiveFileMetaData& a, const rocksdb::LiveFileMetaData& b) {
+                return a.smallestkey < b.smallestkey;
+              });
+    std::vector<std::vector<rocksdb::SstFileMetaData>> file_sets;
+    for (const auto& f : files) {
+      if (f.level == 0) {
+        file_sets.push_back({f});
+      }
+    }
+    EXPECT_EQ(kSets, file_sets.size());
+    if (fail >= 0) {
+      file_sets[fail][0].name = "/999999.sst";
+    }
+    rocksdb::CompactionOptions options;
+    return CompactFilesInParallel(db->rep, options, file_sets, output_level, num_threads);
+  };
+  auto levels = [&]() {
+    std::vector<rocksdb::LiveFileMetaData> files;
+    db->rep->GetLiveFilesMetaData(&files);
+    std::sort(files.begin(), files.end(),
+              [](const rocksdb::LiveFileMetaData& a, const rocksdb::LiveFileMetaData& b) {
+                return a.smallestkey < b.smallestkey;
+              });
+    std::vector<int> levels;
+    for (const auto& f : files) {
+      levels.push_back(f.level);
+    }
+    return levels;
+  };
+
+  EXPECT_TRUE(compact(4, -1).ok());
+  EXPECT_EQ(std::vector<int>(kSets, output_level), levels());
+
+  // The compacted data is all still present.
+  DBIterator* iter = DBNewIter(db, false /* prefix */, false /* stats */);
+  int keys = 0;
+  for (DBIterState state = DBIterSeekToFirst(iter); state.valid;
+       state = DBIterNext(iter, false /* skip_current_key_versions */)) {
+    keys++;
+  }
+  DBIterDestroy(iter);
+  EXPECT_EQ(kSets * 100, keys);
+  DBClose(db);
+
+  // After a compaction fails, no further compactions are started.
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+  EXPECT_FALSE(compact(1, 2).ok());
+  std::vector<int> expected(kSets, 0);
+  expected[0] = output_level;
+  expected[1] = output_level;
+  EXPECT_EQ(expected, levels());
+  DBClose(db);
+}
+
 TEST(Libroach, BatchSSTablesForCompaction) {
   auto toString = [](const std::vector<rocksdb::Range>& ranges) -> std::string {
     std::string res;
@@ -14,6 +14,8 @@
 
 #include "encoding.h"
 #include <rocksdb/slice.h>
+#include <string.h>
+#include <limits>
 #include "db.h"
 #include "keys.h"
 
@@ -158,29 +160,136 @@ std::string EncodeTimestamp(DBTimestamp ts) {
   return s;
 }
 
+void EncodeVarintTimestamp(std::string* s, int64_t wall_time, int32_t logical) {
+  EncodeUint64(s, uint64_t(wall_time));
+  if (logical != 0) {
+    EncodeUvarint64(s, uint32_t(logical));
+  }
+}
+
+namespace {
+
+const int kTimestampWallSize = 1 + sizeof(uint64_t);  // NUL prefix + wall time
+
+// IsVarintLogical returns true if the (non-empty) logical component of a
+// timestamp uses the varint format. See EncodeVarintTimestamp.
+bool IsVarintLogical(const rocksdb::Slice& logical) { return uint8_t(logical[0]) >= 0x80; }
+
+// DecodeLogical decodes the logical component of a timestamp in either
+// format. An empty slice decodes as 0.
+WARN_UNUSED_RESULT bool DecodeLogical(rocksdb::Slice* buf, int32_t* logical) {
+  *logical = 0;
+  if (buf->empty()) {
+    return true;
+  }
+  if (IsVarintLogical(*buf)) {
+    uint64_t l;
+    if (!DecodeUvarint64(buf, &l) || l > uint64_t(std::numeric_limits<int32_t>::max())) {
+      return false;
+    }
+    *logical = int32_t(l);
+    return true;
+  }
+  uint32_t l;
+  if (!DecodeUint32(buf, &l)) {
+    return false;
+  }
+  *logical = int32_t(l);
+  return true;
+}
+
+}  // namespace
+
+int CompareTimestamps(const rocksdb::Slice& a, const rocksdb::Slice& b) {
+  if (a.size() <= kTimestampWallSize || b.size() <= kTimestampWallSize) {
+    // At least one of the timestamps has no logical component, so a bytewise
+    // comparison is correct: the wall times are compared first and a missing
+    // logical component sorts before any present one.
+    return a.compare(b);
+  }
+  const int c = memcmp(a.data(), b.data(), kTimestampWallSize);
+  if (c != 0) {
+    return c;
+  }
+  rocksdb::Slice la(a.data() + kTimestampWallSize, a.size() - kTimestampWallSize);
+  rocksdb::Slice lb(b.data() + kTimestampWallSize, b.size() - kTimestampWallSize);
+  if (IsVarintLogical(la) == IsVarintLogical(lb)) {
+    // Both formats sort bytewise.
+    return la.compare(lb);
+  }
+  // Mixed formats; decode the logical components. Corrupt timestamps fall back
+  // to a bytewise comparison, mirroring DBComparator.
+  int32_t logical_a, logical_b;
+  if (!DecodeLogical(&la, &logical_a) || !DecodeLogical(&lb, &logical_b)) {
+    return a.compare(b);
+  }
+  return logical_a < logical_b ? -1 : (logical_a > logical_b ? +1 : 0);
+}
+
+size_t EncodedKeySize(const rocksdb::Slice& key, int64_t wall_time, int32_t logical) {
+  size_t n = key.size() + 1;
+  if (wall_time != 0 || logical != 0) {
+    n += 1 + sizeof(uint64_t);
+    if (logical != 0) {
+      n += sizeof(uint32_t);
+    }
+  }
+  return n;
+}
+
+size_t EncodeKeyToArray(char* dst, const rocksdb::Slice& key, int64_t wall_time,
+                        int32_t logical) {
+  char* p = dst;
+  memcpy(p, key.data(), key.size());
+  p += key.size();
+  if (wall_time != 0 || logical != 0) {
+    // Add a NUL prefix to the timestamp data. See DBPrefixExtractor.Transform
+    // for more details.
+    *p++ = 0;
+    const uint64_t w = uint64_t(wall_time);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      *p++ = char(w >> shift);
+    }
+    if (logical != 0) {
+      const uint32_t l = uint32_t(logical);
+      for (int shift = 24; shift >= 0; shift -= 8) {
+        *p++ = char(l >> shift);
+      }
+    }
+  }
+  *p = char(p - dst - key.size());
+  p++;
+  return p - dst;
+}
+
 // MVCC keys are encoded as <key>\x00[<wall_time>[<logical>]]<#timestamp-bytes>. A
 // custom RocksDB comparator (DBComparator) is used to maintain the desired
 // ordering as these keys do not sort lexicographically correctly.
 std::string EncodeKey(const rocksdb::Slice& key, int64_t wall_time, int32_t logical) {
+  std::string s(EncodedKeySize(key, wall_time, logical), 0);
+  EncodeKeyToArray(&s[0], key, wall_time, logical);
+  return s;
+}
+
+// MVCC keys are encoded as <key>\x00[<wall_time>[<logical>]]<#timestamp-bytes>. A
+// custom RocksDB comparator (DBComparator) is used to maintain the desired
+// ordering as these keys do not sort lexicographically correctly.
+std::string EncodeKey(DBKey k) { return EncodeKey(ToSlice(k.key), k.wall_time, k.logical); }
+
+std::string EncodeKeyVarintLogical(const rocksdb::Slice& key, int64_t wall_time,
+                                   int32_t logical) {
   std::string s;
   const bool ts = wall_time != 0 || logical != 0;
   s.reserve(key.size() + 1 + (ts ? 1 + kMVCCVersionTimestampSize : 0));
   s.append(key.data(), key.size());
   if (ts) {
-    // Add a NUL prefix to the timestamp data. See DBPrefixExtractor.Transform
-    // for more details.
     s.push_back(0);
-    EncodeTimestamp(s, wall_time, logical);
+    EncodeVarintTimestamp(&s, wall_time, logical);
   }
   s.push_back(char(s.size() - key.size()));
   return s;
 }
 
-// MVCC keys are encoded as <key>\x00[<wall_time>[<logical>]]<#timestamp-bytes>. A
-// custom RocksDB comparator (DBComparator) is used to maintain the desired
-// ordering as these keys do not sort lexicographically correctly.
-std::string EncodeKey(DBKey k) { return EncodeKey(ToSlice(k.key), k.wall_time, k.logical); }
-
 WARN_UNUSED_RESULT bool SplitKey(rocksdb::Slice buf, rocksdb::Slice* key,
                                  rocksdb::Slice* timestamp) {
   if (buf.empty()) {
@@ -202,16 +311,7 @@ WARN_UNUSED_RESULT bool DecodeTimestamp(rocksdb::Slice* timestamp, int64_t* wall
     return false;
   }
   *wall_time = int64_t(w);
-  *logical = 0;
-  if (timestamp->size() > 0) {
-    // TODO(peter): Use varint decoding here.
-    uint32_t l;
-    if (!DecodeUint32(timestamp, &l)) {
-      return false;
-    }
-    *logical = int32_t(l);
-  }
-  return true;
+  return DecodeLogical(timestamp, logical);
 }
 
 WARN_UNUSED_RESULT bool DecodeTimestamp(rocksdb::Slice buf,
@@ -284,4 +384,160 @@ rocksdb::Slice KeyPrefix(const rocksdb::Slice& src) {
   return rocksdb::Slice(key.data(), key.size() + 1);
 }
 
+namespace {
+
+// Protobuf wire types. See
+// https://developers.google.com/protocol-buffers/docs/encoding.
+enum WireType {
+  kWireVarint = 0,
+  kWireFixed64 = 1,
+  kWireLengthDelimited = 2,
+  kWireFixed32 = 5,
+};
+
+// DecodeProtoVarint decodes a protobuf base 128 varint, which unlike
+// DecodeUvarint64 is little-endian and not order-preserving.
+WARN_UNUSED_RESULT bool DecodeProtoVarint(rocksdb::Slice* buf, uint64_t* value) {
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64 && !buf->empty(); shift += 7) {
+    const uint8_t b = (*buf)[0];
+    buf->remove_prefix(1);
+    v |= uint64_t(b & 0x7f) << shift;
+    if (b < 0x80) {
+      *value = v;
+      return true;
+    }
+  }
+  return false;
+}
+
+// DecodeProtoField decodes the tag of the next field in buf. Varint values are
+// stored in *value and length-delimited values in *bytes; fixed width values
+// are skipped.
+WARN_UNUSED_RESULT bool DecodeProtoField(rocksdb::Slice* buf, uint32_t* field, int* wire_type,
+                                         uint64_t* value, rocksdb::Slice* bytes) {
+  uint64_t tag;
+  if (!DecodeProtoVarint(buf, &tag) || (tag >> 3) == 0 || (tag >> 3) > UINT32_MAX) {
+    return false;
+  }
+  *field = uint32_t(tag >> 3);
+  *wire_type = int(tag & 7);
+  switch (*wire_type) {
+  case kWireVarint:
+    return DecodeProtoVarint(buf, value);
+  case kWireFixed64:
+  case kWireFixed32: {
+    const size_t n = *wire_type == kWireFixed64 ? 8 : 4;
+    if (buf->size() < n) {
+      return false;
+    }
+    buf->remove_prefix(n);
+    return true;
+  }
+  case kWireLengthDelimited: {
+    uint64_t n;
+    if (!DecodeProtoVarint(buf, &n) || n > buf->size()) {
+      return false;
+    }
+    *bytes = rocksdb::Slice(buf->data(), n);
+    buf->remove_prefix(n);
+    return true;
+  }
+  default:
+    // Groups are deprecated and never used by our protos.
+    return false;
+  }
+}
+
+WARN_UNUSED_RESULT bool DecodeTxnMetaFields(rocksdb::Slice buf, MVCCMetadataFields* fields) {
+  while (!buf.empty()) {
+    uint32_t field;
+    int wire_type;
+    uint64_t value = 0;
+    rocksdb::Slice bytes;
+    if (!DecodeProtoField(&buf, &field, &wire_type, &value, &bytes)) {
+      return false;
+    }
+    if (field == 1 /* id */) {
+      if (wire_type != kWireLengthDelimited) {
+        return false;
+      }
+      fields->txn_id = bytes;
+    } else if (field == 4 /* epoch */) {
+      if (wire_type != kWireVarint) {
+        return false;
+      }
+      fields->txn_epoch = uint32_t(value);
+    }
+  }
+  return true;
+}
+
+WARN_UNUSED_RESULT bool DecodeLegacyTimestampFields(rocksdb::Slice buf, DBTimestamp* ts) {
+  while (!buf.empty()) {
+    uint32_t field;
+    int wire_type;
+    uint64_t value = 0;
+    rocksdb::Slice bytes;
+    if (!DecodeProtoField(&buf, &field, &wire_type, &value, &bytes)) {
+      return false;
+    }
+    if (field == 1 /* wall_time */ || field == 2 /* logical */) {
+      if (wire_type != kWireVarint) {
+        return false;
+      }
+      if (field == 1) {
+        ts->wall_time = int64_t(value);
+      } else {
+        ts->logical = int32_t(value);
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+WARN_UNUSED_RESULT bool DecodeMVCCMetadataFields(rocksdb::Slice buf, MVCCMetadataFields* fields) {
+  *fields = MVCCMetadataFields();
+  bool has_timestamp = false;
+  while (!buf.empty()) {
+    uint32_t field;
+    int wire_type;
+    uint64_t value = 0;
+    rocksdb::Slice bytes;
+    if (!DecodeProtoField(&buf, &field, &wire_type, &value, &bytes)) {
+      return false;
+    }
+    switch (field) {
+    case 1:  // txn
+      if (wire_type != kWireLengthDelimited || fields->has_txn ||
+          !DecodeTxnMetaFields(bytes, fields)) {
+        return false;
+      }
+      fields->has_txn = true;
+      break;
+    case 2:  // timestamp
+      if (wire_type != kWireLengthDelimited || has_timestamp ||
+          !DecodeLegacyTimestampFields(bytes, &fields->timestamp)) {
+        return false;
+      }
+      has_timestamp = true;
+      break;
+    case 6:  // raw_bytes
+      if (wire_type != kWireLengthDelimited) {
+        return false;
+      }
+      fields->has_raw_bytes = true;
+      fields->raw_bytes = bytes;
+      break;
+    default:
+      // Other fields (deleted, key_bytes, val_bytes, merge_timestamp) and
+      // unknown fields are skipped.
+      break;
+    }
+  }
+  return true;
+}
+
 }  // namespace cockroach
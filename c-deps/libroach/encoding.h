@@ -15,6 +15,7 @@
 #pragma once
 
 #include <libroach.h>
+#include <memory>
 #include <rocksdb/slice.h>
 #include <stdint.h>
 #include "defines.h"
@@ -53,9 +54,33 @@ bool DecodeUvarint64(rocksdb::Slice* buf, uint64_t* value);
 
 const int kMVCCVersionTimestampSize = 12;
 
+// Versioned keys store the timestamp as the big-endian wall time followed, if
+// non-zero, by the logical component in one of two formats:
+//
+// - legacy: a fixed 4 byte big-endian uint32. As logical values are
+//   non-negative the first byte is always < 0x80.
+// - varint: EncodeUvarint64, whose first byte is always >= kIntZero. Logical
+//   values are almost always tiny and thus take a single byte.
+//
+// The first byte of the logical component thus identifies its format (>= 0x80
+// means varint) and both formats can coexist in a store. Readers (DecodeTimestamp, DBComparator and
+// the time bound table properties collector) accept either format; EncodeKey
+// and EncodeTimestamp still write the legacy format so that stores remain
+// readable by older binaries.
+
+// EncodeTimestamp appends the legacy encoding of a timestamp.
 void EncodeTimestamp(std::string& s, int64_t wall_time, int32_t logical);
 std::string EncodeTimestamp(DBTimestamp ts);
 
+// EncodeVarintTimestamp appends the varint encoding of a timestamp.
+void EncodeVarintTimestamp(std::string* s, int64_t wall_time, int32_t logical);
+
+// CompareTimestamps compares two encoded timestamps in either format (as
+// returned by SplitKey, including the NUL prefix), returning <0, 0 or >0 if a
+// is older, equal or newer than b. An empty timestamp is older than any
+// non-empty one.
+int CompareTimestamps(const rocksdb::Slice& a, const rocksdb::Slice& b);
+
 // MVCC keys are encoded as <key>\x00[<wall_time>[<logical>]]<#timestamp-bytes>. A
 // custom RocksDB comparator (DBComparator) is used to maintain the desired
 // ordering as these keys do not sort lexicographically correctly.
@@ -66,6 +91,61 @@ std::string EncodeKey(const rocksdb::Slice& key, int64_t wall_time, int32_t logi
 // ordering as these keys do not sort lexicographically correctly.
 std::string EncodeKey(DBKey k);
 
+// EncodeKeyVarintLogical is like EncodeKey but encodes the logical component
+// of the timestamp using the varint format.
+std::string EncodeKeyVarintLogical(const rocksdb::Slice& key, int64_t wall_time,
+                                   int32_t logical);
+
+// EncodedKeySize returns the size of the MVCC encoding of the specified key.
+size_t EncodedKeySize(const rocksdb::Slice& key, int64_t wall_time, int32_t logical);
+
+// EncodeKeyToArray writes the MVCC encoding of the specified key to dst, which
+// must have room for EncodedKeySize() bytes. Returns the number of bytes
+// written.
+size_t EncodeKeyToArray(char* dst, const rocksdb::Slice& key, int64_t wall_time,
+                        int32_t logical);
+
+// EncodedKey holds the MVCC encoding of a key (see EncodeKey) for the
+// duration of a call. Keys of up to kInlineSize encoded bytes are stored
+// inline, so an EncodedKey on the stack encodes the common case without any
+// heap allocation. Longer keys fall back to a heap allocated buffer.
+// EncodedKey converts implicitly to a rocksdb::Slice, which must not outlive
+// it.
+class EncodedKey {
+ public:
+  static const size_t kInlineSize = 128;
+
+  EncodedKey(const rocksdb::Slice& key, int64_t wall_time, int32_t logical) {
+    Encode(key, wall_time, logical);
+  }
+  explicit EncodedKey(DBKey k) {
+    Encode(rocksdb::Slice(k.key.data, k.key.len), k.wall_time, k.logical);
+  }
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  operator rocksdb::Slice() const { return rocksdb::Slice(data_, size_); }
+
+ private:
+  EncodedKey(const EncodedKey&) = delete;
+  EncodedKey& operator=(const EncodedKey&) = delete;
+
+  void Encode(const rocksdb::Slice& key, int64_t wall_time, int32_t logical) {
+    data_ = inline_;
+    const size_t n = EncodedKeySize(key, wall_time, logical);
+    if (n > kInlineSize) {
+      heap_.reset(new char[n]);
+      data_ = heap_.get();
+    }
+    size_ = EncodeKeyToArray(data_, key, wall_time, logical);
+  }
+
+  char inline_[kInlineSize];
+  std::unique_ptr<char[]> heap_;
+  char* data_;
+  size_t size_;
+};
+
 // SplitKey splits an MVCC key into key and timestamp slices. See also
 // DecodeKey if you want to decode the timestamp. Returns true on
 // success and false on any decoding error.
@@ -102,4 +182,23 @@ WARN_UNUSED_RESULT bool DecodeRangeIDKey(rocksdb::Slice buf, int64_t* range_id,
 // extractor used to build bloom filters on the prefix.
 rocksdb::Slice KeyPrefix(const rocksdb::Slice& src);
 
+// MVCCMetadataFields holds the subset of an MVCCMetadata needed by the MVCC
+// scanner. The slices point into the buffer the fields were decoded from.
+struct MVCCMetadataFields {
+  bool has_txn;
+  rocksdb::Slice txn_id;
+  uint32_t txn_epoch;
+  DBTimestamp timestamp;
+  bool has_raw_bytes;
+  rocksdb::Slice raw_bytes;
+};
+
+// DecodeMVCCMetadataFields extracts MVCCMetadataFields directly from the
+// protobuf wire encoding of an MVCCMetadata without allocating, skipping all
+// other fields. Returns false if buf is malformed or contains encodings the
+// reader does not handle (groups, or repeated occurrences of an embedded
+// message, which protobuf merges), in which case the caller should fall back
+// to MVCCMetadata::ParseFromArray.
+WARN_UNUSED_RESULT bool DecodeMVCCMetadataFields(rocksdb::Slice buf, MVCCMetadataFields* fields);
+
 }  // namespace cockroach
@@ -14,13 +14,56 @@
 
 #include <cinttypes>
 #include <cstdint>
+#include <cstdlib>
 #include <gtest/gtest.h>
+#include <new>
 #include <random>
 #include <vector>
 #include "encoding.h"
 
 using namespace cockroach;
 
+namespace {
+
+// allocationCounter, if set, counts the heap allocations of the current
+// thread. See scopedAllocationCounter.
+thread_local int64_t* allocationCounter = nullptr;
+
+// scopedAllocationCounter counts the heap allocations made by the current
+// thread during its lifetime so that tests can verify that hot paths do not
+// allocate. Allocations made by other threads are not counted.
+class scopedAllocationCounter {
+ public:
+  scopedAllocationCounter() : count_(0), prev_(allocationCounter) {
+    allocationCounter = &count_;
+  }
+  ~scopedAllocationCounter() { allocationCounter = prev_; }
+
+  int64_t count() const { return count_; }
+
+ private:
+  int64_t count_;
+  int64_t* const prev_;
+};
+
+}  // namespace
+
+// Replacing the global allocation functions is the only portable way to
+// observe allocations. They behave like the default ones unless a
+// scopedAllocationCounter is active on the calling thread.
+void* operator new(size_t size) {
+  if (allocationCounter != nullptr) {
+    ++*allocationCounter;
+  }
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
 TEST(Libroach, Encoding) {
   // clang-format off
   std::vector<uint32_t> cases32{
@@ -80,3 +123,138 @@ TEST(Libroach, Encoding) {
     EXPECT_EQ(*it, out);
   }
 }
+
+TEST(Libroach, EncodedKeyAllocations) {
+  const std::string user_key("/Table/51/1/123456789/0");
+  DBKey key;
+  key.key.data = const_cast<char*>(user_key.data());
+  key.key.len = user_key.size();
+  key.wall_time = 1521000000000000000;
+  key.logical = 7;
+
+  const std::string expected = EncodeKey(key);
+  {
+    EncodedKey enc(key);
+    EXPECT_EQ(expected, rocksdb::Slice(enc).ToString());
+  }
+  for (int64_t wall_time : {0, 1}) {
+    for (int32_t logical : {0, 1}) {
+      EncodedKey enc(user_key, wall_time, logical);
+      EXPECT_EQ(EncodeKey(user_key, wall_time, logical), rocksdb::Slice(enc).ToString());
+    }
+  }
+
+  // Keys which exceed the inline buffer fall back to the heap.
+  const std::string long_key(EncodedKey::kInlineSize, 'x');
+  {
+    EncodedKey enc(long_key, 1, 2);
+    EXPECT_EQ(EncodeKey(long_key, 1, 2), rocksdb::Slice(enc).ToString());
+  }
+
+  const int kIters = 1000;
+  size_t sink = 0;
+
+  int64_t encode_key_allocs;
+  {
+    scopedAllocationCounter counter;
+    for (int i = 0; i < kIters; i++) {
+      key.wall_time++;
+      sink += EncodeKey(key).size();
+    }
+    encode_key_allocs = counter.count();
+  }
+
+  int64_t encoded_key_allocs;
+  {
+    scopedAllocationCounter counter;
+    for (int i = 0; i < kIters; i++) {
+      key.wall_time++;
+      sink += EncodedKey(key).size();
+    }
+    encoded_key_allocs = counter.count();
+  }
+
+  EXPECT_EQ(kIters, encode_key_allocs);
+  EXPECT_EQ(0, encoded_key_allocs);
+  EXPECT_EQ(2 * kIters * expected.size(), sink);
+}
+
+TEST(Libroach, DecodeMVCCMetadataFields) {
+  using cockroach::storage::engine::enginepb::MVCCMetadata;
+
+  // checkFields verifies that the fast decoder and protobuf agree on the
+  // fields of an encoded MVCCMetadata.
+  auto checkFields = [](const std::string& data) {
+    MVCCMetadata meta;
+    ASSERT_TRUE(meta.ParseFromString(data));
+    MVCCMetadataFields fields;
+    ASSERT_TRUE(DecodeMVCCMetadataFields(data, &fields));
+    EXPECT_EQ(meta.has_txn(), fields.has_txn);
+    EXPECT_EQ(meta.txn().id(), fields.txn_id.ToString());
+    EXPECT_EQ(meta.txn().epoch(), fields.txn_epoch);
+    EXPECT_EQ(meta.timestamp().wall_time(), fields.timestamp.wall_time);
+    EXPECT_EQ(meta.timestamp().logical(), fields.timestamp.logical);
+    EXPECT_EQ(meta.has_raw_bytes(), fields.has_raw_bytes);
+    EXPECT_EQ(meta.raw_bytes(), fields.raw_bytes.ToString());
+  };
+
+  std::vector<MVCCMetadata> metas(4);
+  // An inline value.
+  metas[0].set_raw_bytes("value");
+  // An empty inline value.
+  metas[1].set_raw_bytes("");
+  // An intent.
+  metas[2].mutable_txn()->set_id("0123456789abcdef");
+  metas[2].mutable_txn()->set_key("anchor");
+  metas[2].mutable_txn()->set_epoch(7);
+  metas[2].mutable_txn()->mutable_timestamp()->set_wall_time(11);
+  metas[2].mutable_txn()->set_priority(-1);
+  metas[2].mutable_timestamp()->set_wall_time(std::numeric_limits<int64_t>::max());
+  metas[2].mutable_timestamp()->set_logical(-3);
+  metas[2].set_deleted(true);
+  metas[2].set_key_bytes(12);
+  metas[2].set_val_bytes(1 << 20);
+  metas[2].mutable_merge_timestamp()->set_wall_time(1);
+  // An intent with an empty txn and a zero timestamp.
+  metas[3].mutable_txn();
+  metas[3].mutable_timestamp();
+
+  for (const auto& meta : metas) {
+    const std::string data = meta.SerializeAsString();
+    checkFields(data);
+
+    // Unknown fields of every supported wire type are skipped.
+    std::string unknown = data;
+    unknown.append("\xf8\x01\x05", 3);          // field 31, varint
+    unknown.append("\xf9\x01" "12345678", 10);  // field 31, fixed64
+    unknown.append("\xfa\x01\x02" "ab", 5);     // field 31, bytes
+    unknown.append("\xfd\x01" "1234", 6);       // field 31, fixed32
+    checkFields(unknown);
+
+    // Truncated data must never be misread.
+    for (size_t i = 0; i < data.size(); i++) {
+      const std::string truncated = data.substr(0, i);
+      MVCCMetadataFields fields;
+      if (DecodeMVCCMetadataFields(truncated, &fields)) {
+        checkFields(truncated);
+      }
+    }
+  }
+
+  // Repeated embedded messages are merged by protobuf and thus left to it.
+  const std::string intent = metas[2].SerializeAsString();
+  MVCCMetadataFields fields;
+  EXPECT_FALSE(DecodeMVCCMetadataFields(intent + intent, &fields));
+  // Groups are not supported.
+  EXPECT_FALSE(DecodeMVCCMetadataFields(std::string("\x0b\x0c", 2), &fields));
+
+  // Decoding does not allocate.
+  {
+    scopedAllocationCounter counter;
+    for (int i = 0; i < 100; i++) {
+      EXPECT_TRUE(DecodeMVCCMetadataFields(intent, &fields));
+    }
+    EXPECT_EQ(0, counter.count());
+  }
+  EXPECT_EQ(7, fields.txn_epoch);
+}
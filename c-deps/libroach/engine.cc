@@ -31,6 +31,10 @@ DBStatus DBEngine::AssertPreClose() { return kSuccess; }
 DBSSTable* DBEngine::GetSSTables(int* n) {
   std::vector<rocksdb::LiveFileMetaData> metadata;
   rep->GetLiveFilesMetaData(&metadata);
+  // The table properties provide the uncompressed and the index and
+  // filter block sizes. An error here only leaves them unset.
+  rocksdb::TablePropertiesCollection props;
+  rep->GetPropertiesOfAllTables(&props);
   *n = metadata.size();
   // We malloc the result so it can be deallocated by the caller using free().
   const int size = metadata.size() * sizeof(DBSSTable);
@@ -39,6 +43,13 @@ DBSSTable* DBEngine::GetSSTables(int* n) {
   for (int i = 0; i < metadata.size(); i++) {
     tables[i].level = metadata[i].level;
     tables[i].size = metadata[i].size;
+    auto it = props.find(metadata[i].db_path + metadata[i].name);
+    if (it != props.end()) {
+      tables[i].raw_size = it->second->raw_key_size + it->second->raw_value_size;
+      tables[i].index_size = it->second->index_size;
+      tables[i].top_level_index_size = it->second->top_level_index_size;
+      tables[i].filter_size = it->second->filter_size;
+    }
 
     rocksdb::Slice tmp;
     if (DecodeKey(metadata[i].smallestkey, &tmp, &tables[i].start_key.wall_time,
@@ -98,15 +109,19 @@ DBString DBEngine::GetUserProperties() {
 namespace cockroach {
 
 DBImpl::DBImpl(rocksdb::DB* r, std::unique_ptr<EnvManager> e, std::shared_ptr<rocksdb::Cache> bc,
-               std::shared_ptr<DBEventListener> event_listener)
-    : DBEngine(r, &iters_count),
+               std::shared_ptr<DBEventListener> event_listener,
+               std::unique_ptr<TombstoneCompactor> tombstone_compactor)
+    : DBEngine(r, &iters_count, event_listener->GetTimeBoundCache(), tombstone_compactor.get()),
       env_mgr(std::move(e)),
       rep_deleter(r),
+      tombstone_compactor_deleter(std::move(tombstone_compactor)),
       block_cache(bc),
       event_listener(event_listener),
       iters_count(0) {}
 
 DBImpl::~DBImpl() {
+  // The listener must not use the DB once it is being closed.
+  event_listener->SetDB(nullptr);
   const rocksdb::Options& opts = rep->GetOptions();
   const std::shared_ptr<rocksdb::Statistics>& s = opts.statistics;
   rocksdb::Info(opts.info_log, "bloom filter utility:    %0.1f%%",
@@ -124,29 +139,30 @@ DBStatus DBImpl::AssertPreClose() {
 
 DBStatus DBImpl::Put(DBKey key, DBSlice value) {
   rocksdb::WriteOptions options;
-  return ToDBStatus(rep->Put(options, EncodeKey(key), ToSlice(value)));
+  return ToDBStatus(rep->Put(options, EncodedKey(key), ToSlice(value)));
 }
 
 DBStatus DBImpl::Merge(DBKey key, DBSlice value) {
   rocksdb::WriteOptions options;
-  return ToDBStatus(rep->Merge(options, EncodeKey(key), ToSlice(value)));
+  return ToDBStatus(rep->Merge(options, EncodedKey(key), ToSlice(value)));
 }
 
 DBStatus DBImpl::Get(DBKey key, DBString* value) {
   rocksdb::ReadOptions read_opts;
-  DBGetter base(rep, read_opts, EncodeKey(key));
+  const EncodedKey enc_key(key);
+  DBGetter base(rep, read_opts, enc_key);
   return base.Get(value);
 }
 
 DBStatus DBImpl::Delete(DBKey key) {
   rocksdb::WriteOptions options;
-  return ToDBStatus(rep->Delete(options, EncodeKey(key)));
+  return ToDBStatus(rep->Delete(options, EncodedKey(key)));
 }
 
 DBStatus DBImpl::DeleteRange(DBKey start, DBKey end) {
   rocksdb::WriteOptions options;
   return ToDBStatus(
-      rep->DeleteRange(options, rep->DefaultColumnFamily(), EncodeKey(start), EncodeKey(end)));
+      rep->DeleteRange(options, rep->DefaultColumnFamily(), EncodedKey(start), EncodedKey(end)));
 }
 
 DBStatus DBImpl::CommitBatch(bool sync) { return FmtStatus("unsupported"); }
@@ -161,7 +177,7 @@ DBStatus DBImpl::ApplyBatchRepr(DBSlice repr, bool sync) {
 DBSlice DBImpl::BatchRepr() { return ToDBSlice("unsupported"); }
 
 DBIterator* DBImpl::NewIter(rocksdb::ReadOptions* read_opts) {
-  DBIterator* iter = new DBIterator(iters);
+  DBIterator* iter = new DBIterator(iters, tombstone_compactor);
   iter->rep.reset(rep->NewIterator(*read_opts));
   return iter;
 }
@@ -195,6 +211,25 @@ DBStatus DBImpl::GetStats(DBStatsResult* stats) {
   stats->compactions = (int64_t)event_listener->GetCompactions();
   stats->table_readers_mem_estimate = table_readers_mem_estimate;
   stats->pending_compaction_bytes_estimate = pending_compaction_bytes_estimate;
+
+  stats->rate_limit_bytes_per_sec = 0;
+  stats->rate_limiter_flush_bytes = 0;
+  stats->rate_limiter_compaction_bytes = 0;
+  if (opts.rate_limiter != nullptr) {
+    stats->rate_limit_bytes_per_sec = opts.rate_limiter->GetBytesPerSecond();
+    stats->rate_limiter_flush_bytes =
+        opts.rate_limiter->GetTotalBytesThrough(rocksdb::Env::IO_HIGH);
+    stats->rate_limiter_compaction_bytes =
+        opts.rate_limiter->GetTotalBytesThrough(rocksdb::Env::IO_LOW);
+  }
+  stats->rate_limiter_drains = (int64_t)s->getTickerCount(rocksdb::NUMBER_RATE_LIMITER_DRAINS);
+
+  stats->tombstone_compactions = 0;
+  stats->tombstone_spans_tracked = 0;
+  if (tombstone_compactor != nullptr) {
+    stats->tombstone_compactions = (int64_t)tombstone_compactor->NumCompactions();
+    stats->tombstone_spans_tracked = (int64_t)tombstone_compactor->NumTracked();
+  }
   return kSuccess;
 }
 
@@ -204,6 +239,11 @@ DBString DBImpl::GetCompactionStats() {
   return ToDBString(tmp);
 }
 
+DBStatus DBImpl::GetWriteStallStats(DBWriteStallStats* stats) {
+  event_listener->GetWriteStallStats(stats);
+  return kSuccess;
+}
+
 DBStatus DBImpl::GetEnvStats(DBEnvStatsResult* stats) {
   // Always initialize the fields.
   stats->encryption_status = DBString();
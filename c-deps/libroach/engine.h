@@ -21,12 +21,17 @@
 #include <rocksdb/env.h>
 #include <rocksdb/statistics.h>
 #include "eventlistener.h"
+#include "tombstone_compactor.h"
 
 struct DBEngine {
   rocksdb::DB* const rep;
   std::atomic<int64_t>* iters;
+  cockroach::TimeBoundCache* const timebound_cache;
+  cockroach::TombstoneCompactor* const tombstone_compactor;
 
-  DBEngine(rocksdb::DB* r, std::atomic<int64_t>* iters) : rep(r), iters(iters) {}
+  DBEngine(rocksdb::DB* r, std::atomic<int64_t>* iters, cockroach::TimeBoundCache* tbc,
+           cockroach::TombstoneCompactor* tc)
+      : rep(r), iters(iters), timebound_cache(tbc), tombstone_compactor(tc) {}
   virtual ~DBEngine();
 
   virtual DBStatus AssertPreClose();
@@ -42,6 +47,7 @@ struct DBEngine {
   virtual DBStatus GetStats(DBStatsResult* stats) = 0;
   virtual DBString GetCompactionStats() = 0;
   virtual DBString GetEnvStats(DBEnvStatsResult* stats) = 0;
+  virtual DBStatus GetWriteStallStats(DBWriteStallStats* stats) = 0;
   virtual DBStatus EnvWriteFile(DBSlice path, DBSlice contents) = 0;
   virtual DBStatus EnvOpenFile(DBSlice path, rocksdb::WritableFile** file) = 0;
   virtual DBStatus EnvReadFile(DBSlice path, DBSlice* contents) = 0;
@@ -62,15 +68,19 @@ struct EnvManager;
 struct DBImpl : public DBEngine {
   std::unique_ptr<EnvManager> env_mgr;
   std::unique_ptr<rocksdb::DB> rep_deleter;
+  // Declared after rep_deleter so that the compactor is stopped before
+  // the DB is closed.
+  std::unique_ptr<TombstoneCompactor> tombstone_compactor_deleter;
   std::shared_ptr<rocksdb::Cache> block_cache;
   std::shared_ptr<DBEventListener> event_listener;
   std::atomic<int64_t> iters_count;
 
   // Construct a new DBImpl from the specified DB.
   // The DB and passed Envs will be deleted when the DBImpl is deleted.
-  // Either env can be NULL.
+  // Either env can be NULL, as can the tombstone compactor.
   DBImpl(rocksdb::DB* r, std::unique_ptr<EnvManager> e, std::shared_ptr<rocksdb::Cache> bc,
-         std::shared_ptr<DBEventListener> event_listener);
+         std::shared_ptr<DBEventListener> event_listener,
+         std::unique_ptr<TombstoneCompactor> tombstone_compactor);
   virtual ~DBImpl();
 
   virtual DBStatus AssertPreClose();
@@ -86,6 +96,7 @@ struct DBImpl : public DBEngine {
   virtual DBStatus GetStats(DBStatsResult* stats);
   virtual DBString GetCompactionStats();
   virtual DBStatus GetEnvStats(DBEnvStatsResult* stats);
+  virtual DBStatus GetWriteStallStats(DBWriteStallStats* stats);
   virtual DBStatus EnvWriteFile(DBSlice path, DBSlice contents);
   virtual DBStatus EnvOpenFile(DBSlice path, rocksdb::WritableFile** file);
   virtual DBStatus EnvReadFile(DBSlice path, DBSlice* contents);
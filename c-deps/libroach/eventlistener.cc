@@ -13,15 +13,33 @@
 // permissions and limitations under the License.
 
 #include "eventlistener.h"
+#include <chrono>
+#include <cstdlib>
 #include <rocksdb/table_properties.h>
 
 static const bool kDebug = false;
 
-DBEventListener::DBEventListener() : flushes_(0), compactions_(0) {}
+DBEventListener::DBEventListener()
+    : db_(nullptr),
+      flushes_(0),
+      compactions_(0),
+      l0_file_count_(0),
+      immutable_memtable_count_(0),
+      pending_compaction_bytes_(0),
+      stall_condition_(0),
+      stall_condition_nanos_(0),
+      slowdowns_(0),
+      stops_(0) {}
+
+void DBEventListener::OnFlushBegin(rocksdb::DB* db, const rocksdb::FlushJobInfo& flush_job_info) {
+  UpdateWriteStallStats(db);
+}
 
 void DBEventListener::OnFlushCompleted(rocksdb::DB* db,
                                        const rocksdb::FlushJobInfo& flush_job_info) {
   ++flushes_;
+  timebound_cache_.Add(flush_job_info.file_path, flush_job_info.table_properties);
+  UpdateWriteStallStats(db);
 
   if (kDebug) {
     const rocksdb::TableProperties& p = flush_job_info.table_properties;
@@ -36,6 +54,14 @@ void DBEventListener::OnFlushCompleted(rocksdb::DB* db,
 
 void DBEventListener::OnCompactionCompleted(rocksdb::DB* db, const rocksdb::CompactionJobInfo& ci) {
   ++compactions_;
+  // table_properties holds both the input and the output files.
+  for (const auto& path : ci.output_files) {
+    const auto p = ci.table_properties.find(path);
+    if (p != ci.table_properties.end()) {
+      timebound_cache_.Add(path, *p->second);
+    }
+  }
+  UpdateWriteStallStats(db);
 
   if (kDebug) {
     fprintf(stderr, "OnCompactionCompleted: input=%d output=%d\n", ci.base_input_level,
@@ -49,6 +75,67 @@ void DBEventListener::OnCompactionCompleted(rocksdb::DB* db, const rocksdb::Comp
   }
 }
 
+void DBEventListener::OnTableFileDeleted(const rocksdb::TableFileDeletionInfo& info) {
+  timebound_cache_.Remove(info.file_path);
+}
+
+void DBEventListener::OnStallConditionsChanged(const rocksdb::WriteStallInfo& info) {
+  int32_t condition = 0;
+  switch (info.condition.cur) {
+  case rocksdb::WriteStallCondition::kNormal:
+    break;
+  case rocksdb::WriteStallCondition::kDelayed:
+    condition = 1;
+    ++slowdowns_;
+    break;
+  case rocksdb::WriteStallCondition::kStopped:
+    condition = 2;
+    ++stops_;
+    break;
+  }
+  const auto now = std::chrono::system_clock::now().time_since_epoch();
+  stall_condition_nanos_ = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+  stall_condition_ = condition;
+
+  // Writes stall because of the number of immutable memtables, L0 files
+  // or pending compaction bytes. The immutable memtable count changes
+  // when memtables are sealed, which is not otherwise reported to
+  // listeners, so refresh the counts whenever the condition changes.
+  rocksdb::DB* db = db_.load();
+  if (db != nullptr) {
+    UpdateWriteStallStats(db);
+  }
+}
+
+void DBEventListener::UpdateWriteStallStats(rocksdb::DB* db) {
+  // The L0 file count is only available as a string property.
+  std::string l0_files;
+  if (db->GetProperty("rocksdb.num-files-at-level0", &l0_files)) {
+    l0_file_count_ = std::strtoll(l0_files.c_str(), nullptr, 10);
+  }
+  uint64_t value;
+  if (db->GetIntProperty("rocksdb.num-immutable-mem-table", &value)) {
+    immutable_memtable_count_ = value;
+  }
+  if (db->GetIntProperty("rocksdb.estimate-pending-compaction-bytes", &value)) {
+    pending_compaction_bytes_ = value;
+  }
+}
+
+void DBEventListener::SetDB(rocksdb::DB* db) { db_ = db; }
+
+void DBEventListener::GetWriteStallStats(DBWriteStallStats* stats) const {
+  stats->l0_file_count = l0_file_count_.load();
+  stats->immutable_memtable_count = immutable_memtable_count_.load();
+  stats->pending_compaction_bytes = pending_compaction_bytes_.load();
+  stats->stall_condition = stall_condition_.load();
+  stats->stall_condition_nanos = stall_condition_nanos_.load();
+  stats->slowdowns = slowdowns_.load();
+  stats->stops = stops_.load();
+}
+
 uint64_t DBEventListener::GetFlushes() const { return flushes_.load(); }
 
 uint64_t DBEventListener::GetCompactions() const { return compactions_.load(); }
+
+cockroach::TimeBoundCache* DBEventListener::GetTimeBoundCache() { return &timebound_cache_; }
@@ -16,7 +16,9 @@
 
 #include <atomic>
 
+#include <libroach.h>
 #include <rocksdb/db.h>
+#include "timebound.h"
 
 // DBEventListener is an implementation of RocksDB's EventListener interface
 // used to collect information on RocksDB events that could be of interest
@@ -28,14 +30,36 @@ class DBEventListener : public rocksdb::EventListener {
 
   uint64_t GetFlushes() const;
   uint64_t GetCompactions() const;
+  cockroach::TimeBoundCache* GetTimeBoundCache();
+  // GetWriteStallStats only loads atomics so that it can be called for
+  // every request.
+  void GetWriteStallStats(DBWriteStallStats* stats) const;
+  // UpdateWriteStallStats refreshes the L0 file count, immutable
+  // memtable count and pending compaction bytes from the DB properties.
+  void UpdateWriteStallStats(rocksdb::DB* db);
+  // SetDB sets the DB whose stats are refreshed by events which do not
+  // pass it to the listener. It must be called once the DB is open.
+  void SetDB(rocksdb::DB* db);
 
   // EventListener methods.
+  virtual void OnFlushBegin(rocksdb::DB* db, const rocksdb::FlushJobInfo& flush_job_info) override;
   virtual void OnFlushCompleted(rocksdb::DB* db,
                                 const rocksdb::FlushJobInfo& flush_job_info) override;
   virtual void OnCompactionCompleted(rocksdb::DB* db,
                                      const rocksdb::CompactionJobInfo& ci) override;
+  virtual void OnTableFileDeleted(const rocksdb::TableFileDeletionInfo& info) override;
+  virtual void OnStallConditionsChanged(const rocksdb::WriteStallInfo& info) override;
 
  private:
+  std::atomic<rocksdb::DB*> db_;
   std::atomic<uint64_t> flushes_;
   std::atomic<uint64_t> compactions_;
+  std::atomic<int64_t> l0_file_count_;
+  std::atomic<int64_t> immutable_memtable_count_;
+  std::atomic<int64_t> pending_compaction_bytes_;
+  std::atomic<int32_t> stall_condition_;
+  std::atomic<int64_t> stall_condition_nanos_;
+  std::atomic<int64_t> slowdowns_;
+  std::atomic<int64_t> stops_;
+  cockroach::TimeBoundCache timebound_cache_;
 };
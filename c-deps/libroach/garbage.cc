@@ -0,0 +1,103 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "garbage.h"
+#include <rocksdb/utilities/table_properties_collectors.h>
+#include <string>
+#include "encoding.h"
+
+namespace cockroach {
+
+namespace {
+
+class GarbageTblPropCollector : public rocksdb::TablePropertiesCollector {
+ public:
+  const char* Name() const override { return "GarbageTblPropCollector"; }
+
+  rocksdb::Status Finish(rocksdb::UserCollectedProperties* properties) override {
+    *properties = GetReadableProperties();
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status AddUserKey(const rocksdb::Slice& user_key, const rocksdb::Slice& value,
+                             rocksdb::EntryType type, rocksdb::SequenceNumber seq,
+                             uint64_t file_size) override {
+    // Range deletions are added after all other keys.
+    if (type == rocksdb::kEntryRangeDeletion) {
+      return rocksdb::Status::OK();
+    }
+    if (type == rocksdb::kEntryDelete || type == rocksdb::kEntrySingleDelete) {
+      deletions_++;
+    }
+
+    rocksdb::Slice key;
+    rocksdb::Slice ts;
+    if (!SplitKey(user_key, &key, &ts)) {
+      prev_key_.clear();
+      return rocksdb::Status::OK();
+    }
+    // The versions of a key follow its metadata key, newest first.
+    if (!ts.empty() && key == rocksdb::Slice(prev_key_)) {
+      if (prev_versioned_) {
+        versions_++;
+      } else if (prev_type_ == rocksdb::kEntryPut) {
+        intents_++;
+      }
+    }
+    prev_key_.assign(key.data(), key.size());
+    prev_versioned_ = !ts.empty();
+    prev_type_ = type;
+    return rocksdb::Status::OK();
+  }
+
+  virtual rocksdb::UserCollectedProperties GetReadableProperties() const override {
+    return rocksdb::UserCollectedProperties{
+        {kGarbageDeletionsProperty, std::to_string(deletions_)},
+        {kGarbageVersionsProperty, std::to_string(versions_)},
+        {kGarbageIntentsProperty, std::to_string(intents_)},
+    };
+  }
+
+ private:
+  uint64_t deletions_ = 0;
+  uint64_t versions_ = 0;
+  uint64_t intents_ = 0;
+
+  // The user key and kind of the previous key.
+  std::string prev_key_;
+  bool prev_versioned_ = false;
+  rocksdb::EntryType prev_type_ = rocksdb::kEntryOther;
+};
+
+class GarbageTblPropCollectorFactory : public rocksdb::TablePropertiesCollectorFactory {
+ public:
+  virtual rocksdb::TablePropertiesCollector* CreateTablePropertiesCollector(
+      rocksdb::TablePropertiesCollectorFactory::Context context) override {
+    return new GarbageTblPropCollector();
+  }
+  const char* Name() const override { return "GarbageTblPropCollectorFactory"; }
+};
+
+}  // namespace
+
+rocksdb::TablePropertiesCollectorFactory* NewGarbageTblPropCollectorFactory() {
+  return new GarbageTblPropCollectorFactory();
+}
+
+std::shared_ptr<rocksdb::TablePropertiesCollectorFactory> NewGarbageCompactionCollectorFactory() {
+  return rocksdb::NewCompactOnDeletionCollectorFactory(kGarbageCompactionWindow,
+                                                       kGarbageCompactionDeletions);
+}
+
+}  // namespace cockroach
@@ -0,0 +1,53 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <rocksdb/table_properties.h>
+
+namespace cockroach {
+
+// Every sstable records how much of its contents is garbage in the
+// following user properties, each a decimal count of keys:
+//
+// - crdb.garbage.deletions: point deletion tombstones.
+// - crdb.garbage.versions: MVCC versions shadowed by a newer version of
+//   the same key within the sstable.
+// - crdb.garbage.intents: intents, i.e. MVCC metadata keys followed by
+//   a version of the same key.
+const char* const kGarbageDeletionsProperty = "crdb.garbage.deletions";
+const char* const kGarbageVersionsProperty = "crdb.garbage.versions";
+const char* const kGarbageIntentsProperty = "crdb.garbage.intents";
+
+// An sstable is marked for compaction if any kGarbageCompactionWindow
+// consecutive keys contain at least kGarbageCompactionDeletions point
+// deletions. Compactions push the deletions down and drop them, along
+// with the keys they delete, once they reach the bottommost
+// level. Shadowed versions and intents are not considered because
+// compactions cannot reclaim them: marking sstables because of them
+// would only rewrite the same data over and over.
+const size_t kGarbageCompactionWindow = 128;
+const size_t kGarbageCompactionDeletions = 32;
+
+// NewGarbageTblPropCollectorFactory returns a factory for collectors
+// which record the garbage properties above.
+rocksdb::TablePropertiesCollectorFactory* NewGarbageTblPropCollectorFactory();
+
+// NewGarbageCompactionCollectorFactory returns a factory for RocksDB's
+// CompactOnDeletionCollector which marks sstables with many point
+// deletions for compaction as described above.
+std::shared_ptr<rocksdb::TablePropertiesCollectorFactory> NewGarbageCompactionCollectorFactory();
+
+}  // namespace cockroach
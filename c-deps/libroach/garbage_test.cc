@@ -0,0 +1,132 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "db.h"
+#include "encoding.h"
+#include "engine.h"
+#include "garbage.h"
+#include "include/libroach.h"
+#include "testutils.h"
+
+using namespace cockroach;
+using namespace testutils;
+
+namespace {
+
+struct collector {
+  collector() : collector(std::shared_ptr<rocksdb::TablePropertiesCollectorFactory>(
+                    NewGarbageTblPropCollectorFactory())) {}
+  explicit collector(std::shared_ptr<rocksdb::TablePropertiesCollectorFactory> f)
+      : factory(std::move(f)),
+        rep(factory->CreateTablePropertiesCollector(
+            rocksdb::TablePropertiesCollectorFactory::Context())) {}
+
+  void add(const std::string& key, int64_t wall_time, rocksdb::EntryType type) {
+    EXPECT_TRUE(rep->AddUserKey(EncodeKey(key, wall_time, 0), "", type, 0, 0).ok());
+  }
+
+  rocksdb::UserCollectedProperties finish() {
+    rocksdb::UserCollectedProperties props;
+    EXPECT_TRUE(rep->Finish(&props).ok());
+    return props;
+  }
+
+  std::shared_ptr<rocksdb::TablePropertiesCollectorFactory> factory;
+  std::unique_ptr<rocksdb::TablePropertiesCollector> rep;
+};
+
+}  // namespace
+
+TEST(Libroach, GarbageTblPropCollector) {
+  collector c;
+  // An intent with two older versions.
+  c.add("a", 0, rocksdb::kEntryPut);
+  c.add("a", 3, rocksdb::kEntryPut);
+  c.add("a", 2, rocksdb::kEntryPut);
+  c.add("a", 1, rocksdb::kEntryPut);
+  // An inline value.
+  c.add("b", 0, rocksdb::kEntryPut);
+  // A resolved intent whose metadata key was deleted.
+  c.add("c", 0, rocksdb::kEntryDelete);
+  c.add("c", 1, rocksdb::kEntryPut);
+  // A deleted version.
+  c.add("d", 2, rocksdb::kEntryPut);
+  c.add("d", 1, rocksdb::kEntrySingleDelete);
+  // Range deletions are ignored.
+  c.add("e", 0, rocksdb::kEntryRangeDeletion);
+
+  const auto props = c.finish();
+  EXPECT_EQ("2", props.at(kGarbageDeletionsProperty));
+  EXPECT_EQ("3", props.at(kGarbageVersionsProperty));
+  EXPECT_EQ("1", props.at(kGarbageIntentsProperty));
+}
+
+TEST(Libroach, GarbageNeedCompact) {
+  struct TestCase {
+    int keys;
+    // Every delete_every-th key is a deletion.
+    int delete_every;
+    bool expected;
+  };
+
+  const int kDeletions = kGarbageCompactionDeletions;
+  std::vector<TestCase> testCases = {
+      {0, 1, false},
+      // Too few deletions.
+      {kDeletions - 1, 1, false},
+      {kDeletions, 1, true},
+      // Too low a density of deletions.
+      {3000, 5, false},
+      {3000, kGarbageCompactionWindow / kDeletions, true},
+  };
+
+  for (const auto& t : testCases) {
+    collector c(NewGarbageCompactionCollectorFactory());
+    for (int i = 0; i < t.keys; i++) {
+      const auto type = (i + 1) % t.delete_every == 0 ? rocksdb::kEntryDelete : rocksdb::kEntryPut;
+      c.add("key" + std::to_string(10000 + i), 0, type);
+    }
+    EXPECT_EQ(t.expected, c.rep->NeedCompact()) << t.keys << " " << t.delete_every;
+  }
+}
+
+TEST(Libroach, DBGarbageProperties) {
+  DBOptions db_opts = defaultDBOptions();
+  DBEngine* db;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+
+  for (int i = 0; i < 100; i++) {
+    const std::string key = "key" + std::to_string(i);
+    for (int64_t wall_time = 1; wall_time <= 3; wall_time++) {
+      DBKey k = {ToDBSlice(key), wall_time, 0};
+      EXPECT_STREQ(DBPut(db, k, ToDBSlice("value")).data, NULL);
+    }
+    DBKey k = {ToDBSlice(key), 0, 0};
+    EXPECT_STREQ(DBDelete(db, k).data, NULL);
+  }
+  EXPECT_STREQ(DBFlush(db).data, NULL);
+
+  rocksdb::TablePropertiesCollection tables;
+  EXPECT_TRUE(db->rep->GetPropertiesOfAllTables(&tables).ok());
+  ASSERT_EQ(1, tables.size());
+  const auto& props = tables.begin()->second->user_collected_properties;
+  EXPECT_EQ("100", props.at(kGarbageDeletionsProperty));
+  EXPECT_EQ("200", props.at(kGarbageVersionsProperty));
+  EXPECT_EQ("0", props.at(kGarbageIntentsProperty));
+
+  DBClose(db);
+}
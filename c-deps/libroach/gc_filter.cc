@@ -0,0 +1,144 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "gc_filter.h"
+#include <algorithm>
+#include "encoding.h"
+
+namespace cockroach {
+
+namespace {
+
+bool spanContains(const GCThreshold& t, const rocksdb::Slice& key) {
+  return key.compare(t.start) >= 0 && (t.end.empty() || key.compare(t.end) < 0);
+}
+
+// gcCompactionFilter is created for every (sub)compaction, which
+// passes it the keys of the compaction in order. The versions of a key
+// follow its metadata key, newest first.
+class gcCompactionFilter : public rocksdb::CompactionFilter {
+ public:
+  gcCompactionFilter(std::shared_ptr<const std::vector<GCThreshold>> thresholds,
+                     std::atomic<uint64_t>* dropped)
+      : thresholds_(std::move(thresholds)), dropped_(dropped) {}
+  ~gcCompactionFilter() { *dropped_ += num_dropped_; }
+
+  bool Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& existing_value,
+              std::string* new_value, bool* value_changed) const override {
+    rocksdb::Slice user_key;
+    DBTimestamp ts = {};
+    if (!DecodeKey(key, &user_key, &ts.wall_time, &ts.logical)) {
+      return false;
+    }
+    const bool is_meta = ts.wall_time == 0 && ts.logical == 0;
+    if (is_meta || user_key != rocksdb::Slice(cur_key_)) {
+      cur_key_.assign(user_key.data(), user_key.size());
+      threshold_ = lookupThreshold(user_key);
+      // Inline values have no versions, so a metadata key followed by
+      // versions is an intent.
+      has_intent_ = is_meta;
+      shadowed_ = false;
+    }
+    if (is_meta || has_intent_ || threshold_ == nullptr) {
+      return false;
+    }
+    if (shadowed_) {
+      ++num_dropped_;
+      return true;
+    }
+    // The first version at or below the threshold is the one visible at
+    // the threshold. It shadows all older versions.
+    shadowed_ = ts.wall_time < threshold_->wall_time ||
+                (ts.wall_time == threshold_->wall_time && ts.logical <= threshold_->logical);
+    return false;
+  }
+
+  const char* Name() const override { return "cockroach_gc_compaction_filter"; }
+
+ private:
+  // lookupThreshold returns the GC threshold of key or nullptr if key is
+  // not within any span.
+  const DBTimestamp* lookupThreshold(const rocksdb::Slice& key) const {
+    // Keys are visited in order, so they usually fall in the same span
+    // as the previous key.
+    if (span_ == nullptr || !spanContains(*span_, key)) {
+      span_ = nullptr;
+      auto it = std::upper_bound(
+          thresholds_->begin(), thresholds_->end(), key,
+          [](const rocksdb::Slice& k, const GCThreshold& t) { return k.compare(t.start) < 0; });
+      if (it != thresholds_->begin() && spanContains(*(it - 1), key)) {
+        span_ = &*(it - 1);
+      }
+    }
+    return span_ == nullptr ? nullptr : &span_->threshold;
+  }
+
+  const std::shared_ptr<const std::vector<GCThreshold>> thresholds_;
+  std::atomic<uint64_t>* const dropped_;
+
+  // Filter is const, but a compaction filter created by a factory is
+  // only used by a single thread.
+  mutable const GCThreshold* span_ = nullptr;
+  mutable std::string cur_key_;
+  mutable const DBTimestamp* threshold_ = nullptr;
+  mutable bool has_intent_ = false;
+  mutable bool shadowed_ = false;
+  mutable uint64_t num_dropped_ = 0;
+};
+
+}  // namespace
+
+const char* const GCCompactionFilterFactory::kName = "cockroach_gc_compaction_filter_factory";
+
+GCCompactionFilterFactory::GCCompactionFilterFactory() : dropped_(0) {}
+
+rocksdb::Status GCCompactionFilterFactory::SetThresholds(std::vector<GCThreshold> thresholds) {
+  std::sort(thresholds.begin(), thresholds.end(),
+            [](const GCThreshold& a, const GCThreshold& b) { return a.start < b.start; });
+  for (size_t i = 0; i < thresholds.size(); i++) {
+    const GCThreshold& t = thresholds[i];
+    if (!t.end.empty() && t.start >= t.end) {
+      return rocksdb::Status::InvalidArgument("empty GC threshold span");
+    }
+    if (i > 0 && (thresholds[i - 1].end.empty() || thresholds[i - 1].end > t.start)) {
+      return rocksdb::Status::InvalidArgument("overlapping GC threshold spans");
+    }
+  }
+
+  std::shared_ptr<const std::vector<GCThreshold>> next;
+  if (!thresholds.empty()) {
+    next.reset(new std::vector<GCThreshold>(std::move(thresholds)));
+  }
+  std::lock_guard<std::mutex> guard(mu_);
+  thresholds_ = std::move(next);
+  return rocksdb::Status::OK();
+}
+
+uint64_t GCCompactionFilterFactory::NumDropped() const { return dropped_.load(); }
+
+std::unique_ptr<rocksdb::CompactionFilter> GCCompactionFilterFactory::CreateCompactionFilter(
+    const rocksdb::CompactionFilter::Context& context) {
+  std::shared_ptr<const std::vector<GCThreshold>> thresholds;
+  {
+    std::lock_guard<std::mutex> guard(mu_);
+    thresholds = thresholds_;
+  }
+  if (thresholds == nullptr) {
+    return nullptr;
+  }
+  return std::unique_ptr<rocksdb::CompactionFilter>(
+      new gcCompactionFilter(std::move(thresholds), &dropped_));
+}
+
+}  // namespace cockroach
@@ -0,0 +1,67 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <libroach.h>
+#include <memory>
+#include <mutex>
+#include <rocksdb/compaction_filter.h>
+#include <rocksdb/status.h>
+#include <string>
+#include <vector>
+
+namespace cockroach {
+
+// GCThreshold is the GC threshold of the user keys in [start, end). An
+// empty end denotes the end of the key space.
+struct GCThreshold {
+  std::string start;
+  std::string end;
+  DBTimestamp threshold;
+};
+
+// GCCompactionFilterFactory creates compaction filters which perform
+// MVCC garbage collection as part of compactions. The filters drop the
+// MVCC versions of a key which are shadowed by a newer version at or
+// below the GC threshold of the key. The newest version at or below the
+// threshold is kept (even if it is a deletion tombstone), as are all
+// versions of keys with an intent in the compaction. Without any
+// thresholds no compaction filters are created.
+class GCCompactionFilterFactory : public rocksdb::CompactionFilterFactory {
+ public:
+  GCCompactionFilterFactory();
+
+  // SetThresholds replaces the GC thresholds. Returns an error if a
+  // span is empty or the spans overlap.
+  rocksdb::Status SetThresholds(std::vector<GCThreshold> thresholds);
+  // NumDropped returns the number of versions dropped by compactions.
+  uint64_t NumDropped() const;
+
+  std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
+      const rocksdb::CompactionFilter::Context& context) override;
+  const char* Name() const override { return kName; }
+
+  static const char* const kName;
+
+ private:
+  std::mutex mu_;
+  // The thresholds sorted by start key. Replaced, never modified, so
+  // that running compactions can keep using the previous thresholds.
+  std::shared_ptr<const std::vector<GCThreshold>> thresholds_;
+  std::atomic<uint64_t> dropped_;
+};
+
+}  // namespace cockroach
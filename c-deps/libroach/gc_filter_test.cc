@@ -0,0 +1,167 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <string>
+#include <vector>
+#include "db.h"
+#include "encoding.h"
+#include "gc_filter.h"
+#include "include/libroach.h"
+#include "testutils.h"
+
+using namespace cockroach;
+using namespace testutils;
+
+namespace {
+
+GCThreshold threshold(const std::string& start, const std::string& end, int64_t wall_time) {
+  return GCThreshold{start, end, DBTimestamp{wall_time, 0}};
+}
+
+}  // namespace
+
+TEST(Libroach, GCThresholdsValidation) {
+  GCCompactionFilterFactory factory;
+  const rocksdb::CompactionFilter::Context context = {};
+  EXPECT_EQ(nullptr, factory.CreateCompactionFilter(context));
+
+  EXPECT_TRUE(factory.SetThresholds({threshold("c", "d", 1), threshold("a", "b", 1)}).ok());
+  EXPECT_NE(nullptr, factory.CreateCompactionFilter(context));
+  EXPECT_TRUE(factory.SetThresholds({threshold("a", "b", 1), threshold("b", "", 1)}).ok());
+
+  EXPECT_FALSE(factory.SetThresholds({threshold("b", "a", 1)}).ok());
+  EXPECT_FALSE(factory.SetThresholds({threshold("a", "a", 1)}).ok());
+  EXPECT_FALSE(factory.SetThresholds({threshold("a", "c", 1), threshold("b", "d", 1)}).ok());
+  EXPECT_FALSE(factory.SetThresholds({threshold("a", "", 1), threshold("b", "d", 1)}).ok());
+  // Failed updates leave the thresholds unchanged.
+  EXPECT_NE(nullptr, factory.CreateCompactionFilter(context));
+
+  EXPECT_TRUE(factory.SetThresholds({}).ok());
+  EXPECT_EQ(nullptr, factory.CreateCompactionFilter(context));
+}
+
+TEST(Libroach, GCCompactionFilter) {
+  GCCompactionFilterFactory factory;
+  EXPECT_TRUE(factory.SetThresholds({threshold("b", "d", 5), threshold("x", "", 100)}).ok());
+  std::unique_ptr<rocksdb::CompactionFilter> filter(
+      factory.CreateCompactionFilter(rocksdb::CompactionFilter::Context()));
+
+  struct TestCase {
+    std::string key;
+    int64_t wall_time;
+    bool dropped;
+  };
+
+  std::vector<TestCase> testCases = {
+      // Outside of any span.
+      {"a", 9, false},
+      {"a", 3, false},
+      {"a", 1, false},
+      // The newest version at or below the threshold shadows all older
+      // versions.
+      {"b", 9, false},
+      {"b", 5, false},
+      {"b", 4, true},
+      {"b", 1, true},
+      // An intent protects all versions.
+      {"c", 0, false},
+      {"c", 9, false},
+      {"c", 3, false},
+      {"c", 1, false},
+      // An inline value.
+      {"c1", 0, false},
+      // Versions above the threshold are kept.
+      {"c2", 9, false},
+      {"c2", 7, false},
+      {"c2", 4, false},
+      {"c2", 2, true},
+      // The end key is exclusive.
+      {"d", 3, false},
+      {"d", 1, false},
+      {"x", 3, false},
+      {"x", 1, true},
+      {"zzz", 50, false},
+      {"zzz", 10, true},
+  };
+
+  int dropped = 0;
+  for (const auto& c : testCases) {
+    std::string new_value;
+    bool value_changed = false;
+    const bool result = filter->Filter(6, EncodeKey(c.key, c.wall_time, 0), "value", &new_value,
+                                       &value_changed);
+    EXPECT_EQ(c.dropped, result) << c.key << "@" << c.wall_time;
+    EXPECT_FALSE(value_changed);
+    dropped += result;
+  }
+
+  filter.reset();
+  EXPECT_EQ(dropped, factory.NumDropped());
+}
+
+TEST(Libroach, DBSetGCThresholds) {
+  DBOptions db_opts = defaultDBOptions();
+  DBEngine* db;
+
+  // The compaction filter is only installed if requested.
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+  DBStatus status = DBSetGCThresholds(db, nullptr, 0);
+  EXPECT_EQ("GC compaction filter is not enabled", ToString(status));
+  free(status.data);
+  DBClose(db);
+
+  db_opts.gc_compaction_filter = true;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+
+  for (const std::string key : {"a", "b"}) {
+    for (int64_t wall_time = 1; wall_time <= 10; wall_time++) {
+      DBKey k = {ToDBSlice(key), wall_time, 0};
+      EXPECT_STREQ(DBPut(db, k, ToDBSlice("value")).data, NULL);
+    }
+  }
+
+  EXPECT_STREQ(DBFlush(db).data, NULL);
+
+  DBGCThreshold thresholds[] = {
+      {ToDBSlice("b"), ToDBSlice("c"), DBTimestamp{5, 0}},
+  };
+  EXPECT_STREQ(DBSetGCThresholds(db, thresholds, 1).data, NULL);
+  EXPECT_STREQ(DBCompactRange(db, DBSlice(), DBSlice(), true /* force_bottommost */).data, NULL);
+
+  auto versions = [&](const std::string& key) {
+    DBIterator* iter = DBNewIter(db, false /* prefix */, false /* stats */);
+    int n = 0;
+    for (DBIterState state = DBIterSeek(iter, DBKey{ToDBSlice(key), 0, 0});
+         state.valid && ToString(state.key.key) == key;
+         state = DBIterNext(iter, false /* skip_current_key_versions */)) {
+      n++;
+    }
+    DBIterDestroy(iter);
+    return n;
+  };
+  EXPECT_EQ(10, versions("a"));
+  // The versions at 1-4 are shadowed by the version at 5.
+  EXPECT_EQ(6, versions("b"));
+
+  DBGCThreshold overlapping[] = {
+      {ToDBSlice("a"), ToDBSlice("c"), DBTimestamp{5, 0}},
+      {ToDBSlice("b"), ToDBSlice("d"), DBTimestamp{5, 0}},
+  };
+  status = DBSetGCThresholds(db, overlapping, 2);
+  const std::string err = ToString(status);
+  EXPECT_NE(std::string::npos, err.find("overlapping GC threshold spans")) << err;
+  free(status.data);
+
+  DBClose(db);
+}
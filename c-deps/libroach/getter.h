@@ -44,10 +44,11 @@ struct IteratorGetter : public Getter {
 struct DBGetter : public Getter {
   rocksdb::DB* const rep;
   rocksdb::ReadOptions const options;
-  std::string const key;
+  // The encoded key. The caller retains ownership of the underlying data.
+  rocksdb::Slice const key;
 
-  DBGetter(rocksdb::DB* const r, rocksdb::ReadOptions opts, std::string&& k)
-      : rep(r), options(opts), key(std::move(k)) {}
+  DBGetter(rocksdb::DB* const r, rocksdb::ReadOptions opts, rocksdb::Slice k)
+      : rep(r), options(opts), key(k) {}
 
   virtual DBStatus Get(DBString* value);
 };
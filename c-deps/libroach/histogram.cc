@@ -0,0 +1,186 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "histogram.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <set>
+
+namespace cockroach {
+
+namespace {
+
+const uint64_t kSubBuckets = 1 << kHistogramSubBucketBits;
+const uint64_t kMaxNanos = (uint64_t(1) << kHistogramMaxBits) - 1;
+
+// threadHistograms are the histograms of a single thread. They are
+// written by their thread and read concurrently by GetHistogram, hence
+// the (relaxed) atomics.
+struct threadHistograms {
+  threadHistograms() {
+    for (int t = 0; t < kNumHistogramTypes; t++) {
+      for (int i = 0; i < kNumHistogramBuckets; i++) {
+        buckets[t][i].store(0, std::memory_order_relaxed);
+      }
+      sum[t].store(0, std::memory_order_relaxed);
+      max[t].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // add is only called by the thread owning the histograms, or with
+  // the registry lock held for the histograms of exited threads.
+  void add(HistogramType type, int bucket, uint64_t count, uint64_t nanos, uint64_t max_nanos) {
+    increment(&buckets[type][bucket], count);
+    increment(&sum[type], nanos);
+    if (max_nanos > max[type].load(std::memory_order_relaxed)) {
+      max[type].store(max_nanos, std::memory_order_relaxed);
+    }
+  }
+
+  static void increment(std::atomic<uint64_t>* v, uint64_t delta) {
+    v->store(v->load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> buckets[kNumHistogramTypes][kNumHistogramBuckets];
+  std::atomic<uint64_t> sum[kNumHistogramTypes];
+  std::atomic<uint64_t> max[kNumHistogramTypes];
+};
+
+struct registry {
+  std::mutex mu;
+  std::set<threadHistograms*> threads;
+  // The merged histograms of the threads which exited.
+  threadHistograms exited;
+};
+
+// getRegistry returns the registry of the thread histograms. The
+// registry is never deleted so that it outlives the threads.
+registry* getRegistry() {
+  static registry* r = new registry;
+  return r;
+}
+
+// threadHistogramsHandle registers the histograms of a thread and
+// merges them into the histograms of the exited threads when the
+// thread exits.
+struct threadHistogramsHandle {
+  threadHistogramsHandle() : histograms(new threadHistograms) {
+    registry* r = getRegistry();
+    std::lock_guard<std::mutex> guard(r->mu);
+    r->threads.insert(histograms);
+  }
+  ~threadHistogramsHandle() {
+    registry* r = getRegistry();
+    std::lock_guard<std::mutex> guard(r->mu);
+    for (int t = 0; t < kNumHistogramTypes; t++) {
+      const HistogramType type = static_cast<HistogramType>(t);
+      for (int i = 0; i < kNumHistogramBuckets; i++) {
+        const uint64_t count = histograms->buckets[t][i].load(std::memory_order_relaxed);
+        if (count > 0) {
+          r->exited.add(type, i, count, 0, 0);
+        }
+      }
+      r->exited.add(type, 0, 0, histograms->sum[t].load(std::memory_order_relaxed),
+                    histograms->max[t].load(std::memory_order_relaxed));
+    }
+    r->threads.erase(histograms);
+    delete histograms;
+  }
+
+  threadHistograms* const histograms;
+};
+
+}  // namespace
+
+int HistogramBucket(uint64_t nanos) {
+  if (nanos < kSubBuckets) {
+    return int(nanos);
+  }
+  if (nanos > kMaxNanos) {
+    nanos = kMaxNanos;
+  }
+  const int shift = 63 - __builtin_clzll(nanos) - kHistogramSubBucketBits;
+  return int(((shift + 1) << kHistogramSubBucketBits) + ((nanos >> shift) - kSubBuckets));
+}
+
+uint64_t HistogramBucketMax(int bucket) {
+  if (bucket < int(kSubBuckets)) {
+    return bucket;
+  }
+  const int shift = (bucket >> kHistogramSubBucketBits) - 1;
+  const uint64_t min = (kSubBuckets + (bucket & (kSubBuckets - 1))) << shift;
+  return min + (uint64_t(1) << shift) - 1;
+}
+
+void RecordLatency(HistogramType type, uint64_t nanos) {
+  static thread_local threadHistogramsHandle handle;
+  handle.histograms->add(type, HistogramBucket(nanos), 1, nanos, nanos);
+}
+
+void GetHistogram(HistogramType type, DBHistogram* result) {
+  uint64_t buckets[kNumHistogramBuckets] = {};
+  uint64_t sum = 0;
+  uint64_t max = 0;
+  {
+    registry* r = getRegistry();
+    std::lock_guard<std::mutex> guard(r->mu);
+    auto merge = [&](const threadHistograms& h) {
+      for (int i = 0; i < kNumHistogramBuckets; i++) {
+        buckets[i] += h.buckets[type][i].load(std::memory_order_relaxed);
+      }
+      sum += h.sum[type].load(std::memory_order_relaxed);
+      max = std::max(max, h.max[type].load(std::memory_order_relaxed));
+    };
+    merge(r->exited);
+    for (const threadHistograms* h : r->threads) {
+      merge(*h);
+    }
+  }
+
+  uint64_t count = 0;
+  for (int i = 0; i < kNumHistogramBuckets; i++) {
+    count += buckets[i];
+  }
+  *result = DBHistogram();
+  result->count = count;
+  result->sum_nanos = sum;
+  result->max_nanos = max;
+  if (count == 0) {
+    return;
+  }
+
+  // The quantiles are the largest latency in the bucket holding them,
+  // like HDR histograms' highest equivalent value.
+  const struct {
+    double q;
+    int64_t* value;
+  } quantiles[] = {
+      {0.50, &result->p50_nanos},
+      {0.90, &result->p90_nanos},
+      {0.99, &result->p99_nanos},
+      {0.999, &result->p999_nanos},
+  };
+  uint64_t seen = 0;
+  int q = 0;
+  for (int i = 0; i < kNumHistogramBuckets && q < 4; i++) {
+    seen += buckets[i];
+    while (q < 4 && seen >= quantiles[q].q * count) {
+      *quantiles[q].value = std::min(HistogramBucketMax(i), max);
+      q++;
+    }
+  }
+}
+
+}  // namespace cockroach
@@ -0,0 +1,75 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <libroach.h>
+#include <stdint.h>
+
+namespace cockroach {
+
+// HistogramType identifies the operations whose latencies are recorded.
+enum HistogramType {
+  kHistogramGet,
+  kHistogramMVCCGet,
+  kHistogramMVCCScan,
+  kHistogramCommitBatch,
+  kHistogramApplyBatchRepr,
+  kHistogramIngestExternalFiles,
+  kHistogramSstFileWriterFinish,
+  kNumHistogramTypes,
+};
+
+// The latency histograms are log-linear, like HDR histograms: every
+// power of two is divided into 2^kHistogramSubBucketBits buckets, which
+// bounds the relative error of a recorded latency to 1/8. Latencies
+// are recorded in nanoseconds and clamped to 2^kHistogramMaxBits.
+const int kHistogramSubBucketBits = 3;
+const int kHistogramMaxBits = 36;
+const int kNumHistogramBuckets =
+    (kHistogramMaxBits - kHistogramSubBucketBits + 1) << kHistogramSubBucketBits;
+
+// HistogramBucket returns the bucket of a latency. Exposed for testing.
+int HistogramBucket(uint64_t nanos);
+// HistogramBucketMax returns the largest latency in a bucket. Exposed
+// for testing.
+uint64_t HistogramBucketMax(int bucket);
+
+// RecordLatency adds a latency to the histograms of the calling
+// thread. The histograms are only written by their thread, without any
+// locking or atomic read-modify-write instructions.
+void RecordLatency(HistogramType type, uint64_t nanos);
+
+// GetHistogram merges the histograms of all threads, including the ones
+// which exited, and summarizes them.
+void GetHistogram(HistogramType type, DBHistogram* result);
+
+// ScopedLatency records the time between its construction and its
+// destruction.
+class ScopedLatency {
+ public:
+  explicit ScopedLatency(HistogramType type)
+      : type_(type), start_(std::chrono::steady_clock::now()) {}
+  ~ScopedLatency() {
+    const auto elapsed = std::chrono::steady_clock::now() - start_;
+    RecordLatency(type_, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+
+ private:
+  const HistogramType type_;
+  const std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace cockroach
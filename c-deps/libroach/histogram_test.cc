@@ -0,0 +1,115 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <thread>
+#include <vector>
+#include "db.h"
+#include "histogram.h"
+#include "include/libroach.h"
+#include "testutils.h"
+
+using namespace cockroach;
+using namespace testutils;
+
+TEST(Libroach, HistogramBuckets) {
+  // Small latencies have a bucket each.
+  for (uint64_t nanos = 0; nanos < 8; nanos++) {
+    EXPECT_EQ(nanos, HistogramBucket(nanos));
+    EXPECT_EQ(nanos, HistogramBucketMax(nanos));
+  }
+
+  int prev = HistogramBucket(7);
+  for (uint64_t nanos = 8; nanos < 100000; nanos++) {
+    const int bucket = HistogramBucket(nanos);
+    // The buckets are contiguous and bound the relative error.
+    EXPECT_LE(prev, bucket);
+    EXPECT_GE(prev + 1, bucket);
+    EXPECT_LE(nanos, HistogramBucketMax(bucket));
+    EXPECT_GE(nanos + nanos / 8, HistogramBucketMax(bucket));
+    prev = bucket;
+  }
+
+  // Large latencies are clamped.
+  EXPECT_EQ(kNumHistogramBuckets - 1, HistogramBucket(1ULL << kHistogramMaxBits));
+  EXPECT_EQ(kNumHistogramBuckets - 1, HistogramBucket(~0ULL));
+}
+
+TEST(Libroach, HistogramRecord) {
+  DBHistogram before;
+  GetHistogram(kHistogramSstFileWriterFinish, &before);
+
+  // Record 1000 latencies of 1..1000us, half of them from threads which
+  // exit before the histogram is read.
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 10; i++) {
+    threads.emplace_back([i] {
+      for (int j = 1; j <= 50; j++) {
+        RecordLatency(kHistogramSstFileWriterFinish, (i * 50 + j) * 1000);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (int i = 501; i <= 1000; i++) {
+    RecordLatency(kHistogramSstFileWriterFinish, i * 1000);
+  }
+
+  DBHistogram h;
+  GetHistogram(kHistogramSstFileWriterFinish, &h);
+  EXPECT_EQ(1000, h.count - before.count);
+  EXPECT_EQ(500500000, h.sum_nanos - before.sum_nanos);
+  EXPECT_EQ(1000000, h.max_nanos);
+
+  const struct {
+    int64_t expected;
+    int64_t actual;
+  } quantiles[] = {
+      {500000, h.p50_nanos},
+      {900000, h.p90_nanos},
+      {990000, h.p99_nanos},
+      {999000, h.p999_nanos},
+  };
+  for (const auto& q : quantiles) {
+    EXPECT_LE(q.expected, q.actual);
+    EXPECT_GE(q.expected + q.expected / 8, q.actual);
+  }
+
+  // Other histograms are unaffected.
+  DBHistogram other;
+  GetHistogram(kHistogramIngestExternalFiles, &other);
+  EXPECT_EQ(0, other.count);
+}
+
+TEST(Libroach, DBGetHistograms) {
+  DBOptions db_opts = defaultDBOptions();
+  DBEngine* db;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+
+  DBHistogramsResult before;
+  EXPECT_STREQ(DBGetHistograms(&before).data, NULL);
+
+  DBKey key = {ToDBSlice("a"), 0, 0};
+  EXPECT_STREQ(DBPut(db, key, ToDBSlice("value")).data, NULL);
+  DBString value;
+  EXPECT_STREQ(DBGet(db, key, &value).data, NULL);
+  free(value.data);
+
+  DBHistogramsResult after;
+  EXPECT_STREQ(DBGetHistograms(&after).data, NULL);
+  EXPECT_EQ(1, after.get.count - before.get.count);
+  EXPECT_EQ(0, after.mvcc_scan.count - before.mvcc_scan.count);
+
+  DBClose(db);
+}
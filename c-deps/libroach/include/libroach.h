@@ -71,12 +71,58 @@ typedef struct {
   bool use_file_registry;
   bool must_exist;
   bool read_only;
+  // If true, sstables are written with partitioned (two-level) index
+  // and filter blocks. Only the top-level index and filter partitions
+  // are pinned in memory; the partitions are loaded into the block
+  // cache on demand.
+  bool partitioned_index_filters;
+  // If true, sstables are compressed using a per-level policy: no
+  // compression for L0, Snappy for the base and intermediate levels
+  // and ZSTD with a trained dictionary for the bottommost level, which
+  // holds most of the (cold) data. Requires RocksDB to be built with
+  // ZSTD support; DBOpen fails otherwise.
+  bool tiered_compression;
+  // If positive, the rate (in bytes/sec) at which flushes and
+  // compactions may write to disk. The limiter is auto-tuned: the
+  // effective rate is adjusted between 5% and 100% of this limit based
+  // on recent demand. Flushes are served ahead of compactions. Zero
+  // disables rate limiting.
+  int64_t rate_limit_bytes_per_sec;
+  // If true, compactions drop MVCC versions below the GC thresholds
+  // set by DBSetGCThresholds. The compaction filter makes RocksDB
+  // rewrite sstables which it could otherwise move to a lower level
+  // as is, so it is only installed if requested. Not exposed to Go:
+  // the replicas of a range would drop versions at different times and
+  // MVCC stats would not account for them.
+  bool gc_compaction_filter;
+  // If true, iterators count the deletion tombstones they skip and the
+  // key spans in which many are skipped are compacted in the
+  // background. Counting enables the perf context on every iterator
+  // operation, so it is only done if requested.
+  bool compact_tombstones;
   DBSlice rocksdb_options;
   DBSlice extra_options;
 } DBOptions;
 
-// Create a new cache with the specified size.
-DBCache* DBNewCache(uint64_t size);
+// DBCacheOptions contains block cache options.
+typedef struct {
+  uint64_t size;
+  // The number of CPUs accessing the cache. The cache is split into a
+  // power of two number of shards, each protected by its own mutex,
+  // which scales with num_cpu to keep lock contention low.
+  int num_cpu;
+  // The fraction of the cache reserved for high priority blocks (index
+  // and filter blocks when they are stored in the cache) so that scans
+  // of cold data do not evict them. Ignored by the CLOCK cache.
+  double high_pri_pool_ratio;
+  // If true, use a CLOCK cache whose lookups do not take the shard
+  // mutex. DBNewCache returns NULL if RocksDB was built without CLOCK
+  // cache support.
+  bool use_clock_cache;
+} DBCacheOptions;
+
+// Create a new cache with the specified options.
+DBCache* DBNewCache(DBCacheOptions opts);
 
 // Add a reference to an existing cache. Note that the underlying
 // RocksDB cache is shared between the original and new reference.
@@ -114,6 +160,45 @@ DBStatus DBCompact(DBEngine* db);
 // If end is empty, it indicates the end of the database.
 DBStatus DBCompactRange(DBEngine* db, DBSlice start, DBSlice end, bool force_bottommost);
 
+// Changes mutable RocksDB column family options (e.g.
+// level0_slowdown_writes_trigger, write_buffer_size) at runtime. The
+// options are specified using the same "key1=value1;key2=value2" syntax
+// as DBOptions.rocksdb_options. The changes are validated before any
+// of them is applied and are not persisted across restarts.
+DBStatus DBSetOptions(DBEngine* db, DBSlice options);
+
+// Changes mutable RocksDB database-wide options (e.g.
+// max_background_jobs, delayed_write_rate) at runtime. See
+// DBSetOptions.
+DBStatus DBSetDBOptions(DBEngine* db, DBSlice options);
+
+// DBSetRateLimit sets the maximum rate (in bytes/sec) of flush and
+// compaction writes. The auto-tuned rate limiter scales its effective
+// rate below this limit. Returns an error if the engine was opened
+// without a rate limiter.
+DBStatus DBSetRateLimit(DBEngine* db, int64_t bytes_per_sec);
+
+// DBGCThreshold is the MVCC GC threshold of the keys in [start,
+// end). An empty end denotes the end of the key space.
+typedef struct {
+  DBSlice start;
+  DBSlice end;
+  DBTimestamp threshold;
+} DBGCThreshold;
+
+// DBSetGCThresholds replaces the GC thresholds applied by
+// compactions. Compactions drop the MVCC versions of a key which are
+// shadowed by a newer version at or below the key's threshold, unless
+// the key has an intent in the compaction. The spans must not
+// overlap. Setting no thresholds disables GC during compactions.
+// Fails unless the DB was opened with gc_compaction_filter.
+//
+// The caller must ensure that there are no unresolved intents at or
+// below a threshold. Compactions run independently on each replica
+// and do not update MVCC stats, so versions may be dropped from the
+// replicas of a range at different times.
+DBStatus DBSetGCThresholds(DBEngine* db, const DBGCThreshold* thresholds, int len);
+
 // Stores the approximate on-disk size of the given key range into the
 // supplied uint64.
 DBStatus DBApproximateDiskBytes(DBEngine* db, DBKey start, DBKey end, uint64_t* size);
@@ -133,6 +218,16 @@ DBStatus DBDelete(DBEngine* db, DBKey key);
 // Deletes a range of keys from start (inclusive) to end (exclusive).
 DBStatus DBDeleteRange(DBEngine* db, DBKey start, DBKey end);
 
+// Deletes a range of keys from start (inclusive) to end (exclusive)
+// from the engine's underlying database and reclaims their space
+// quickly. First, all sstables which lie entirely within the range are
+// deleted. Then the remaining keys are deleted with a range tombstone
+// and the sstables overlapping the range are scheduled for
+// compaction. Unlike DBDeleteRange, deleting the sstables is not atomic
+// and ignores snapshots: it must only be used for ranges which are no
+// longer read or written, such as dropped tables.
+DBStatus DBDeleteFilesAndRange(DBEngine* db, DBKey start, DBKey end);
+
 // Deletes a range of keys from start (inclusive) to end
 // (exclusive). Unlike DBDeleteRange, this function finds the keys to
 // delete by iterating over the supplied iterator and creating
@@ -198,6 +293,30 @@ typedef struct {
   //
   // TODO(tschottdorf): populate this field for all iterators.
   uint64_t timebound_num_ssts;
+  // the number of SSTables whose timestamp bounds do not overlap the
+  // time range (only for time bound iterators). These SSTables are
+  // skipped without being read. This field is populated from the table
+  // filter.
+  uint64_t timebound_num_ssts_pruned;
+  // RocksDB perf and IO stats context counters. The number of blocks
+  // found in the block cache and the number, size and read time of the
+  // blocks read from sstables, i.e. the block cache misses.
+  uint64_t block_cache_hit_count;
+  uint64_t block_read_count;
+  uint64_t block_read_bytes;
+  uint64_t block_read_nanos;
+  uint64_t block_decompress_nanos;
+  // The number of sstable bloom filter checks which did (hit) or did
+  // not (miss) match the key.
+  uint64_t bloom_sst_hit_count;
+  uint64_t bloom_sst_miss_count;
+  // The time spent seeking the iterators of the memtables and
+  // sstables, and the time spent stepping over them to the next visible
+  // key.
+  uint64_t seek_nanos;
+  uint64_t next_nanos;
+  // The bytes read from files.
+  uint64_t bytes_read;
   // New fields added here must also be added in various other places;
   // just grep the repo for internal_delete_skipped_count. Sorry.
 } IteratorStats;
@@ -306,6 +425,20 @@ typedef struct {
   int64_t compactions;
   int64_t table_readers_mem_estimate;
   int64_t pending_compaction_bytes_estimate;
+  // The rate limiter's current (auto-tuned) rate, the bytes written
+  // through it by flushes and compactions and the number of times it
+  // ran out of budget and throttled a writer. All zero if rate
+  // limiting is disabled.
+  int64_t rate_limit_bytes_per_sec;
+  int64_t rate_limiter_flush_bytes;
+  int64_t rate_limiter_compaction_bytes;
+  int64_t rate_limiter_drains;
+  // The number of compactions run for key spans in which iterators
+  // skipped many deletion tombstones and the number of key spans
+  // tracked which haven't reached the threshold yet. Both zero unless
+  // the DB was opened with compact_tombstones.
+  int64_t tombstone_compactions;
+  int64_t tombstone_spans_tracked;
 } DBStatsResult;
 
 // DBEnvStatsResult contains Env stats (filesystem layer).
@@ -322,13 +455,78 @@ typedef struct {
   DBString encryption_status;
 } DBEnvStatsResult;
 
+// DBWriteStallStats contains the signals which lead up to RocksDB
+// slowing down or stopping writes.
+typedef struct {
+  // The number of L0 sstables, unflushed immutable memtables and the
+  // estimated number of bytes compactions need to rewrite to bring all
+  // levels down to their target size. These are updated when flushes
+  // and compactions start or finish.
+  int64_t l0_file_count;
+  int64_t immutable_memtable_count;
+  int64_t pending_compaction_bytes;
+  // The current write stall condition: 0 if writes are not stalled, 1
+  // if they are slowed down and 2 if they are stopped.
+  int32_t stall_condition;
+  // The time of the last change of the stall condition in nanoseconds
+  // since the Unix epoch, or 0 if it never changed.
+  int64_t stall_condition_nanos;
+  // The number of times writes were slowed down or stopped.
+  int64_t slowdowns;
+  int64_t stops;
+} DBWriteStallStats;
+
 DBStatus DBGetStats(DBEngine* db, DBStatsResult* stats);
 DBString DBGetCompactionStats(DBEngine* db);
 DBStatus DBGetEnvStats(DBEngine* db, DBEnvStatsResult* stats);
+// DBGetWriteStallStats is cheap enough to be called for every request.
+DBStatus DBGetWriteStallStats(DBEngine* db, DBWriteStallStats* stats);
+
+// DBHistogram summarizes the latencies of an operation. The quantiles
+// are accurate to within 1/8 of their value.
+typedef struct {
+  int64_t count;
+  int64_t sum_nanos;
+  int64_t max_nanos;
+  int64_t p50_nanos;
+  int64_t p90_nanos;
+  int64_t p99_nanos;
+  int64_t p999_nanos;
+} DBHistogram;
+
+// DBHistogramsResult contains the latencies of libroach operations,
+// measured inside libroach and thus excluding the cgo overhead. The
+// histograms are cumulative and shared by all engines of the process.
+typedef struct {
+  // DBGet.
+  DBHistogram get;
+  // MVCCGet and MVCCScan.
+  DBHistogram mvcc_get;
+  DBHistogram mvcc_scan;
+  // The commit of a batch by DBCommitAndCloseBatch.
+  DBHistogram commit_batch;
+  DBHistogram apply_batch_repr;
+  DBHistogram ingest_external_files;
+  DBHistogram sst_file_writer_finish;
+} DBHistogramsResult;
+
+DBStatus DBGetHistograms(DBHistogramsResult* result);
 
 typedef struct {
   int level;
   uint64_t size;
+  // The uncompressed size of the keys and values in the sstable. The
+  // compression ratio of a level is the sum of raw_size over the sum
+  // of size.
+  uint64_t raw_size;
+  // The on-disk sizes of the sstable's index blocks, of its top-level
+  // index block (partitioned indexes only) and of its filter
+  // blocks. They bound the memory table readers hold for the sstable
+  // outside of the block cache (rocksdb.estimate-table-readers-mem) or
+  // pin in it (the top-level index of partitioned indexes).
+  uint64_t index_size;
+  uint64_t top_level_index_size;
+  uint64_t filter_size;
   DBKey start_key;
   DBKey end_key;
 } DBSSTable;
@@ -20,12 +20,25 @@
 #include <rocksdb/write_batch.h>
 #include "chunked_buffer.h"
 #include "encoding.h"
+#include "tombstone_compactor.h"
 
 struct DBIterator {
-  DBIterator(std::atomic<int64_t>* iters) : iters_count(iters) { ++(*iters_count); }
-  ~DBIterator() { --(*iters_count); }
+  DBIterator(std::atomic<int64_t>* iters, cockroach::TombstoneCompactor* tc)
+      : iters_count(iters), tombstone_compactor(tc) {
+    ++(*iters_count);
+  }
+  ~DBIterator() {
+    --(*iters_count);
+    if (tombstone_compactor != nullptr) {
+      tombstone_compactor->Record(tombstones);
+    }
+  }
 
   std::atomic<int64_t>* const iters_count;
+  // The deletion tombstones skipped by the iterator are reported to
+  // tombstone_compactor, if any, when the iterator is destroyed.
+  cockroach::TombstoneCompactor* const tombstone_compactor;
+  cockroach::TombstoneSpan tombstones;
   std::unique_ptr<rocksdb::Iterator> rep;
   std::unique_ptr<cockroach::chunkedBuffer> kvs;
   std::unique_ptr<rocksdb::WriteBatch> intents;
@@ -19,6 +19,7 @@
 #include "protos/roachpb/data.pb.h"
 #include "protos/roachpb/internal.pb.h"
 #include "status.h"
+#include "timeseries.h"
 
 namespace cockroach {
 
@@ -44,6 +45,104 @@ cockroach::roachpb::ValueType GetTag(const std::string& val) {
 
 void SetTag(std::string* val, cockroach::roachpb::ValueType tag) { (*val)[kTagPos] = tag; }
 
+// MergeScratch holds messages that are reused across merge operator
+// invocations on the same thread. Compactions over merge-heavy SSTs invoke the
+// merge operator for every key, and allocating (and freeing) a fresh set of
+// messages and their nested buffers per operand thrashes the allocator. Reused
+// messages are Clear()'ed, which retains the capacity of their string and
+// repeated fields.
+struct MergeScratch {
+  cockroach::storage::engine::enginepb::MVCCMetadata meta;
+  cockroach::storage::engine::enginepb::MVCCMetadata operand;
+  cockroach::roachpb::InternalTimeSeriesData left_ts;
+  cockroach::roachpb::InternalTimeSeriesData right_ts;
+  cockroach::roachpb::InternalTimeSeriesData new_ts;
+};
+
+MergeScratch* GetMergeScratch() {
+  static thread_local MergeScratch scratch;
+  return &scratch;
+}
+
+// Buffers larger than this are released after a merge rather than being
+// retained by the thread's MergeScratch.
+const size_t kMaxRetainedScratchBytes = 1 << 20;
+
+void TrimScratchBuffer(std::string* buf) {
+  if (buf->capacity() > kMaxRetainedScratchBytes) {
+    std::string().swap(*buf);
+  }
+}
+
+// TrimScratchTimeSeries releases the repeated fields of a reused time series
+// message if they retain more than kMaxRetainedScratchBytes. Clear()'ed
+// samples are kept allocated by their repeated field, so samples_size() is
+// their high-water mark as long as the message is trimmed after every use.
+void TrimScratchTimeSeries(cockroach::roachpb::InternalTimeSeriesData* ts) {
+  const size_t retained =
+      ts->offset().Capacity() * sizeof(int32_t) + ts->count().Capacity() * sizeof(uint32_t) +
+      (ts->last().Capacity() + ts->sum().Capacity() + ts->max().Capacity() +
+       ts->min().Capacity() + ts->first().Capacity() + ts->variance().Capacity()) *
+          sizeof(double) +
+      ts->samples_size() * sizeof(cockroach::roachpb::InternalTimeSeriesSample);
+  if (retained > kMaxRetainedScratchBytes) {
+    cockroach::roachpb::InternalTimeSeriesData().Swap(ts);
+  }
+}
+
+// TrimScratchTimeSeriesMessages trims the time series messages of the
+// thread's MergeScratch after a time series merge.
+void TrimScratchTimeSeriesMessages() {
+  MergeScratch* scratch = GetMergeScratch();
+  TrimScratchTimeSeries(&scratch->left_ts);
+  TrimScratchTimeSeries(&scratch->right_ts);
+  TrimScratchTimeSeries(&scratch->new_ts);
+}
+
+// Counter values hold a single little-endian int64.
+const int kCounterSize = 8;
+
+bool IsCounter(const std::string& val) { return GetTag(val) == cockroach::roachpb::COUNTER; }
+
+WARN_UNUSED_RESULT bool DecodeCounter(const std::string& val, uint64_t* v) {
+  if (val.size() != kHeaderSize + kCounterSize) {
+    return false;
+  }
+  const rocksdb::Slice d = ValueDataBytes(val);
+  *v = 0;
+  for (int i = kCounterSize - 1; i >= 0; i--) {
+    *v = (*v << 8) | uint8_t(d[i]);
+  }
+  return true;
+}
+
+void EncodeCounter(std::string* val, uint64_t v) {
+  val->assign(kHeaderSize, 0);
+  SetTag(val, cockroach::roachpb::COUNTER);
+  for (int i = 0; i < kCounterSize; i++) {
+    val->push_back(char(v & 0xff));
+    v >>= 8;
+  }
+}
+
+// MergeCounterValues adds the int64 delta in right to the counter in left.
+// Overflow wraps around, matching Go's int64 arithmetic. Returns true if the
+// merge is successful.
+WARN_UNUSED_RESULT bool MergeCounterValues(std::string* left, const std::string& right,
+                                           rocksdb::Logger* logger) {
+  uint64_t left_v, right_v;
+  if (!DecodeCounter(*left, &left_v)) {
+    rocksdb::Warn(logger, "left counter value has invalid length %d", int(left->size()));
+    return false;
+  }
+  if (!DecodeCounter(right, &right_v)) {
+    rocksdb::Warn(logger, "right counter value has invalid length %d", int(right.size()));
+    return false;
+  }
+  EncodeCounter(left, left_v + right_v);
+  return true;
+}
+
 WARN_UNUSED_RESULT bool ParseProtoFromValue(const std::string& val,
                                             google::protobuf::MessageLite* msg) {
   if (val.size() < kHeaderSize) {
@@ -67,13 +166,33 @@ bool TimeSeriesSampleOrdering(const cockroach::roachpb::InternalTimeSeriesSample
 }
 
 // IsTimeSeriesData returns true if the given protobuffer Value contains a
-// TimeSeriesData message.
+// TimeSeriesData message in either the protobuf or compressed encoding.
 bool IsTimeSeriesData(const std::string& val) {
-  return GetTag(val) == cockroach::roachpb::TIMESERIES;
+  const auto tag = GetTag(val);
+  return tag == cockroach::roachpb::TIMESERIES || tag == cockroach::roachpb::TIMESERIES_COMPRESSED;
 }
 
+WARN_UNUSED_RESULT bool ParseTimeSeriesFromValue(const std::string& val,
+                                                 cockroach::roachpb::InternalTimeSeriesData* ts) {
+  if (GetTag(val) == cockroach::roachpb::TIMESERIES_COMPRESSED) {
+    return DecodeCompressedTimeSeries(ValueDataBytes(val), ts);
+  }
+  return ParseProtoFromValue(val, ts);
+}
+
+// SerializeTimeSeriesToValue serializes ts into the value using the encoding
+// indicated by tag. Data which cannot be represented by the compressed
+// encoding (e.g. row format data) falls back to the protobuf encoding.
 void SerializeTimeSeriesToValue(std::string* val,
-                                const cockroach::roachpb::InternalTimeSeriesData& ts) {
+                                const cockroach::roachpb::InternalTimeSeriesData& ts,
+                                cockroach::roachpb::ValueType tag) {
+  if (tag == cockroach::roachpb::TIMESERIES_COMPRESSED) {
+    val->assign(kHeaderSize, 0);
+    if (EncodeCompressedTimeSeries(ts, val)) {
+      SetTag(val, cockroach::roachpb::TIMESERIES_COMPRESSED);
+      return;
+    }
+  }
   SerializeProtoToValue(val, ts);
   SetTag(val, cockroach::roachpb::TIMESERIES);
 }
@@ -81,17 +200,23 @@ void SerializeTimeSeriesToValue(std::string* val,
 // MergeTimeSeriesValues attempts to merge two Values which contain
 // InternalTimeSeriesData messages. The messages cannot be merged if they have
 // different start timestamps or sample durations. Returns true if the merge is
-// successful.
+// successful. The result uses the compressed encoding if either input does.
 WARN_UNUSED_RESULT bool MergeTimeSeriesValues(std::string* left, const std::string& right,
                                               bool full_merge, rocksdb::Logger* logger) {
+  const auto tag = (GetTag(*left) == cockroach::roachpb::TIMESERIES_COMPRESSED ||
+                    GetTag(right) == cockroach::roachpb::TIMESERIES_COMPRESSED)
+                       ? cockroach::roachpb::TIMESERIES_COMPRESSED
+                       : cockroach::roachpb::TIMESERIES;
+
   // Attempt to parse TimeSeriesData from both Values.
-  cockroach::roachpb::InternalTimeSeriesData left_ts;
-  cockroach::roachpb::InternalTimeSeriesData right_ts;
-  if (!ParseProtoFromValue(*left, &left_ts)) {
+  MergeScratch* scratch = GetMergeScratch();
+  cockroach::roachpb::InternalTimeSeriesData& left_ts = scratch->left_ts;
+  cockroach::roachpb::InternalTimeSeriesData& right_ts = scratch->right_ts;
+  if (!ParseTimeSeriesFromValue(*left, &left_ts)) {
     rocksdb::Warn(logger, "left InternalTimeSeriesData could not be parsed from bytes.");
     return false;
   }
-  if (!ParseProtoFromValue(right, &right_ts)) {
+  if (!ParseTimeSeriesFromValue(right, &right_ts)) {
     rocksdb::Warn(logger, "right InternalTimeSeriesData could not be parsed from bytes.");
     return false;
   }
@@ -122,7 +247,7 @@ WARN_UNUSED_RESULT bool MergeTimeSeriesValues(std::string* left, const std::stri
       convertToColumnar(&right_ts);
     }
     left_ts.MergeFrom(right_ts);
-    SerializeTimeSeriesToValue(left, left_ts);
+    SerializeTimeSeriesToValue(left, left_ts, tag);
     return true;
   }
 
@@ -141,11 +266,12 @@ WARN_UNUSED_RESULT bool MergeTimeSeriesValues(std::string* left, const std::stri
         std::lower_bound(left_ts.offset().begin(), left_ts.offset().end(), *min_offset));
     left_ts.MergeFrom(right_ts);
     sortAndDeduplicateColumns(&left_ts, first_unsorted_index);
-    SerializeTimeSeriesToValue(left, left_ts);
+    SerializeTimeSeriesToValue(left, left_ts, tag);
   } else {
     // Initialize new_ts and its primitive data fields. Values from the left and
     // right collections will be merged into the new collection.
-    cockroach::roachpb::InternalTimeSeriesData new_ts;
+    cockroach::roachpb::InternalTimeSeriesData& new_ts = scratch->new_ts;
+    new_ts.Clear();
     new_ts.set_start_timestamp_nanos(left_ts.start_timestamp_nanos());
     new_ts.set_sample_duration_nanos(left_ts.sample_duration_nanos());
 
@@ -194,7 +320,7 @@ WARN_UNUSED_RESULT bool MergeTimeSeriesValues(std::string* left, const std::stri
     }
 
     // Serialize the new TimeSeriesData into the left value's byte field.
-    SerializeTimeSeriesToValue(left, new_ts);
+    SerializeTimeSeriesToValue(left, new_ts, tag);
   }
   return true;
 }
@@ -207,8 +333,9 @@ WARN_UNUSED_RESULT bool MergeTimeSeriesValues(std::string* left, const std::stri
 // if the merge is successful.
 WARN_UNUSED_RESULT bool ConsolidateTimeSeriesValue(std::string* val, rocksdb::Logger* logger) {
   // Attempt to parse TimeSeriesData from both Values.
-  cockroach::roachpb::InternalTimeSeriesData val_ts;
-  if (!ParseProtoFromValue(*val, &val_ts)) {
+  const auto tag = GetTag(*val);
+  cockroach::roachpb::InternalTimeSeriesData& val_ts = GetMergeScratch()->left_ts;
+  if (!ParseTimeSeriesFromValue(*val, &val_ts)) {
     rocksdb::Warn(logger, "InternalTimeSeriesData could not be parsed from bytes.");
     return false;
   }
@@ -234,7 +361,7 @@ WARN_UNUSED_RESULT bool ConsolidateTimeSeriesValue(std::string* val, rocksdb::Lo
   }
 
   // Serialize the new TimeSeriesData into the value's byte field.
-  SerializeTimeSeriesToValue(val, val_ts);
+  SerializeTimeSeriesToValue(val, val_ts, tag);
   return true;
 }
 
@@ -260,7 +387,8 @@ class DBMergeOperator : public rocksdb::MergeOperator {
     // corruption error will be returned, but likely only after the next
     // read of the key). In effect, there is no propagation of error
     // information to the client.
-    cockroach::storage::engine::enginepb::MVCCMetadata meta;
+    cockroach::storage::engine::enginepb::MVCCMetadata& meta = GetMergeScratch()->meta;
+    meta.Clear();
     if (existing_value != NULL) {
       if (!meta.ParseFromArray(existing_value->data(), existing_value->size())) {
         // Corrupted existing value.
@@ -275,7 +403,9 @@ class DBMergeOperator : public rocksdb::MergeOperator {
       }
     }
 
-    if (!meta.SerializeToString(new_value)) {
+    const bool ok = meta.SerializeToString(new_value);
+    TrimScratchBuffer(meta.mutable_raw_bytes());
+    if (!ok) {
       rocksdb::Warn(logger, "serialization error");
       return false;
     }
@@ -286,7 +416,8 @@ class DBMergeOperator : public rocksdb::MergeOperator {
                                  const std::deque<rocksdb::Slice>& operand_list,
                                  std::string* new_value,
                                  rocksdb::Logger* logger) const WARN_UNUSED_RESULT {
-    cockroach::storage::engine::enginepb::MVCCMetadata meta;
+    cockroach::storage::engine::enginepb::MVCCMetadata& meta = GetMergeScratch()->meta;
+    meta.Clear();
 
     for (int i = 0; i < operand_list.size(); i++) {
       if (!MergeOne(&meta, operand_list[i], false, logger)) {
@@ -294,7 +425,9 @@ class DBMergeOperator : public rocksdb::MergeOperator {
       }
     }
 
-    if (!meta.SerializeToString(new_value)) {
+    const bool ok = meta.SerializeToString(new_value);
+    TrimScratchBuffer(meta.mutable_raw_bytes());
+    if (!ok) {
       rocksdb::Warn(logger, "serialization error");
       return false;
     }
@@ -305,12 +438,15 @@ class DBMergeOperator : public rocksdb::MergeOperator {
   bool MergeOne(cockroach::storage::engine::enginepb::MVCCMetadata* meta,
                 const rocksdb::Slice& operand, bool full_merge,
                 rocksdb::Logger* logger) const WARN_UNUSED_RESULT {
-    cockroach::storage::engine::enginepb::MVCCMetadata operand_meta;
+    cockroach::storage::engine::enginepb::MVCCMetadata& operand_meta =
+        GetMergeScratch()->operand;
     if (!operand_meta.ParseFromArray(operand.data(), operand.size())) {
       rocksdb::Warn(logger, "corrupted operand value");
       return false;
     }
-    return MergeValues(meta, operand_meta, full_merge, logger);
+    const bool ok = MergeValues(meta, operand_meta, full_merge, logger);
+    TrimScratchBuffer(operand_meta.mutable_raw_bytes());
+    return ok;
   }
 };
 
@@ -461,11 +597,21 @@ WARN_UNUSED_RESULT bool MergeValues(cockroach::storage::engine::enginepb::MVCCMe
     }
 
     // Replay Advisory: Because merge commands pass through raft, it is possible
-    // for merging values to be "replayed". Currently, the only actual use of
-    // the merge system is for time series data, which is safe against replay;
-    // however, this property is not general for all potential mergeable types.
-    // If a future need arises to merge another type of data, replay protection
-    // will likely need to be a consideration.
+    // for merging values to be "replayed". Time series data is safe against
+    // replay; however, this property is not general for all potential
+    // mergeable types. In particular counter merges are not idempotent, so a
+    // replayed counter merge is double counted.
+
+    if (IsCounter(left->raw_bytes()) || IsCounter(right.raw_bytes())) {
+      if (!IsCounter(left->raw_bytes()) || !IsCounter(right.raw_bytes())) {
+        rocksdb::Warn(logger, "inconsistent value types for merging counter "
+                              "(type(left) != type(right))");
+        return false;
+      }
+      // Counter deltas sum associatively, so partial merges can fold them
+      // just like full merges.
+      return MergeCounterValues(left->mutable_raw_bytes(), right.raw_bytes(), logger);
+    }
 
     if (IsTimeSeriesData(left->raw_bytes()) || IsTimeSeriesData(right.raw_bytes())) {
       // The right operand must also be a time series.
@@ -474,8 +620,10 @@ WARN_UNUSED_RESULT bool MergeValues(cockroach::storage::engine::enginepb::MVCCMe
                               "series data (type(left) != type(right))");
         return false;
       }
-      return MergeTimeSeriesValues(left->mutable_raw_bytes(), right.raw_bytes(), full_merge,
-                                   logger);
+      const bool ok =
+          MergeTimeSeriesValues(left->mutable_raw_bytes(), right.raw_bytes(), full_merge, logger);
+      TrimScratchTimeSeriesMessages();
+      return ok;
     } else {
       const rocksdb::Slice rdata = ValueDataBytes(right.raw_bytes());
       left->mutable_raw_bytes()->append(rdata.data(), rdata.size());
@@ -487,10 +635,16 @@ WARN_UNUSED_RESULT bool MergeValues(cockroach::storage::engine::enginepb::MVCCMe
       left->mutable_merge_timestamp()->CopyFrom(right.merge_timestamp());
     }
     if (full_merge && IsTimeSeriesData(left->raw_bytes())) {
-      if (!ConsolidateTimeSeriesValue(left->mutable_raw_bytes(), logger)) {
+      const bool ok = ConsolidateTimeSeriesValue(left->mutable_raw_bytes(), logger);
+      TrimScratchTimeSeriesMessages();
+      if (!ok) {
         return false;
       }
     }
+    if (IsCounter(left->raw_bytes()) && left->raw_bytes().size() != kHeaderSize + kCounterSize) {
+      rocksdb::Warn(logger, "counter value has invalid length %d", int(left->raw_bytes().size()));
+      return false;
+    }
     return true;
   }
 }
@@ -500,9 +654,13 @@ DBStatus MergeResult(cockroach::storage::engine::enginepb::MVCCMetadata* meta, D
   // TODO(pmattis): Should recompute checksum here. Need a crc32
   // implementation and need to verify the checksumming is identical
   // to what is being done in Go. Zlib's crc32 should be sufficient.
+  //
+  // ByteSize() caches the message sizes, so serialize using the cached sizes
+  // rather than recomputing them.
   result->len = meta->ByteSize();
   result->data = static_cast<char*>(malloc(result->len));
-  if (!meta->SerializeToArray(result->data, result->len)) {
+  uint8_t* start = reinterpret_cast<uint8_t*>(result->data);
+  if (meta->SerializeWithCachedSizesToArray(start) - start != result->len) {
     return ToDBString("serialization error");
   }
   return kSuccess;
@@ -13,10 +13,13 @@
 // permissions and limitations under the License.
 
 #include <gtest/gtest.h>
+#include <limits>
 #include <utility>
 #include <vector>
 #include "merge.h"
+#include "protos/roachpb/data.pb.h"
 #include "protos/roachpb/internal.pb.h"
+#include "timeseries.h"
 
 using namespace cockroach;
 
@@ -232,3 +235,235 @@ TEST(TimeSeriesMerge, ConvertToColumnar) {
   convertToColumnar(&orig);
   EXPECT_EQ(orig.SerializeAsString(), expected.SerializeAsString());
 }
+
+std::string testTimeSeriesValue(const roachpb::InternalTimeSeriesData& data,
+                                roachpb::ValueType tag) {
+  std::string val(5, 0);
+  val[4] = tag;
+  if (tag == roachpb::TIMESERIES_COMPRESSED) {
+    EXPECT_TRUE(EncodeCompressedTimeSeries(data, &val));
+  } else {
+    data.AppendToString(&val);
+  }
+  return val;
+}
+
+TEST(TimeSeriesCompressed, RoundTrip) {
+  std::vector<roachpb::InternalTimeSeriesData> testCases(5);
+  // Empty.
+  testCases[0].set_start_timestamp_nanos(1000);
+  testCases[0].set_sample_duration_nanos(10);
+  // Regularly spaced samples without rollups.
+  testCases[1].set_start_timestamp_nanos(1521000000000000000);
+  testCases[1].set_sample_duration_nanos(10000000000);
+  for (int i = 0; i < 360; i++) {
+    testAddColumnsNoRollup(&testCases[1], i, 1000 + i / 10);
+  }
+  // Rollups with irregular offsets.
+  testCases[2].set_start_timestamp_nanos(-5);
+  testCases[2].set_sample_duration_nanos(1);
+  for (int i = 0; i < 100; i++) {
+    testAddColumns(&testCases[2], i * i - 50 * i, i % 7);
+  }
+  // Unsorted offsets and extreme values.
+  testCases[3].set_start_timestamp_nanos(0);
+  testCases[3].set_sample_duration_nanos(0);
+  testAddColumnsNoRollup(&testCases[3], std::numeric_limits<int32_t>::max(), 1);
+  testAddColumnsNoRollup(&testCases[3], std::numeric_limits<int32_t>::min(), 2);
+  testAddColumnsNoRollup(&testCases[3], 0, 3);
+  testCases[3].add_offset(7);
+  testCases[3].add_last(std::numeric_limits<double>::quiet_NaN());
+  testCases[3].add_offset(8);
+  testCases[3].add_last(-std::numeric_limits<double>::infinity());
+  testCases[3].add_offset(9);
+  testCases[3].add_last(-0.0);
+  testCases[3].add_offset(10);
+  testCases[3].add_last(0.1);
+  // A subset of the rollup columns.
+  testCases[4].set_start_timestamp_nanos(std::numeric_limits<int64_t>::max());
+  testCases[4].set_sample_duration_nanos(std::numeric_limits<int64_t>::min());
+  for (int i = 0; i < 10; i++) {
+    testAddColumnsNoRollup(&testCases[4], i * 3, i);
+    testCases[4].add_count(i * 2);
+    testCases[4].add_variance(i * 0.5);
+  }
+
+  for (const auto& data : testCases) {
+    std::string buf;
+    EXPECT_TRUE(EncodeCompressedTimeSeries(data, &buf));
+    roachpb::InternalTimeSeriesData decoded;
+    EXPECT_TRUE(DecodeCompressedTimeSeries(buf, &decoded));
+    EXPECT_EQ(data.SerializeAsString(), decoded.SerializeAsString());
+
+    // Any truncation of the encoding must be detected.
+    for (int i = 0; i < buf.size(); i++) {
+      EXPECT_FALSE(DecodeCompressedTimeSeries(rocksdb::Slice(buf.data(), i), &decoded));
+    }
+  }
+
+  // Regularly spaced, slowly changing samples should compress well.
+  std::string buf;
+  EXPECT_TRUE(EncodeCompressedTimeSeries(testCases[1], &buf));
+  EXPECT_LT(buf.size() * 4, testCases[1].ByteSize());
+}
+
+TEST(TimeSeriesCompressed, Unencodable) {
+  roachpb::InternalTimeSeriesData rows;
+  testAddRows(&rows, 1, 2);
+  roachpb::InternalTimeSeriesData mismatched;
+  testAddColumns(&mismatched, 1, 2);
+  mismatched.add_min(3);
+
+  for (const auto& data : {rows, mismatched}) {
+    std::string buf;
+    EXPECT_FALSE(EncodeCompressedTimeSeries(data, &buf));
+    EXPECT_TRUE(buf.empty());
+  }
+}
+
+TEST(TimeSeriesCompressed, Merge) {
+  roachpb::InternalTimeSeriesData left;
+  testAddColumnsNoRollup(&left, 1, 1);
+  testAddColumnsNoRollup(&left, 3, 3);
+  testAddColumnsNoRollup(&left, 5, 5);
+  roachpb::InternalTimeSeriesData right;
+  testAddColumnsNoRollup(&right, 4, 4);
+  testAddColumnsNoRollup(&right, 3, 33);
+  testAddColumnsNoRollup(&right, 2, 2);
+  roachpb::InternalTimeSeriesData expected;
+  testAddColumnsNoRollup(&expected, 1, 1);
+  testAddColumnsNoRollup(&expected, 2, 2);
+  testAddColumnsNoRollup(&expected, 3, 33);
+  testAddColumnsNoRollup(&expected, 4, 4);
+  testAddColumnsNoRollup(&expected, 5, 5);
+
+  const roachpb::ValueType tags[] = {roachpb::TIMESERIES, roachpb::TIMESERIES_COMPRESSED};
+  for (auto leftTag : tags) {
+    for (auto rightTag : tags) {
+      for (bool fullMerge : {true, false}) {
+        storage::engine::enginepb::MVCCMetadata meta;
+        meta.set_raw_bytes(testTimeSeriesValue(left, leftTag));
+        storage::engine::enginepb::MVCCMetadata operand;
+        operand.set_raw_bytes(testTimeSeriesValue(right, rightTag));
+        EXPECT_TRUE(MergeValues(&meta, operand, fullMerge, nullptr));
+        if (!fullMerge) {
+          // Partial merges only concatenate; consolidate with a full merge
+          // into an empty value.
+          storage::engine::enginepb::MVCCMetadata full;
+          EXPECT_TRUE(MergeValues(&full, meta, true, nullptr));
+          meta = full;
+        }
+
+        const auto wantTag = (leftTag == roachpb::TIMESERIES_COMPRESSED ||
+                              rightTag == roachpb::TIMESERIES_COMPRESSED)
+                                 ? roachpb::TIMESERIES_COMPRESSED
+                                 : roachpb::TIMESERIES;
+        EXPECT_EQ(testTimeSeriesValue(expected, wantTag), meta.raw_bytes());
+      }
+    }
+  }
+}
+
+// Merges reuse thread-local scratch messages. Check that nothing carries over
+// from one merge to the next, including after a merge large enough for the
+// scratch messages to be released.
+TEST(TimeSeriesMerge, Repeated) {
+  struct TestCase {
+    roachpb::InternalTimeSeriesData left;
+    roachpb::InternalTimeSeriesData right;
+    roachpb::InternalTimeSeriesData expected;
+  };
+  std::vector<TestCase> testCases(4);
+  for (auto& c : testCases) {
+    for (auto data : {&c.left, &c.right, &c.expected}) {
+      data->set_start_timestamp_nanos(1000);
+      data->set_sample_duration_nanos(10);
+    }
+  }
+
+  const int kLarge = 200000;
+  for (int i = 0; i < kLarge; i++) {
+    testAddColumnsNoRollup(i % 2 == 0 ? &testCases[0].left : &testCases[0].right, i, i);
+    testAddColumnsNoRollup(&testCases[0].expected, i, i);
+  }
+
+  testAddColumns(&testCases[1].left, 1, 1);
+  testAddColumns(&testCases[1].right, 2, 2);
+  testAddColumns(&testCases[1].expected, 1, 1);
+  testAddColumns(&testCases[1].expected, 2, 2);
+
+  testAddRows(&testCases[2].left, 1, 10);
+  testAddRows(&testCases[2].left, 3, 30);
+  testAddRows(&testCases[2].right, 3, 33);
+  testAddRows(&testCases[2].right, 2, 20);
+  testAddRows(&testCases[2].expected, 1, 10);
+  testAddRows(&testCases[2].expected, 2, 20);
+  testAddRows(&testCases[2].expected, 3, 33);
+
+  testAddColumnsNoRollup(&testCases[3].left, 7, 7);
+  testAddColumnsNoRollup(&testCases[3].right, 7, 77);
+  testAddColumnsNoRollup(&testCases[3].expected, 7, 77);
+
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < testCases.size(); i++) {
+      SCOPED_TRACE(testing::Message() << "round " << round << " case " << i);
+      const TestCase& c = testCases[i];
+      storage::engine::enginepb::MVCCMetadata meta;
+      meta.set_raw_bytes(testTimeSeriesValue(c.left, roachpb::TIMESERIES));
+      storage::engine::enginepb::MVCCMetadata operand;
+      operand.set_raw_bytes(testTimeSeriesValue(c.right, roachpb::TIMESERIES));
+      EXPECT_TRUE(MergeValues(&meta, operand, true, nullptr));
+      EXPECT_EQ(testTimeSeriesValue(c.expected, roachpb::TIMESERIES), meta.raw_bytes());
+    }
+  }
+}
+
+std::string testCounterValue(int64_t v) {
+  std::string val(5, 0);
+  val[4] = roachpb::COUNTER;
+  for (int i = 0; i < 8; i++) {
+    val.push_back(char(uint64_t(v) >> (8 * i)));
+  }
+  return val;
+}
+
+TEST(CounterMerge, Sum) {
+  const std::vector<int64_t> deltas = {5, -3, 100, std::numeric_limits<int64_t>::max(), 2};
+  for (bool fullMerge : {true, false}) {
+    storage::engine::enginepb::MVCCMetadata meta;
+    for (auto d : deltas) {
+      storage::engine::enginepb::MVCCMetadata operand;
+      operand.set_raw_bytes(testCounterValue(d));
+      EXPECT_TRUE(MergeValues(&meta, operand, fullMerge, nullptr));
+    }
+    // Overflow wraps around.
+    EXPECT_EQ(testCounterValue(std::numeric_limits<int64_t>::min() + 103), meta.raw_bytes());
+  }
+}
+
+TEST(CounterMerge, Invalid) {
+  storage::engine::enginepb::MVCCMetadata counter;
+  counter.set_raw_bytes(testCounterValue(1));
+  storage::engine::enginepb::MVCCMetadata bytes;
+  bytes.set_raw_bytes(std::string(5, 0) + "abc");
+  bytes.mutable_raw_bytes()->at(4) = roachpb::BYTES;
+  storage::engine::enginepb::MVCCMetadata truncated;
+  truncated.set_raw_bytes(testCounterValue(1).substr(0, 9));
+
+  {
+    auto meta = counter;
+    EXPECT_FALSE(MergeValues(&meta, bytes, true, nullptr));
+  }
+  {
+    auto meta = bytes;
+    EXPECT_FALSE(MergeValues(&meta, counter, true, nullptr));
+  }
+  {
+    auto meta = counter;
+    EXPECT_FALSE(MergeValues(&meta, truncated, false, nullptr));
+  }
+  {
+    storage::engine::enginepb::MVCCMetadata meta;
+    EXPECT_FALSE(MergeValues(&meta, truncated, true, nullptr));
+  }
+}
@@ -15,6 +15,7 @@
 #include "mvcc.h"
 #include "comparator.h"
 #include "encoding.h"
+#include "histogram.h"
 #include "keys.h"
 
 using namespace cockroach;
@@ -71,8 +72,8 @@ MVCCStatsResult MVCCComputeStatsInternal(::rocksdb::Iterator* const iter_rep, DB
   MVCCStatsResult stats;
   memset(&stats, 0, sizeof(stats));
 
-  iter_rep->Seek(EncodeKey(start));
-  const std::string end_key = EncodeKey(end);
+  iter_rep->Seek(EncodedKey(start));
+  const EncodedKey end_key(end);
 
   cockroach::storage::engine::enginepb::MVCCMetadata meta;
   std::string prev_key;
@@ -287,7 +288,8 @@ DBScanResults MVCCGet(DBIterator* iter, DBSlice key, DBTimestamp timestamp, DBTx
   // don't retrieve a key different than the start key. This is a bit
   // of a hack.
   const DBSlice end = {0, 0};
-  ScopedStats scoped_iter(iter);
+  ScopedLatency latency(kHistogramMVCCGet);
+  ScopedStats scoped_iter(iter, key);
   mvccForwardScanner scanner(iter, key, end, timestamp, 0 /* max_keys */, txn, consistent,
                              tombstones);
   return scanner.get();
@@ -296,7 +298,9 @@ DBScanResults MVCCGet(DBIterator* iter, DBSlice key, DBTimestamp timestamp, DBTx
 DBScanResults MVCCScan(DBIterator* iter, DBSlice start, DBSlice end, DBTimestamp timestamp,
                        int64_t max_keys, DBTxn txn, bool consistent, bool reverse,
                        bool tombstones) {
-  ScopedStats scoped_iter(iter);
+  ScopedLatency latency(kHistogramMVCCScan);
+  // Reverse scans start at the end key.
+  ScopedStats scoped_iter(iter, reverse ? end : start, reverse ? start : end);
   if (reverse) {
     mvccReverseScanner scanner(iter, end, start, timestamp, max_keys, txn, consistent, tombstones);
     return scanner.scan();
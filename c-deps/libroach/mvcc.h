@@ -105,7 +105,7 @@ template <bool reverse> class mvccScanner {
 
   const DBScanResults& get() {
     is_get_ = true;
-    if (!iterSeek(EncodeKey(start_key_, 0, 0))) {
+    if (!iterSeek(EncodedKey(start_key_, 0, 0))) {
       return results_;
     }
     if (cur_key_ == start_key_) {
@@ -124,7 +124,7 @@ template <bool reverse> class mvccScanner {
     // printf("seek %d: %s\n", int(micros), pctx->ToString(true).c_str());
 
     if (reverse) {
-      if (!iterSeekReverse(EncodeKey(start_key_, 0, 0))) {
+      if (!iterSeekReverse(EncodedKey(start_key_, 0, 0))) {
         return results_;
       }
       for (; cur_key_.compare(end_key_) >= 0;) {
@@ -133,7 +133,7 @@ template <bool reverse> class mvccScanner {
         }
       }
     } else {
-      if (!iterSeek(EncodeKey(start_key_, 0, 0))) {
+      if (!iterSeek(EncodedKey(start_key_, 0, 0))) {
         return results_;
       }
       for (; cur_key_.compare(end_key_) < 0;) {
@@ -204,21 +204,21 @@ template <bool reverse> class mvccScanner {
       return seekVersion(timestamp_, false);
     }
 
-    if (!meta_.ParseFromArray(cur_value_.data(), cur_value_.size())) {
+    if (!decodeMeta()) {
       return setStatus(FmtStatus("unable to decode MVCCMetadata"));
     }
 
-    if (meta_.has_raw_bytes()) {
+    if (meta_fields_.has_raw_bytes) {
       // 4. Emit immediately if the value is inline.
-      return addAndAdvance(meta_.raw_bytes());
+      return addAndAdvance(meta_fields_.raw_bytes);
     }
 
-    if (!meta_.has_txn()) {
+    if (!meta_fields_.has_txn) {
       return setStatus(FmtStatus("intent without transaction"));
     }
 
-    const bool own_intent = (meta_.txn().id() == txn_id_);
-    const DBTimestamp meta_timestamp = ToDBTimestamp(meta_.timestamp());
+    const bool own_intent = (meta_fields_.txn_id == txn_id_);
+    const DBTimestamp meta_timestamp = meta_fields_.timestamp;
     if (timestamp_ < meta_timestamp && !own_intent) {
       // 5. The key contains an intent, but we're reading before the
       // intent. Seek to the desired version. Note that if we own the
@@ -248,7 +248,7 @@ template <bool reverse> class mvccScanner {
         return false;
       }
       intents_->Put(cur_raw_key_, cur_value_);
-      return seekVersion(PrevTimestamp(ToDBTimestamp(meta_.timestamp())), false);
+      return seekVersion(PrevTimestamp(meta_timestamp), false);
     }
 
     if (!own_intent) {
@@ -261,7 +261,7 @@ template <bool reverse> class mvccScanner {
       return advanceKey();
     }
 
-    if (txn_epoch_ == meta_.txn().epoch()) {
+    if (txn_epoch_ == meta_fields_.txn_epoch) {
       // 8. We're reading our own txn's intent. Note that we read at
       // the intent timestamp, not at our read timestamp as the intent
       // timestamp may have been pushed forward by another
@@ -269,13 +269,13 @@ template <bool reverse> class mvccScanner {
       return seekVersion(meta_timestamp, false);
     }
 
-    if (txn_epoch_ < meta_.txn().epoch()) {
+    if (txn_epoch_ < meta_fields_.txn_epoch) {
       // 9. We're reading our own txn's intent but the current txn has
       // an earlier epoch than the intent. Return an error so that the
       // earlier incarnation of our transaction aborts (presumably
       // this is some operation that was retried).
       return setStatus(FmtStatus("failed to read with epoch %u due to a write intent with epoch %u",
-                                 txn_epoch_, meta_.txn().epoch()));
+                                 txn_epoch_, meta_fields_.txn_epoch));
     }
 
     // 10. We're reading our own txn's intent but the current txn has a
@@ -283,7 +283,29 @@ template <bool reverse> class mvccScanner {
     // restarted and an earlier iteration wrote the value we're now
     // reading. In this case, we ignore the intent and read the
     // previous value as if the transaction were starting fresh.
-    return seekVersion(PrevTimestamp(ToDBTimestamp(meta_.timestamp())), false);
+    return seekVersion(PrevTimestamp(meta_timestamp), false);
+  }
+
+  // decodeMeta decodes the MVCCMetadata in cur_value_ into
+  // meta_fields_. The fields the scanner needs are read directly from
+  // the wire format, avoiding the allocations performed by fully
+  // parsing the message (txn id, key, raw bytes), which matters for
+  // intent-heavy scans and inline values. Anything the fast path does
+  // not understand falls back to the protobuf parser.
+  bool decodeMeta() {
+    if (DecodeMVCCMetadataFields(cur_value_, &meta_fields_)) {
+      return true;
+    }
+    if (!meta_.ParseFromArray(cur_value_.data(), cur_value_.size())) {
+      return false;
+    }
+    meta_fields_.has_txn = meta_.has_txn();
+    meta_fields_.txn_id = meta_.txn().id();
+    meta_fields_.txn_epoch = meta_.txn().epoch();
+    meta_fields_.timestamp = ToDBTimestamp(meta_.timestamp());
+    meta_fields_.has_raw_bytes = meta_.has_raw_bytes();
+    meta_fields_.raw_bytes = meta_.raw_bytes();
+    return true;
   }
 
   // nextKey advances the iterator to point to the next MVCC key
@@ -466,7 +488,8 @@ template <bool reverse> class mvccScanner {
     }
 
     iters_before_seek_ = std::max<int>(1, iters_before_seek_ - 1);
-    if (!iterSeek(EncodeKey(key_buf_, desired_timestamp.wall_time, desired_timestamp.logical))) {
+    if (!iterSeek(
+            EncodedKey(key_buf_, desired_timestamp.wall_time, desired_timestamp.logical))) {
       return advanceKeyAtEnd();
     }
     if (cur_key_ != key_buf_) {
@@ -617,6 +640,10 @@ template <bool reverse> class mvccScanner {
   std::string saved_buf_;
   bool peeked_;
   bool is_get_;
+  // meta_fields_ holds the decoded MVCCMetadata of the current key. The
+  // slices point into either cur_value_ or, if the protobuf fallback
+  // was used, meta_.
+  MVCCMetadataFields meta_fields_;
   cockroach::storage::engine::enginepb::MVCCMetadata meta_;
   // cur_raw_key_ holds either iter_rep_->key() or the saved value of
   // iter_rep_->key() if we've peeked at the previous key (and peeked_
@@ -13,14 +13,20 @@
 // permissions and limitations under the License.
 
 #include "options.h"
+#include <algorithm>
 #include <rocksdb/filter_policy.h>
+#include <rocksdb/rate_limiter.h>
 #include <rocksdb/slice_transform.h>
 #include <rocksdb/table.h>
 #include "cache.h"
 #include "comparator.h"
 #include "encoding.h"
+#include "garbage.h"
+#include "gc_filter.h"
 #include "godefs.h"
 #include "merge.h"
+#include "rate_limiter.h"
+#include "timebound.h"
 
 namespace cockroach {
 
@@ -95,9 +101,11 @@ class TimeBoundTblPropCollector : public rocksdb::TablePropertiesCollector {
   const char* Name() const override { return "TimeBoundTblPropCollector"; }
 
   rocksdb::Status Finish(rocksdb::UserCollectedProperties* properties) override {
+    finishSegment();
     *properties = rocksdb::UserCollectedProperties{
         {"crdb.ts.min", ts_min_},
         {"crdb.ts.max", ts_max_},
+        {kTimeBoundSegmentsProperty, EncodeTimeBoundSegments(segments_)},
     };
     return rocksdb::Status::OK();
   }
@@ -105,15 +113,27 @@ class TimeBoundTblPropCollector : public rocksdb::TablePropertiesCollector {
   rocksdb::Status AddUserKey(const rocksdb::Slice& user_key, const rocksdb::Slice& value,
                              rocksdb::EntryType type, rocksdb::SequenceNumber seq,
                              uint64_t file_size) override {
-    rocksdb::Slice unused;
+    rocksdb::Slice key;
     rocksdb::Slice ts;
-    if (SplitKey(user_key, &unused, &ts) && !ts.empty()) {
-      ts.remove_prefix(1);  // The NUL prefix.
-      if (ts_max_.empty() || ts.compare(ts_max_) > 0) {
-        ts_max_.assign(ts.data(), ts.size());
+    if (!SplitKey(user_key, &key, &ts)) {
+      return rocksdb::Status::OK();
+    }
+    // Range deletions are added after all other keys and are not part of
+    // any segment.
+    if (type != rocksdb::kEntryRangeDeletion) {
+      addToSegment(key, ts, user_key.size() + value.size());
+    }
+    if (!ts.empty()) {
+      // Compare the timestamps with CompareTimestamps as they may use either
+      // logical format. The min and max are stored in the legacy format, which
+      // is what DBNewTimeBoundIter and DBGetUserProperties expect.
+      if (ts_max_.empty() || CompareTimestamps(ts, max_key_) > 0) {
+        max_key_.assign(ts.data(), ts.size());
+        ts_max_ = CanonicalTimestamp(ts);
       }
-      if (ts_min_.empty() || ts.compare(ts_min_) < 0) {
-        ts_min_.assign(ts.data(), ts.size());
+      if (ts_min_.empty() || CompareTimestamps(ts, min_key_) < 0) {
+        min_key_.assign(ts.data(), ts.size());
+        ts_min_ = CanonicalTimestamp(ts);
       }
     }
     return rocksdb::Status::OK();
@@ -124,8 +144,74 @@ class TimeBoundTblPropCollector : public rocksdb::TablePropertiesCollector {
   }
 
  private:
+  // addToSegment adds a key to the current segment, starting a new
+  // segment if the current one is full. Keys are added in order.
+  void addToSegment(const rocksdb::Slice& key, const rocksdb::Slice& ts, size_t size) {
+    if (segment_size_ > 0 && key != rocksdb::Slice(segment_.last_key)) {
+      if (segment_size_ >= kTimeBoundSegmentSize) {
+        finishSegment();
+      } else {
+        segment_.last_key.assign(key.data(), key.size());
+      }
+    }
+    if (segment_size_ == 0) {
+      segment_.first_key.assign(key.data(), key.size());
+      segment_.last_key.assign(key.data(), key.size());
+    }
+    if (!ts.empty()) {
+      if (segment_max_key_.empty() || CompareTimestamps(ts, segment_max_key_) > 0) {
+        segment_max_key_.assign(ts.data(), ts.size());
+      }
+      if (segment_min_key_.empty() || CompareTimestamps(ts, segment_min_key_) < 0) {
+        segment_min_key_.assign(ts.data(), ts.size());
+      }
+    }
+    segment_size_ += size;
+  }
+
+  void finishSegment() {
+    if (segment_size_ == 0) {
+      return;
+    }
+    if (!segment_min_key_.empty()) {
+      segment_.ts_min = CanonicalTimestamp(segment_min_key_);
+      segment_.ts_max = CanonicalTimestamp(segment_max_key_);
+    }
+    segments_.push_back(std::move(segment_));
+    segment_ = TimeBoundSegment();
+    segment_min_key_.clear();
+    segment_max_key_.clear();
+    segment_size_ = 0;
+  }
+
+  // CanonicalTimestamp converts an encoded timestamp including its NUL prefix
+  // into the legacy encoding without the prefix.
+  static std::string CanonicalTimestamp(const rocksdb::Slice& encoded) {
+    rocksdb::Slice ts(encoded.data() + 1, encoded.size() - 1);  // Skip the NUL prefix.
+    int64_t wall_time;
+    int32_t logical;
+    if (!DecodeTimestamp(&ts, &wall_time, &logical) || !ts.empty()) {
+      // Keep the original bytes; DBGetUserProperties will report the decoding
+      // error.
+      return rocksdb::Slice(encoded.data() + 1, encoded.size() - 1).ToString();
+    }
+    std::string s;
+    EncodeTimestamp(s, wall_time, logical);
+    return s;
+  }
+
   std::string ts_min_;
   std::string ts_max_;
+  // The encoded timestamps (as returned by SplitKey) of ts_min_ and ts_max_.
+  std::string min_key_;
+  std::string max_key_;
+
+  // The segments of the sstable and the state of the current segment.
+  std::vector<TimeBoundSegment> segments_;
+  TimeBoundSegment segment_;
+  std::string segment_min_key_;
+  std::string segment_max_key_;
+  size_t segment_size_ = 0;
 };
 
 class TimeBoundTblPropCollectorFactory : public rocksdb::TablePropertiesCollectorFactory {
@@ -193,6 +279,17 @@ rocksdb::Options DBMakeOptions(DBOptions db_opts) {
   std::shared_ptr<rocksdb::TablePropertiesCollectorFactory> time_bound_prop_collector(
       new TimeBoundTblPropCollectorFactory());
   options.table_properties_collector_factories.push_back(time_bound_prop_collector);
+  // Record the amount of garbage in each sstable and mark sstables
+  // with many deletions for compaction.
+  options.table_properties_collector_factories.emplace_back(NewGarbageTblPropCollectorFactory());
+  options.table_properties_collector_factories.push_back(NewGarbageCompactionCollectorFactory());
+
+  if (db_opts.gc_compaction_filter) {
+    // Drop MVCC versions below the GC thresholds set by
+    // DBSetGCThresholds during compactions. No compaction filter is
+    // used until thresholds are set.
+    options.compaction_filter_factory.reset(new GCCompactionFilterFactory());
+  }
 
   // The write buffer size is the size of the in memory structure that
   // will be flushed to create L0 files.
@@ -260,6 +357,44 @@ rocksdb::Options DBMakeOptions(DBOptions db_opts) {
   // few months of runtime without rolling based on the workload.
   options.max_manifest_file_size = 128 << 20;  // 128 MB
 
+  if (db_opts.rate_limit_bytes_per_sec > 0) {
+    // Background writes are paced so that large compactions do not
+    // saturate the disk and starve foreground reads. In auto-tuned
+    // mode the limiter starts well below rate_limit_bytes_per_sec and
+    // raises (or lowers) its rate depending on how often writers had
+    // to wait for budget, so the full bandwidth is only used when the
+    // backlog demands it. Flushes request I/O at high priority and are
+    // granted budget before compactions, which keeps write stalls
+    // caused by a full memtable rare. AutoTunedRateLimiter lets
+    // DBSetRateLimit change the maximum rate without tuning undoing it.
+    options.rate_limiter.reset(new AutoTunedRateLimiter(db_opts.rate_limit_bytes_per_sec,
+                                                        100 * 1000 /* refill_period_us */));
+  }
+
+  if (db_opts.tiered_compression) {
+    // Most of the data lives in the bottommost level and is rarely
+    // read, so it is worth compressing it as tightly as possible. The
+    // upper levels are frequently rewritten, so compression there is
+    // kept cheap (or skipped entirely for L0, which is small and
+    // rewritten soonest). With level_compaction_dynamic_level_bytes,
+    // compression_per_level[1] applies to the base level, which can be
+    // large, and the subsequent entries to the levels below it.
+    //
+    // RocksDB checks compression_per_level against the compression
+    // types it was built with, so DBOpen fails rather than silently
+    // writing uncompressed sstables if ZSTD is not linked in.
+    options.compression_per_level.assign(options.num_levels, rocksdb::kSnappyCompression);
+    options.compression_per_level[0] = rocksdb::kNoCompression;
+    options.compression_per_level[options.num_levels - 1] = rocksdb::kZSTD;
+    options.bottommost_compression = rocksdb::kZSTD;
+    // RocksDB only uses compression dictionaries for the bottommost
+    // level. Each sstable gets a dictionary trained by ZSTD on
+    // samples of its own data, which substantially improves the
+    // compression of our small, similar values.
+    options.compression_opts.max_dict_bytes = 16 << 10;         // 16 KB
+    options.compression_opts.zstd_max_train_bytes = 100 << 14;  // 100 * max_dict_bytes
+  }
+
   rocksdb::BlockBasedTableOptions table_options;
   if (db_opts.cache != nullptr) {
     table_options.block_cache = db_opts.cache->rep;
@@ -291,6 +426,25 @@ rocksdb::Options DBMakeOptions(DBOptions db_opts) {
   // the "whole key", doubling the size of our bloom filters. This is
   // used to speed up Get operations which we don't use.
   table_options.whole_key_filtering = false;
+
+  if (db_opts.partitioned_index_filters) {
+    // By default each open sstable holds its entire index and filter
+    // in memory, which on multi-TB stores adds up to many GB outside
+    // of the block cache (see rocksdb.estimate-table-readers-mem). A
+    // two-level index and partitioned filters split these blocks into
+    // metadata_block_size partitions which are loaded into the block
+    // cache on demand, while the small top-level index of each table
+    // remains pinned. Index and filter partitions are inserted with
+    // high priority so that they are evicted after data blocks when
+    // the cache has a high priority pool.
+    table_options.index_type = rocksdb::BlockBasedTableOptions::kTwoLevelIndexSearch;
+    table_options.partition_filters = true;
+    table_options.metadata_block_size = 4 << 10;  // 4 KB
+    table_options.cache_index_and_filter_blocks = true;
+    table_options.cache_index_and_filter_blocks_with_high_priority = true;
+    table_options.pin_top_level_index_and_filter = true;
+    table_options.pin_l0_filter_and_index_blocks_in_cache = false;
+  }
   options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
   return options;
 }
@@ -0,0 +1,85 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "rate_limiter.h"
+
+namespace cockroach {
+
+namespace {
+
+rocksdb::RateLimiter* newAutoTunedLimiter(int64_t max_bytes_per_sec, int64_t refill_period_us) {
+  return rocksdb::NewGenericRateLimiter(max_bytes_per_sec, refill_period_us, 10 /* fairness */,
+                                        rocksdb::RateLimiter::Mode::kWritesOnly,
+                                        true /* auto_tuned */);
+}
+
+}  // namespace
+
+AutoTunedRateLimiter::AutoTunedRateLimiter(int64_t max_bytes_per_sec, int64_t refill_period_us)
+    : rocksdb::RateLimiter(rocksdb::RateLimiter::Mode::kWritesOnly),
+      refill_period_us_(refill_period_us),
+      limiter_(newAutoTunedLimiter(max_bytes_per_sec, refill_period_us)),
+      max_bytes_per_sec_(max_bytes_per_sec),
+      retired_bytes_(),
+      retired_requests_() {}
+
+void AutoTunedRateLimiter::SetBytesPerSecond(int64_t max_bytes_per_sec) {
+  std::lock_guard<std::mutex> guard(mu_);
+  if (max_bytes_per_sec == max_bytes_per_sec_) {
+    return;
+  }
+  std::shared_ptr<rocksdb::RateLimiter> limiter(
+      newAutoTunedLimiter(max_bytes_per_sec, refill_period_us_));
+  std::shared_ptr<rocksdb::RateLimiter> old = std::atomic_exchange(&limiter_, limiter);
+  max_bytes_per_sec_ = max_bytes_per_sec;
+  // Requests which already loaded the old limiter may still add to its
+  // totals, which are then not reported.
+  for (int pri = rocksdb::Env::IO_LOW; pri <= rocksdb::Env::IO_TOTAL; pri++) {
+    const auto p = static_cast<rocksdb::Env::IOPriority>(pri);
+    retired_bytes_[pri] += old->GetTotalBytesThrough(p);
+    retired_requests_[pri] += old->GetTotalRequests(p);
+  }
+}
+
+int64_t AutoTunedRateLimiter::GetMaxBytesPerSecond() const {
+  std::lock_guard<std::mutex> guard(mu_);
+  return max_bytes_per_sec_;
+}
+
+void AutoTunedRateLimiter::Request(const int64_t bytes, const rocksdb::Env::IOPriority pri,
+                                   rocksdb::Statistics* stats) {
+  current()->Request(bytes, pri, stats);
+}
+
+int64_t AutoTunedRateLimiter::GetSingleBurstBytes() const {
+  return current()->GetSingleBurstBytes();
+}
+
+int64_t AutoTunedRateLimiter::GetTotalBytesThrough(const rocksdb::Env::IOPriority pri) const {
+  std::lock_guard<std::mutex> guard(mu_);
+  return retired_bytes_[pri] + limiter_->GetTotalBytesThrough(pri);
+}
+
+int64_t AutoTunedRateLimiter::GetTotalRequests(const rocksdb::Env::IOPriority pri) const {
+  std::lock_guard<std::mutex> guard(mu_);
+  return retired_requests_[pri] + limiter_->GetTotalRequests(pri);
+}
+
+int64_t AutoTunedRateLimiter::GetBytesPerSecond() const { return current()->GetBytesPerSecond(); }
+
+std::shared_ptr<rocksdb::RateLimiter> AutoTunedRateLimiter::current() const {
+  return std::atomic_load(&limiter_);
+}
+
+}  // namespace cockroach
@@ -0,0 +1,65 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <rocksdb/rate_limiter.h>
+
+namespace cockroach {
+
+// AutoTunedRateLimiter is an auto-tuned rate limiter whose maximum rate
+// can be changed at runtime. RocksDB's auto-tuned GenericRateLimiter
+// tunes its rate between 1/20th of and the maximum rate it was created
+// with, so calling SetBytesPerSecond on it only lasts until the next
+// tuning. AutoTunedRateLimiter instead swaps in a new auto-tuned
+// limiter whenever the maximum rate changes.
+class AutoTunedRateLimiter : public rocksdb::RateLimiter {
+ public:
+  AutoTunedRateLimiter(int64_t max_bytes_per_sec, int64_t refill_period_us);
+
+  // SetBytesPerSecond changes the maximum rate. The effective rate is
+  // tuned below it.
+  void SetBytesPerSecond(int64_t max_bytes_per_sec) override;
+  // GetMaxBytesPerSecond returns the maximum rate.
+  int64_t GetMaxBytesPerSecond() const;
+
+  using rocksdb::RateLimiter::Request;
+  void Request(const int64_t bytes, const rocksdb::Env::IOPriority pri,
+               rocksdb::Statistics* stats) override;
+  int64_t GetSingleBurstBytes() const override;
+  int64_t GetTotalBytesThrough(
+      const rocksdb::Env::IOPriority pri = rocksdb::Env::IO_TOTAL) const override;
+  int64_t GetTotalRequests(
+      const rocksdb::Env::IOPriority pri = rocksdb::Env::IO_TOTAL) const override;
+  // GetBytesPerSecond returns the current, tuned rate.
+  int64_t GetBytesPerSecond() const override;
+
+ private:
+  std::shared_ptr<rocksdb::RateLimiter> current() const;
+
+  const int64_t refill_period_us_;
+  // mu_ serializes changes of the maximum rate. Requests load limiter_
+  // atomically and do not take it.
+  mutable std::mutex mu_;
+  std::shared_ptr<rocksdb::RateLimiter> limiter_;
+  int64_t max_bytes_per_sec_;
+  // The totals of the limiters which were swapped out, indexed by
+  // IOPriority.
+  int64_t retired_bytes_[rocksdb::Env::IO_TOTAL + 1];
+  int64_t retired_requests_[rocksdb::Env::IO_TOTAL + 1];
+};
+
+}  // namespace cockroach
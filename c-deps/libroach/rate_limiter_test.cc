@@ -0,0 +1,63 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <gtest/gtest.h>
+#include "rate_limiter.h"
+
+using namespace cockroach;
+
+namespace {
+
+// saturate requests writes through limiter for the given duration,
+// which keeps the limiter drained and makes auto-tuning raise its rate.
+void saturate(rocksdb::RateLimiter* limiter, std::chrono::milliseconds duration) {
+  const auto end = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < end) {
+    limiter->Request(std::min<int64_t>(256, limiter->GetSingleBurstBytes()), rocksdb::Env::IO_LOW,
+                     nullptr);
+  }
+}
+
+}  // namespace
+
+TEST(AutoTunedRateLimiter, SetBytesPerSecond) {
+  // With a 1ms refill period the limiter is tuned every 100ms.
+  const int64_t kMaxRate = 64 << 20;
+  const int64_t kRate = 1 << 20;
+  AutoTunedRateLimiter limiter(kMaxRate, 1000 /* refill_period_us */);
+  EXPECT_EQ(kMaxRate, limiter.GetMaxBytesPerSecond());
+  EXPECT_LE(limiter.GetBytesPerSecond(), kMaxRate);
+
+  saturate(&limiter, std::chrono::milliseconds(50));
+  const int64_t bytes = limiter.GetTotalBytesThrough();
+  const int64_t requests = limiter.GetTotalRequests();
+  EXPECT_GT(bytes, 0);
+  EXPECT_GT(requests, 0);
+
+  // Lowering the maximum rate must survive tuning: a GenericRateLimiter
+  // would be tuned back up towards the maximum it was created with.
+  limiter.SetBytesPerSecond(kRate);
+  EXPECT_EQ(kRate, limiter.GetMaxBytesPerSecond());
+  EXPECT_LE(limiter.GetBytesPerSecond(), kRate);
+  saturate(&limiter, std::chrono::milliseconds(500));
+  EXPECT_GT(limiter.GetBytesPerSecond(), 0);
+  EXPECT_LE(limiter.GetBytesPerSecond(), kRate);
+
+  // The totals include the requests made through the replaced limiter.
+  EXPECT_GT(limiter.GetTotalBytesThrough(), bytes);
+  EXPECT_GT(limiter.GetTotalRequests(), requests);
+  EXPECT_GE(limiter.GetTotalBytesThrough(rocksdb::Env::IO_LOW), bytes);
+}
@@ -28,7 +28,8 @@ DBStatus DBSnapshot::Merge(DBKey key, DBSlice value) { return FmtStatus("unsuppo
 DBStatus DBSnapshot::Get(DBKey key, DBString* value) {
   rocksdb::ReadOptions read_opts;
   read_opts.snapshot = snapshot;
-  DBGetter base(rep, read_opts, EncodeKey(key));
+  const EncodedKey enc_key(key);
+  DBGetter base(rep, read_opts, enc_key);
   return base.Get(value);
 }
 
@@ -44,7 +45,7 @@ DBSlice DBSnapshot::BatchRepr() { return ToDBSlice("unsupported"); }
 
 DBIterator* DBSnapshot::NewIter(rocksdb::ReadOptions* read_opts) {
   read_opts->snapshot = snapshot;
-  DBIterator* iter = new DBIterator(iters);
+  DBIterator* iter = new DBIterator(iters, tombstone_compactor);
   iter->rep.reset(rep->NewIterator(*read_opts));
   return iter;
 }
@@ -55,6 +56,10 @@ DBString DBSnapshot::GetCompactionStats() { return ToDBString("unsupported"); }
 
 DBStatus DBSnapshot::GetEnvStats(DBEnvStatsResult* stats) { return FmtStatus("unsupported"); }
 
+DBStatus DBSnapshot::GetWriteStallStats(DBWriteStallStats* stats) {
+  return FmtStatus("unsupported");
+}
+
 DBStatus DBSnapshot::EnvWriteFile(DBSlice path, DBSlice contents) {
   return FmtStatus("unsupported");
 }
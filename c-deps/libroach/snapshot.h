@@ -23,7 +23,9 @@ namespace cockroach {
 struct DBSnapshot : public DBEngine {
   const rocksdb::Snapshot* snapshot;
 
-  DBSnapshot(DBEngine* db) : DBEngine(db->rep, db->iters), snapshot(db->rep->GetSnapshot()) {}
+  DBSnapshot(DBEngine* db)
+      : DBEngine(db->rep, db->iters, db->timebound_cache, db->tombstone_compactor),
+        snapshot(db->rep->GetSnapshot()) {}
   virtual ~DBSnapshot();
 
   virtual DBStatus Put(DBKey key, DBSlice value);
@@ -38,6 +40,7 @@ struct DBSnapshot : public DBEngine {
   virtual DBStatus GetStats(DBStatsResult* stats);
   virtual DBString GetCompactionStats();
   virtual DBStatus GetEnvStats(DBEnvStatsResult* stats);
+  virtual DBStatus GetWriteStallStats(DBWriteStallStats* stats);
   virtual DBStatus EnvWriteFile(DBSlice path, DBSlice contents);
   virtual DBStatus EnvOpenFile(DBSlice path, rocksdb::WritableFile** file);
   virtual DBStatus EnvReadFile(DBSlice path, DBSlice* contents);
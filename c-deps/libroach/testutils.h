@@ -31,6 +31,11 @@ inline DBOptions defaultDBOptions() {
       false,      // use_file_registry
       false,      // must_exist
       false,      // read_only
+      false,      // partitioned_index_filters
+      false,      // tiered_compression
+      0,          // rate_limit_bytes_per_sec
+      false,      // gc_compaction_filter
+      false,      // compact_tombstones
       DBSlice(),  // rocksdb_options
       DBSlice(),  // extra_options
   };
@@ -0,0 +1,602 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "timebound.h"
+#include <algorithm>
+#include <memory>
+#include "comparator.h"
+#include "encoding.h"
+
+namespace cockroach {
+
+namespace {
+
+// encodePrefixed appends s to buf, prefix compressed against prev.
+void encodePrefixed(std::string* buf, const rocksdb::Slice& prev, const rocksdb::Slice& s) {
+  const size_t shared = s.difference_offset(prev);
+  EncodeUvarint64(buf, shared);
+  EncodeUvarint64(buf, s.size() - shared);
+  buf->append(s.data() + shared, s.size() - shared);
+}
+
+bool decodePrefixed(rocksdb::Slice* buf, const std::string& prev, std::string* s) {
+  uint64_t shared, unshared;
+  if (!DecodeUvarint64(buf, &shared) || !DecodeUvarint64(buf, &unshared) ||
+      shared > prev.size() || unshared > buf->size()) {
+    return false;
+  }
+  s->assign(prev.data(), shared);
+  s->append(buf->data(), unshared);
+  buf->remove_prefix(unshared);
+  return true;
+}
+
+void encodeString(std::string* buf, const rocksdb::Slice& s) {
+  EncodeUvarint64(buf, s.size());
+  buf->append(s.data(), s.size());
+}
+
+bool decodeString(rocksdb::Slice* buf, std::string* s) {
+  uint64_t size;
+  if (!DecodeUvarint64(buf, &size) || size > buf->size()) {
+    return false;
+  }
+  s->assign(buf->data(), size);
+  buf->remove_prefix(size);
+  return true;
+}
+
+bool timestampLess(const DBTimestamp& a, const DBTimestamp& b) {
+  return a.wall_time < b.wall_time || (a.wall_time == b.wall_time && a.logical < b.logical);
+}
+
+// keySpan is a span of user keys. Both start and end are inclusive.
+struct keySpan {
+  std::string start;
+  std::string end;
+};
+
+// liveTable is an sstable which might contain keys with timestamps in
+// the range of a time-bound iterator.
+struct liveTable {
+  std::shared_ptr<const TimeBoundTable> bounds;
+  // The first and last user keys of the sstable.
+  std::string smallest;
+  std::string largest;
+};
+
+// liveSpans returns the sorted, disjoint spans of user keys of the
+// specified sstables which might contain keys with timestamps in
+// [min_ts, max_ts]. Only spans which end at or after lower and, if
+// upper is not null, start at or before *upper are returned.
+std::vector<keySpan> liveSpans(const std::vector<liveTable>& tables, const DBTimestamp& min_ts,
+                               const DBTimestamp& max_ts, const std::string& lower,
+                               const std::string* upper) {
+  std::vector<keySpan> spans;
+  auto add = [&](const std::string& start, const std::string& end) {
+    if (end >= lower && (upper == nullptr || start <= *upper)) {
+      spans.push_back(keySpan{start, end});
+    }
+  };
+  for (const auto& t : tables) {
+    if (t.largest < lower || (upper != nullptr && t.smallest > *upper)) {
+      continue;
+    }
+    if (!t.bounds->has_segments) {
+      // The sstable was written before segments were introduced.
+      add(t.smallest, t.largest);
+      continue;
+    }
+    for (const auto& seg : t.bounds->segments) {
+      if (seg.bounds.Overlaps(min_ts, max_ts)) {
+        add(seg.first_key, seg.last_key);
+      }
+    }
+  }
+
+  std::sort(spans.begin(), spans.end(),
+            [](const keySpan& a, const keySpan& b) { return a.start < b.start; });
+  size_t n = 0;
+  for (size_t i = 0; i < spans.size(); i++) {
+    keySpan& s = spans[i];
+    if (n > 0 && s.start <= spans[n - 1].end) {
+      if (s.end > spans[n - 1].end) {
+        spans[n - 1].end = std::move(s.end);
+      }
+      continue;
+    }
+    if (n != i) {
+      spans[n] = std::move(s);
+    }
+    n++;
+  }
+  spans.resize(n);
+  return spans;
+}
+
+// timeBoundIterator wraps an iterator over all keys of an engine and
+// seeks past keys which lie outside of the live spans of the engine's
+// sstables and are not present in memtable_iter, which iterates over
+// all keys that are not stored in sstables. The spans are computed
+// lazily, starting at the first key the iterator is positioned at, and
+// only up to the upper bound of the iterator.
+class timeBoundIterator : public rocksdb::Iterator {
+ public:
+  timeBoundIterator(rocksdb::Iterator* iter, rocksdb::Iterator* memtable_iter,
+                    std::vector<liveTable> tables, const DBTimestamp& min_ts,
+                    const DBTimestamp& max_ts, const rocksdb::Slice* upper)
+      : iter_(iter),
+        memtable_iter_(memtable_iter),
+        tables_(std::move(tables)),
+        min_ts_(min_ts),
+        max_ts_(max_ts),
+        has_upper_(upper != nullptr),
+        upper_(upper != nullptr ? upper->ToString() : ""),
+        have_spans_(false),
+        valid_(true) {}
+
+  bool Valid() const override { return valid_ && iter_->Valid(); }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    skipForward();
+  }
+  void SeekToLast() override {
+    valid_ = true;
+    iter_->SeekToLast();
+  }
+  void Seek(const rocksdb::Slice& target) override {
+    iter_->Seek(target);
+    skipForward();
+  }
+  void SeekForPrev(const rocksdb::Slice& target) override {
+    valid_ = true;
+    iter_->SeekForPrev(target);
+  }
+  void Next() override {
+    iter_->Next();
+    skipForward();
+  }
+  void Prev() override { iter_->Prev(); }
+  rocksdb::Slice key() const override { return iter_->key(); }
+  rocksdb::Slice value() const override { return iter_->value(); }
+  rocksdb::Status status() const override {
+    if (!memtable_iter_->status().ok()) {
+      return memtable_iter_->status();
+    }
+    return iter_->status();
+  }
+
+ private:
+  // skipForward seeks the iterator forward until it is positioned at a
+  // key within a live span or present in the memtables.
+  void skipForward() {
+    valid_ = true;
+    while (iter_->Valid()) {
+      rocksdb::Slice key, ts;
+      if (!SplitKey(iter_->key(), &key, &ts)) {
+        return;
+      }
+      if (!have_spans_ || key.compare(lower_) < 0) {
+        // The iterator was positioned for the first time or moved
+        // before the keys the spans were computed for.
+        lower_ = key.ToString();
+        spans_ = liveSpans(tables_, min_ts_, max_ts_, lower_, has_upper_ ? &upper_ : nullptr);
+        cur_ = spans_.end();
+        have_spans_ = true;
+      }
+      // Find the first span ending at or after key. Iteration mostly
+      // stays within the current span.
+      if (cur_ == spans_.end() || rocksdb::Slice(cur_->end).compare(key) < 0 ||
+          (cur_ != spans_.begin() && rocksdb::Slice((cur_ - 1)->end).compare(key) >= 0)) {
+        cur_ = std::lower_bound(spans_.begin(), spans_.end(), key,
+                                [](const keySpan& s, const rocksdb::Slice& k) {
+                                  return rocksdb::Slice(s.end).compare(k) < 0;
+                                });
+      }
+      if (cur_ != spans_.end() && rocksdb::Slice(cur_->start).compare(key) <= 0) {
+        return;
+      }
+
+      // The key lies before the next live span. Any keys up to that span
+      // only need to be visited if they are present in the memtables.
+      memtable_iter_->Seek(iter_->key());
+      if (memtable_iter_->Valid()) {
+        rocksdb::Slice memtable_key;
+        if (!SplitKey(memtable_iter_->key(), &memtable_key, &ts)) {
+          return;
+        }
+        if (cur_ == spans_.end() || memtable_key.compare(cur_->start) < 0) {
+          if (kComparator.Compare(memtable_iter_->key(), iter_->key()) <= 0) {
+            return;
+          }
+          seek_key_ = memtable_iter_->key().ToString();
+          iter_->Seek(seek_key_);
+          continue;
+        }
+      } else if (!memtable_iter_->status().ok()) {
+        return;
+      }
+      if (cur_ == spans_.end()) {
+        valid_ = false;
+        return;
+      }
+      seek_key_ = EncodeKey(cur_->start, 0, 0);
+      iter_->Seek(seek_key_);
+    }
+  }
+
+  std::unique_ptr<rocksdb::Iterator> iter_;
+  std::unique_ptr<rocksdb::Iterator> memtable_iter_;
+  const std::vector<liveTable> tables_;
+  const DBTimestamp min_ts_;
+  const DBTimestamp max_ts_;
+  // The user key of the iterator's upper bound, if it has one.
+  const bool has_upper_;
+  const std::string upper_;
+  // The spans of tables_ which end at or after lower_.
+  bool have_spans_;
+  std::string lower_;
+  std::vector<keySpan> spans_;
+  std::vector<keySpan>::const_iterator cur_;
+  std::string seek_key_;
+  bool valid_;
+};
+
+// liveTables sets tables to the sstables of db which might contain keys
+// with timestamps in [min_ts, max_ts], looking up their bounds in cache
+// and adding any sstables missing from it. If refresh is set, the
+// properties held by the table readers are added to cache even if the
+// bounds of every sstable are cached. pruned is set if some segment of
+// these sstables does not overlap the range, i.e. if the iterator can
+// skip more than a table filter does. Returns false if the bounds of
+// some sstable cannot be determined.
+bool liveTables(rocksdb::DB* db, TimeBoundCache* cache, bool refresh, const DBTimestamp& min_ts,
+                const DBTimestamp& max_ts, std::vector<liveTable>* tables, bool* pruned) {
+  std::vector<rocksdb::LiveFileMetaData> files;
+  db->GetLiveFilesMetaData(&files);
+  std::vector<std::shared_ptr<const TimeBoundTable>> bounds(files.size());
+  bool missing = false;
+  for (size_t i = 0; i < files.size(); i++) {
+    uint64_t number;
+    if (!ParseTableFileNumber(files[i].name, &number)) {
+      return false;
+    }
+    bounds[i] = cache->Get(number);
+    missing = missing || bounds[i] == nullptr;
+  }
+  if (missing || refresh) {
+    // The properties of the sstables whose table readers are open are
+    // the ones held by the readers.
+    rocksdb::TablePropertiesCollection props;
+    if (!db->GetPropertiesOfAllTables(&props).ok()) {
+      return false;
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+      const std::string path = files[i].db_path + files[i].name;
+      const auto p = props.find(path);
+      if (p == props.end()) {
+        if (bounds[i] == nullptr) {
+          return false;
+        }
+        continue;
+      }
+      bounds[i] = cache->AddReaderProperties(path, p->second);
+    }
+  }
+
+  *pruned = false;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (!bounds[i]->bounds.Overlaps(min_ts, max_ts)) {
+      continue;
+    }
+    *pruned = *pruned || bounds[i]->SegmentsPrunable(min_ts, max_ts);
+    rocksdb::Slice smallest, largest, ts;
+    if (!SplitKey(files[i].smallestkey, &smallest, &ts) ||
+        !SplitKey(files[i].largestkey, &largest, &ts)) {
+      return false;
+    }
+    tables->push_back(liveTable{std::move(bounds[i]), smallest.ToString(), largest.ToString()});
+  }
+  return true;
+}
+
+}  // namespace
+
+std::string EncodeTimeBoundSegments(const std::vector<TimeBoundSegment>& segments) {
+  std::string buf;
+  rocksdb::Slice prev;
+  for (const auto& seg : segments) {
+    encodePrefixed(&buf, prev, seg.first_key);
+    encodePrefixed(&buf, seg.first_key, seg.last_key);
+    encodeString(&buf, seg.ts_min);
+    encodeString(&buf, seg.ts_max);
+    prev = seg.last_key;
+  }
+  return buf;
+}
+
+bool DecodeTimeBoundSegments(rocksdb::Slice buf, std::vector<TimeBoundSegment>* segments) {
+  segments->clear();
+  std::string prev;
+  while (!buf.empty()) {
+    TimeBoundSegment seg;
+    if (!decodePrefixed(&buf, prev, &seg.first_key) ||
+        !decodePrefixed(&buf, seg.first_key, &seg.last_key) || !decodeString(&buf, &seg.ts_min) ||
+        !decodeString(&buf, &seg.ts_max)) {
+      return false;
+    }
+    prev = seg.last_key;
+    segments->push_back(std::move(seg));
+  }
+  return true;
+}
+
+bool TimeBoundOverlaps(const rocksdb::Slice& ts_min, const rocksdb::Slice& ts_max,
+                       const rocksdb::Slice& min, const rocksdb::Slice& max) {
+  if (ts_min.empty() || ts_max.empty()) {
+    return true;
+  }
+  return max.compare(ts_min) >= 0 && min.compare(ts_max) <= 0;
+}
+
+bool TimeBoundTableOverlaps(const rocksdb::UserCollectedProperties& props,
+                            const rocksdb::Slice& min, const rocksdb::Slice& max) {
+  auto tbl_min = props.find("crdb.ts.min");
+  if (tbl_min == props.end()) {
+    return true;
+  }
+  auto tbl_max = props.find("crdb.ts.max");
+  if (tbl_max == props.end()) {
+    return true;
+  }
+  return TimeBoundOverlaps(tbl_min->second, tbl_max->second, min, max);
+}
+
+void TimeBounds::Decode(const rocksdb::Slice& ts_min, const rocksdb::Slice& ts_max) {
+  known = false;
+  rocksdb::Slice min_buf(ts_min), max_buf(ts_max);
+  if (ts_min.empty() || ts_max.empty() ||
+      !DecodeTimestamp(&min_buf, &min.wall_time, &min.logical) || !min_buf.empty() ||
+      !DecodeTimestamp(&max_buf, &max.wall_time, &max.logical) || !max_buf.empty()) {
+    return;
+  }
+  known = true;
+}
+
+bool TimeBounds::Overlaps(const DBTimestamp& min_ts, const DBTimestamp& max_ts) const {
+  if (!known) {
+    return true;
+  }
+  return !timestampLess(max_ts, min) && !timestampLess(max, min_ts);
+}
+
+std::shared_ptr<const TimeBoundTable> DecodeTimeBoundTable(
+    const rocksdb::UserCollectedProperties& props) {
+  std::shared_ptr<TimeBoundTable> table(new TimeBoundTable);
+  auto tbl_min = props.find("crdb.ts.min");
+  auto tbl_max = props.find("crdb.ts.max");
+  if (tbl_min != props.end() && tbl_max != props.end()) {
+    table->bounds.Decode(tbl_min->second, tbl_max->second);
+  }
+  const auto s = props.find(kTimeBoundSegmentsProperty);
+  std::vector<TimeBoundSegment> segments;
+  if (s != props.end() && DecodeTimeBoundSegments(s->second, &segments)) {
+    table->has_segments = true;
+    table->segments.resize(segments.size());
+    for (size_t i = 0; i < segments.size(); i++) {
+      TimeBoundTable::Segment& seg = table->segments[i];
+      seg.first_key = std::move(segments[i].first_key);
+      seg.last_key = std::move(segments[i].last_key);
+      seg.bounds.Decode(segments[i].ts_min, segments[i].ts_max);
+      if (!seg.bounds.known) {
+        continue;
+      }
+      if (!table->has_segment_bounds || timestampLess(seg.bounds.max, table->min_segment_max)) {
+        table->min_segment_max = seg.bounds.max;
+      }
+      if (!table->has_segment_bounds || timestampLess(table->max_segment_min, seg.bounds.min)) {
+        table->max_segment_min = seg.bounds.min;
+      }
+      table->has_segment_bounds = true;
+    }
+  }
+  return table;
+}
+
+bool TimeBoundTable::SegmentsPrunable(const DBTimestamp& min_ts, const DBTimestamp& max_ts) const {
+  // A segment does not overlap the range if it ends before min_ts or
+  // starts after max_ts.
+  return bounds.Overlaps(min_ts, max_ts) && has_segment_bounds &&
+         (timestampLess(min_segment_max, min_ts) || timestampLess(max_ts, max_segment_min));
+}
+
+bool ParseTableFileNumber(const rocksdb::Slice& path, uint64_t* number) {
+  const rocksdb::Slice suffix(".sst");
+  if (path.size() < suffix.size() ||
+      rocksdb::Slice(path.data() + path.size() - suffix.size(), suffix.size()) != suffix) {
+    return false;
+  }
+  const char* end = path.data() + path.size() - suffix.size();
+  const char* start = end;
+  while (start > path.data() && start[-1] >= '0' && start[-1] <= '9') {
+    start--;
+  }
+  if (start == end || (start > path.data() && start[-1] != '/')) {
+    return false;
+  }
+  *number = 0;
+  for (const char* p = start; p < end; p++) {
+    *number = *number * 10 + (*p - '0');
+  }
+  return true;
+}
+
+void TimeBoundCache::Add(const std::string& path, const rocksdb::TableProperties& props) {
+  uint64_t number;
+  if (!ParseTableFileNumber(path, &number)) {
+    return;
+  }
+  auto table = DecodeTimeBoundTable(props.user_collected_properties);
+  std::lock_guard<std::mutex> guard(mu_);
+  entry& e = tables_[number];
+  if (e.props != nullptr) {
+    by_props_.erase(e.props.get());
+    e.props.reset();
+  }
+  e.bounds = std::move(table);
+}
+
+std::shared_ptr<const TimeBoundTable> TimeBoundCache::AddReaderProperties(
+    const std::string& path, const std::shared_ptr<const rocksdb::TableProperties>& props) {
+  uint64_t number;
+  if (!ParseTableFileNumber(path, &number)) {
+    return DecodeTimeBoundTable(props->user_collected_properties);
+  }
+  std::unique_lock<std::mutex> guard(mu_);
+  auto it = tables_.find(number);
+  if (it == tables_.end()) {
+    guard.unlock();
+    auto table = DecodeTimeBoundTable(props->user_collected_properties);
+    guard.lock();
+    it = tables_.insert({number, entry{std::move(table), nullptr}}).first;
+  }
+  entry& e = it->second;
+  if (e.props != props) {
+    if (e.props != nullptr) {
+      by_props_.erase(e.props.get());
+    }
+    e.props = props;
+    by_props_[props.get()] = e.bounds;
+  }
+  return e.bounds;
+}
+
+void TimeBoundCache::Remove(const std::string& path) {
+  uint64_t number;
+  if (!ParseTableFileNumber(path, &number)) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(mu_);
+  const auto it = tables_.find(number);
+  if (it == tables_.end()) {
+    return;
+  }
+  if (it->second.props != nullptr) {
+    by_props_.erase(it->second.props.get());
+  }
+  tables_.erase(it);
+}
+
+std::shared_ptr<const TimeBoundTable> TimeBoundCache::Get(uint64_t number) const {
+  std::lock_guard<std::mutex> guard(mu_);
+  const auto it = tables_.find(number);
+  if (it == tables_.end()) {
+    return nullptr;
+  }
+  return it->second.bounds;
+}
+
+std::shared_ptr<const TimeBoundTable> TimeBoundCache::Get(const rocksdb::TableProperties& props) {
+  std::lock_guard<std::mutex> guard(mu_);
+  const auto it = by_props_.find(&props);
+  if (it == by_props_.end()) {
+    stale_ = true;
+    return nullptr;
+  }
+  return it->second;
+}
+
+bool TimeBoundCache::TakeStale() {
+  std::lock_guard<std::mutex> guard(mu_);
+  const bool stale = stale_;
+  stale_ = false;
+  return stale;
+}
+
+bool TimeBoundCache::SegmentsPrunable(const DBTimestamp& min_ts, const DBTimestamp& max_ts) const {
+  std::lock_guard<std::mutex> guard(mu_);
+  for (const auto& t : tables_) {
+    if (t.second.bounds->SegmentsPrunable(min_ts, max_ts)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t TimeBoundCache::Size() const {
+  std::lock_guard<std::mutex> guard(mu_);
+  return tables_.size();
+}
+
+rocksdb::Iterator* NewTimeBoundIterator(
+    rocksdb::DB* db, TimeBoundCache* cache,
+    const std::function<rocksdb::Iterator*(rocksdb::ReadOptions*)>& new_iter,
+    const rocksdb::ReadOptions& read_opts, const DBTimestamp& min_ts, const DBTimestamp& max_ts) {
+  // The spans to visit must be computed from exactly the sstables the
+  // iterator reads. The superversion number changes whenever the set
+  // of sstables or memtables changes: if it is the same before the
+  // sstables are listed and after the iterators are created, the
+  // iterators read the listed sstables. Otherwise a flush or compaction
+  // finished in the meantime and we fall back to visiting every key.
+  //
+  // Listing the sstables is only worthwhile if some segment can be
+  // skipped. The cache holds every live sstable unless it is stale
+  // (e.g. some sstable was ingested), in which case the sstables are
+  // listed to refresh it.
+  const rocksdb::Slice kSuperVersionNumber("rocksdb.current-super-version-number");
+  rocksdb::ReadOptions opts = read_opts;
+  const bool refresh = cache->TakeStale();
+  uint64_t version = 0;
+  std::vector<liveTable> tables;
+  bool pruned = false;
+  if ((!refresh && !cache->SegmentsPrunable(min_ts, max_ts)) ||
+      !db->GetIntProperty(kSuperVersionNumber, &version) ||
+      !liveTables(db, cache, refresh, min_ts, max_ts, &tables, &pruned) || !pruned) {
+    // Unless some segment can be skipped, read_opts.table_filter already
+    // skips everything that can be skipped.
+    return new_iter(&opts);
+  }
+
+  // Both iterators read at the same sequence number so that the
+  // memtable iterator sees every memtable key the main iterator sees.
+  // The memtable iterator is created like the main iterator, but
+  // excludes all sstables.
+  const rocksdb::Snapshot* snapshot = nullptr;
+  if (opts.snapshot == nullptr) {
+    snapshot = db->GetSnapshot();
+    opts.snapshot = snapshot;
+  }
+  rocksdb::ReadOptions memtable_opts = opts;
+  memtable_opts.table_filter = [](const rocksdb::TableProperties&) { return false; };
+  std::unique_ptr<rocksdb::Iterator> iter(new_iter(&opts));
+  std::unique_ptr<rocksdb::Iterator> memtable_iter(new_iter(&memtable_opts));
+  if (snapshot != nullptr) {
+    db->ReleaseSnapshot(snapshot);
+  }
+  if (iter == nullptr || memtable_iter == nullptr) {
+    return iter.release();
+  }
+
+  uint64_t version_after;
+  if (!db->GetIntProperty(kSuperVersionNumber, &version_after) || version != version_after) {
+    return iter.release();
+  }
+  rocksdb::Slice upper, ts;
+  const bool has_upper = opts.iterate_upper_bound != nullptr &&
+                         SplitKey(*opts.iterate_upper_bound, &upper, &ts);
+  return new timeBoundIterator(iter.release(), memtable_iter.release(), std::move(tables),
+                               min_ts, max_ts, has_upper ? &upper : nullptr);
+}
+
+}  // namespace cockroach
@@ -0,0 +1,202 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <functional>
+#include <libroach.h>
+#include <memory>
+#include <mutex>
+#include <rocksdb/db.h>
+#include <rocksdb/iterator.h>
+#include <rocksdb/table_properties.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "defines.h"
+
+namespace cockroach {
+
+// Every sstable records the minimum and maximum MVCC timestamps of its
+// keys in the crdb.ts.min and crdb.ts.max user properties, which lets
+// time-bound iterators skip sstables that cannot contain keys in their
+// time range. Sstables are usually large, so a single recent write
+// prevents an sstable from being skipped. To allow skipping parts of
+// sstables, the keys of each sstable are also divided into segments of
+// about kTimeBoundSegmentSize bytes (32 data blocks) and the user key
+// and timestamp bounds of each segment are stored in the
+// crdb.ts.segments property.
+const char* const kTimeBoundSegmentsProperty = "crdb.ts.segments";
+const size_t kTimeBoundSegmentSize = 1 << 20;  // 1 MB
+
+// TimeBoundSegment describes a segment of an sstable. Segments never
+// split the versions of a user key across segments.
+struct TimeBoundSegment {
+  // The first and last user keys (without timestamps) in the segment.
+  std::string first_key;
+  std::string last_key;
+  // The minimum and maximum timestamps of the segment's keys in the
+  // legacy encoding used by crdb.ts.min and crdb.ts.max, or empty if
+  // the segment does not contain any versioned keys.
+  std::string ts_min;
+  std::string ts_max;
+};
+
+// EncodeTimeBoundSegments encodes a sorted list of segments into the
+// value of the crdb.ts.segments property. Each key is prefix
+// compressed against the previous key.
+std::string EncodeTimeBoundSegments(const std::vector<TimeBoundSegment>& segments);
+
+// DecodeTimeBoundSegments decodes the value of the crdb.ts.segments
+// property. Returns false if buf is malformed.
+WARN_UNUSED_RESULT bool DecodeTimeBoundSegments(rocksdb::Slice buf,
+                                                std::vector<TimeBoundSegment>* segments);
+
+// TimeBoundOverlaps returns true if the timestamp range [ts_min, ts_max]
+// overlaps [min, max]. All timestamps are in the legacy encoding. An
+// empty range is considered to overlap everything.
+bool TimeBoundOverlaps(const rocksdb::Slice& ts_min, const rocksdb::Slice& ts_max,
+                       const rocksdb::Slice& min, const rocksdb::Slice& max);
+
+// TimeBoundTableOverlaps returns true if the sstable with the specified
+// user properties might contain keys with timestamps in [min, max].
+bool TimeBoundTableOverlaps(const rocksdb::UserCollectedProperties& props,
+                            const rocksdb::Slice& min, const rocksdb::Slice& max);
+
+// TimeBounds is a decoded timestamp range [min, max].
+struct TimeBounds {
+  // Whether the bounds are known. Unknown bounds overlap every range.
+  bool known = false;
+  DBTimestamp min = {};
+  DBTimestamp max = {};
+
+  // Decode sets the bounds from legacy encoded timestamps. The bounds
+  // are left unknown if either timestamp is empty or malformed.
+  void Decode(const rocksdb::Slice& ts_min, const rocksdb::Slice& ts_max);
+  // Overlaps returns true if the bounds might overlap [min_ts, max_ts].
+  bool Overlaps(const DBTimestamp& min_ts, const DBTimestamp& max_ts) const;
+};
+
+// TimeBoundTable holds the decoded timestamp bounds of an sstable and
+// of its segments.
+struct TimeBoundTable {
+  struct Segment {
+    std::string first_key;
+    std::string last_key;
+    TimeBounds bounds;
+  };
+
+  TimeBounds bounds;
+  // Whether the sstable has a crdb.ts.segments property.
+  bool has_segments = false;
+  std::vector<Segment> segments;
+  // The smallest maximum and the largest minimum timestamp of the
+  // segments with known bounds, if there are any.
+  bool has_segment_bounds = false;
+  DBTimestamp min_segment_max = {};
+  DBTimestamp max_segment_min = {};
+
+  // SegmentsPrunable returns true if the sstable might contain keys
+  // with timestamps in [min_ts, max_ts] but some of its segments
+  // cannot, without looking at every segment.
+  bool SegmentsPrunable(const DBTimestamp& min_ts, const DBTimestamp& max_ts) const;
+};
+
+// DecodeTimeBoundTable decodes the timestamp bounds from the user
+// properties of an sstable.
+std::shared_ptr<const TimeBoundTable> DecodeTimeBoundTable(
+    const rocksdb::UserCollectedProperties& props);
+
+// ParseTableFileNumber extracts the file number from the path of an
+// sstable (e.g. "/path/to/000123.sst"). Returns false if path does not
+// name an sstable.
+WARN_UNUSED_RESULT bool ParseTableFileNumber(const rocksdb::Slice& path, uint64_t* number);
+
+// TimeBoundCache caches the decoded timestamp bounds of sstables by
+// file number, so that time-bound iterators do not need to fetch and
+// decode the properties of every sstable whenever they are
+// created. DBEventListener adds the sstables created by flushes and
+// compactions and removes deleted sstables. Other sstables (e.g. those
+// present when the DB was opened or ingested sstables) are added when
+// they are first needed.
+//
+// RocksDB does not pass the file number to table filters, so the
+// bounds are also cached by the address of the TableProperties held by
+// the table reader of each sstable. The cache holds a reference to
+// these properties so that their address is not reused for the
+// properties of another sstable.
+class TimeBoundCache {
+ public:
+  // Add decodes and caches the bounds of the sstable at path.
+  void Add(const std::string& path, const rocksdb::TableProperties& props);
+  // AddReaderProperties caches the bounds of the sstable at path by the
+  // address of props, which should be held by the sstable's table
+  // reader, and returns them. The bounds are decoded unless they are
+  // already cached.
+  std::shared_ptr<const TimeBoundTable> AddReaderProperties(
+      const std::string& path, const std::shared_ptr<const rocksdb::TableProperties>& props);
+  // Remove drops the sstable at path from the cache.
+  void Remove(const std::string& path);
+  // Get returns the bounds of the specified sstable or nullptr if they
+  // are not cached.
+  std::shared_ptr<const TimeBoundTable> Get(uint64_t number) const;
+  // Get returns the bounds of the sstable whose table reader holds
+  // props or nullptr if they are not cached by its address. A miss
+  // marks the cache as stale.
+  std::shared_ptr<const TimeBoundTable> Get(const rocksdb::TableProperties& props);
+  // TakeStale returns whether the cache is stale, i.e. whether Get(props)
+  // missed since the last call, and clears the flag. A new cache is
+  // stale.
+  bool TakeStale();
+  // SegmentsPrunable returns true if some cached sstable has segments
+  // which can be skipped by a time-bound iterator over [min_ts, max_ts].
+  bool SegmentsPrunable(const DBTimestamp& min_ts, const DBTimestamp& max_ts) const;
+  // Size returns the number of cached sstables.
+  size_t Size() const;
+
+ private:
+  struct entry {
+    std::shared_ptr<const TimeBoundTable> bounds;
+    // The properties held by the sstable's table reader, if known.
+    std::shared_ptr<const rocksdb::TableProperties> props;
+  };
+
+  mutable std::mutex mu_;
+  std::unordered_map<uint64_t, entry> tables_;
+  std::unordered_map<const rocksdb::TableProperties*, std::shared_ptr<const TimeBoundTable>>
+      by_props_;
+  bool stale_ = true;
+};
+
+// NewTimeBoundIterator returns an iterator created by new_iter which,
+// when moving forward, skips the segments of db's sstables that cannot
+// contain keys with timestamps in [min_ts, max_ts]. read_opts should
+// include a table_filter which skips entire sstables accordingly. Keys
+// outside of the sstables (e.g. in memtables or in a batch included by
+// new_iter) are never skipped. Keys with timestamps outside of the
+// range may still be returned, but no key within the range is
+// skipped. Reverse iteration does not skip anything. Only the parts of
+// the sstables at or after the first key the iterator is positioned at
+// and before read_opts.iterate_upper_bound are considered. If no
+// segment of the sstables can be skipped, the iterator created by
+// new_iter is returned as is. The bounds of the sstables are looked up
+// in cache and the sstables are only listed if cache is stale or some
+// cached sstable has segments which can be skipped. Returns nullptr if
+// new_iter does.
+rocksdb::Iterator* NewTimeBoundIterator(
+    rocksdb::DB* db, TimeBoundCache* cache,
+    const std::function<rocksdb::Iterator*(rocksdb::ReadOptions*)>& new_iter,
+    const rocksdb::ReadOptions& read_opts, const DBTimestamp& min_ts, const DBTimestamp& max_ts);
+
+}  // namespace cockroach
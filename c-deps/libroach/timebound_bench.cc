@@ -0,0 +1,99 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <string>
+#include "db.h"
+#include "encoding.h"
+#include "include/libroach.h"
+#include "testutils.h"
+
+using namespace cockroach;
+using namespace testutils;
+
+namespace {
+
+// Each sstable holds a few segments.
+const int kTables = 40;
+const int kKeysPerTable = 16000;
+
+std::string makeKey(int table, int i) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%06d/%06d", table, i);
+  return buf;
+}
+
+// timeScans reports the time per call of new_iter followed by a seek
+// into a random sstable and a short scan.
+void timeScans(const char* name, DBEngine* db, const std::function<DBIterator*()>& new_iter) {
+  const int kIters = 2000;
+  const int kScanKeys = 10;
+  int64_t keys = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIters; i++) {
+    const std::string key = makeKey((i * 7919) % kTables, 0);
+    DBIterator* iter = new_iter();
+    DBIterState state = DBIterSeek(iter, DBKey{ToDBSlice(key), 0, 0});
+    for (int j = 0; state.valid && j < kScanKeys; j++) {
+      keys++;
+      state = DBIterNext(iter, false /* skip_current_key_versions */);
+    }
+    DBIterDestroy(iter);
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  printf("  %-24s %8.1f us/op (%lld keys)\n", name,
+         std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / 1e3 / kIters,
+         (long long)keys);
+}
+
+}  // namespace
+
+// Times the creation of time-bound iterators and short scans with them
+// on an engine with many sstables, of which only a few segments hold
+// recent keys. A regular iterator is the baseline.
+int main() {
+  DBOptions db_opts = defaultDBOptions();
+  db_opts.rocksdb_options = ToDBSlice("disable_auto_compactions=true");
+  DBEngine* db;
+  DBStatus status = DBOpen(&db, DBSlice(), db_opts);
+  if (status.data != NULL) {
+    fprintf(stderr, "unable to open engine: %s\n", ToString(status).c_str());
+    return 1;
+  }
+
+  const std::string value(128, 'v');
+  for (int t = 0; t < kTables; t++) {
+    for (int i = 0; i < kKeysPerTable; i++) {
+      // Every tenth sstable has a recent version at its end.
+      const int64_t wall_time = (t % 10 == 0 && i == kKeysPerTable - 1) ? 100 : 1;
+      const std::string key = makeKey(t, i);
+      DBPut(db, DBKey{ToDBSlice(key), wall_time, 0}, ToDBSlice(value));
+    }
+    DBFlush(db);
+  }
+
+  printf("%d sstables of %d keys:\n", kTables, kKeysPerTable);
+  timeScans("DBNewIter", db, [db]() { return DBNewIter(db, false /* prefix */, false); });
+  timeScans("DBNewTimeBoundIter", db, [db]() {
+    return DBNewTimeBoundIter(db, DBTimestamp{50, 0}, DBTimestamp{150, 0}, false);
+  });
+  timeScans("DBNewTimeBoundIter/all", db, [db]() {
+    return DBNewTimeBoundIter(db, DBTimestamp{0, 0}, DBTimestamp{150, 0}, false);
+  });
+
+  DBClose(db);
+  return 0;
+}
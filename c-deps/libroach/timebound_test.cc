@@ -0,0 +1,261 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <set>
+#include <string>
+#include <vector>
+#include "db.h"
+#include "encoding.h"
+#include "engine.h"
+#include "include/libroach.h"
+#include "testutils.h"
+#include "timebound.h"
+
+using namespace cockroach;
+using namespace testutils;
+
+namespace {
+
+std::string timestamp(int64_t wall_time) {
+  std::string s;
+  EncodeTimestamp(s, wall_time, 0);
+  return s;
+}
+
+}  // namespace
+
+TEST(Libroach, TimeBoundSegmentsEncoding) {
+  std::vector<TimeBoundSegment> segments = {
+      {"a", "abc", timestamp(1), timestamp(5)},
+      {"abd", "abd", "", ""},
+      {std::string("b\x00", 2), "b\xff\xff", timestamp(2), timestamp(2)},
+      {"c", "d", timestamp(3), timestamp(4)},
+  };
+  const std::string buf = EncodeTimeBoundSegments(segments);
+
+  std::vector<TimeBoundSegment> decoded;
+  EXPECT_TRUE(DecodeTimeBoundSegments(buf, &decoded));
+  ASSERT_EQ(segments.size(), decoded.size());
+  for (size_t i = 0; i < segments.size(); i++) {
+    EXPECT_EQ(segments[i].first_key, decoded[i].first_key);
+    EXPECT_EQ(segments[i].last_key, decoded[i].last_key);
+    EXPECT_EQ(segments[i].ts_min, decoded[i].ts_min);
+    EXPECT_EQ(segments[i].ts_max, decoded[i].ts_max);
+  }
+
+  EXPECT_TRUE(DecodeTimeBoundSegments("", &decoded));
+  EXPECT_EQ(0, decoded.size());
+  // Truncated values either fail to decode or decode to fewer segments.
+  for (size_t i = 1; i < buf.size(); i++) {
+    if (DecodeTimeBoundSegments(rocksdb::Slice(buf.data(), i), &decoded)) {
+      EXPECT_LT(decoded.size(), segments.size()) << i;
+    }
+  }
+}
+
+TEST(Libroach, DBTimeBoundIterSegments) {
+  DBOptions db_opts = defaultDBOptions();
+  DBEngine* db;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+
+  const std::string value(1 << 10, 'v');
+  auto put = [&](const char* prefix, int i, int64_t wall_time) {
+    const std::string key = prefix + std::to_string(10000 + i);
+    DBKey k = {ToDBSlice(key), wall_time, 0};
+    EXPECT_STREQ(DBPut(db, k, ToDBSlice(value)).data, NULL);
+  };
+
+  // Write several MB of old versions around a few recent versions into a
+  // single sstable, which is split into many segments.
+  const int kOldKeys = 4096;
+  const int kRecentKeys = 10;
+  for (int i = 0; i < kOldKeys; i++) {
+    put("a", i, 1);
+    put("c", i, 1);
+  }
+  for (int i = 0; i < kRecentKeys; i++) {
+    put("b", i, 100);
+  }
+  EXPECT_STREQ(DBFlush(db).data, NULL);
+  // Recent versions in the memtable are never skipped.
+  put("a", 17, 100);
+  put("c", 4000, 100);
+
+  auto scan = [&](int64_t min_wall_time, int64_t max_wall_time, std::set<std::string>* recent) {
+    DBIterator* iter = DBNewTimeBoundIter(db, DBTimestamp{min_wall_time, 0},
+                                          DBTimestamp{max_wall_time, 0}, false /* with_stats */);
+    int keys = 0;
+    for (DBIterState state = DBIterSeekToFirst(iter); state.valid;
+         state = DBIterNext(iter, false /* skip_current_key_versions */)) {
+      keys++;
+      if (state.key.wall_time >= min_wall_time && state.key.wall_time <= max_wall_time) {
+        recent->insert(ToString(state.key.key));
+      }
+    }
+    DBIterDestroy(iter);
+    return keys;
+  };
+
+  std::set<std::string> all;
+  EXPECT_EQ(2 * kOldKeys + kRecentKeys + 2, scan(0, 200, &all));
+  EXPECT_EQ(2 * kOldKeys + kRecentKeys, all.size());
+
+  // Only the segments holding the recent keys are read. A segment holds
+  // about 1000 keys.
+  std::set<std::string> recent;
+  EXPECT_LT(scan(50, 150, &recent), 2500);
+  std::set<std::string> expected = {"a10017", "c14000"};
+  for (int i = 0; i < kRecentKeys; i++) {
+    expected.insert("b" + std::to_string(10000 + i));
+  }
+  EXPECT_EQ(expected, recent);
+
+  // Seeking backwards past the first key the iterator was positioned
+  // at does not skip the recent keys before it.
+  DBIterator* iter =
+      DBNewTimeBoundIter(db, DBTimestamp{50, 0}, DBTimestamp{150, 0}, false /* with_stats */);
+  DBIterState state = DBIterSeek(iter, DBKey{ToDBSlice("c"), 0, 0});
+  ASSERT_TRUE(state.valid);
+  EXPECT_EQ("c14000", ToString(state.key.key));
+  recent.clear();
+  for (state = DBIterSeek(iter, DBKey{ToDBSlice("a"), 0, 0}); state.valid;
+       state = DBIterNext(iter, false /* skip_current_key_versions */)) {
+    if (state.key.wall_time >= 50) {
+      recent.insert(ToString(state.key.key));
+    }
+  }
+  EXPECT_EQ(expected, recent);
+  DBIterDestroy(iter);
+
+  DBClose(db);
+}
+
+TEST(Libroach, TimeBoundCache) {
+  uint64_t number;
+  EXPECT_TRUE(ParseTableFileNumber("/path/to/000123.sst", &number));
+  EXPECT_EQ(123, number);
+  EXPECT_TRUE(ParseTableFileNumber("7.sst", &number));
+  EXPECT_EQ(7, number);
+  EXPECT_FALSE(ParseTableFileNumber("/path/to/000123.log", &number));
+  EXPECT_FALSE(ParseTableFileNumber("/path/to/.sst", &number));
+  EXPECT_FALSE(ParseTableFileNumber("/path/to/x123.sst", &number));
+
+  rocksdb::TableProperties props;
+  props.user_collected_properties["crdb.ts.min"] = timestamp(10);
+  props.user_collected_properties["crdb.ts.max"] = timestamp(20);
+  props.user_collected_properties[kTimeBoundSegmentsProperty] = EncodeTimeBoundSegments({
+      {"a", "b", timestamp(10), timestamp(12)}, {"c", "d", "", ""},
+  });
+
+  TimeBoundCache cache;
+  EXPECT_EQ(nullptr, cache.Get(123));
+  cache.Add("/path/to/000123.sst", props);
+  auto table = cache.Get(123);
+  ASSERT_NE(nullptr, table);
+  EXPECT_EQ(1, cache.Size());
+
+  EXPECT_TRUE(table->bounds.known);
+  EXPECT_TRUE(table->bounds.Overlaps(DBTimestamp{20, 0}, DBTimestamp{30, 0}));
+  EXPECT_TRUE(table->bounds.Overlaps(DBTimestamp{0, 0}, DBTimestamp{10, 0}));
+  EXPECT_FALSE(table->bounds.Overlaps(DBTimestamp{20, 1}, DBTimestamp{30, 0}));
+  EXPECT_FALSE(table->bounds.Overlaps(DBTimestamp{0, 0}, DBTimestamp{9, 5}));
+
+  ASSERT_TRUE(table->has_segments);
+  ASSERT_EQ(2, table->segments.size());
+  EXPECT_EQ("a", table->segments[0].first_key);
+  EXPECT_EQ("b", table->segments[0].last_key);
+  EXPECT_FALSE(table->segments[0].bounds.Overlaps(DBTimestamp{15, 0}, DBTimestamp{20, 0}));
+  // Segments without versioned keys overlap everything.
+  EXPECT_FALSE(table->segments[1].bounds.known);
+  EXPECT_TRUE(table->segments[1].bounds.Overlaps(DBTimestamp{15, 0}, DBTimestamp{20, 0}));
+  EXPECT_TRUE(table->SegmentsPrunable(DBTimestamp{15, 0}, DBTimestamp{20, 0}));
+  EXPECT_FALSE(table->SegmentsPrunable(DBTimestamp{0, 0}, DBTimestamp{11, 0}));
+  EXPECT_FALSE(table->SegmentsPrunable(DBTimestamp{21, 0}, DBTimestamp{30, 0}));
+  EXPECT_TRUE(cache.SegmentsPrunable(DBTimestamp{15, 0}, DBTimestamp{20, 0}));
+  EXPECT_FALSE(cache.SegmentsPrunable(DBTimestamp{0, 0}, DBTimestamp{11, 0}));
+
+  // The bounds are found by the address of the properties held by the
+  // table reader once these are added. Misses mark the cache stale.
+  std::shared_ptr<const rocksdb::TableProperties> reader_props(new rocksdb::TableProperties(props));
+  EXPECT_TRUE(cache.TakeStale());
+  EXPECT_FALSE(cache.TakeStale());
+  EXPECT_EQ(nullptr, cache.Get(*reader_props));
+  EXPECT_TRUE(cache.TakeStale());
+  EXPECT_EQ(table, cache.AddReaderProperties("/path/to/000123.sst", reader_props));
+  EXPECT_EQ(table, cache.Get(*reader_props));
+  EXPECT_EQ(nullptr, cache.Get(props));
+  EXPECT_TRUE(cache.TakeStale());
+  EXPECT_EQ(1, cache.Size());
+
+  cache.Remove("/path/to/000123.sst");
+  EXPECT_EQ(nullptr, cache.Get(123));
+  EXPECT_EQ(nullptr, cache.Get(*reader_props));
+  EXPECT_EQ(0, cache.Size());
+  // The removed bounds remain usable by their holders.
+  EXPECT_TRUE(table->bounds.known);
+}
+
+TEST(Libroach, DBTimeBoundIterPruned) {
+  DBOptions db_opts = defaultDBOptions();
+  DBEngine* db;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+
+  // Write three sstables with disjoint time ranges.
+  for (int64_t wall_time : {10, 20, 30}) {
+    const std::string key = "key" + std::to_string(wall_time);
+    DBKey k = {ToDBSlice(key), wall_time, 0};
+    EXPECT_STREQ(DBPut(db, k, ToDBSlice("value")).data, NULL);
+    EXPECT_STREQ(DBFlush(db).data, NULL);
+  }
+  // The flushed sstables were added to the cache.
+  EXPECT_EQ(3, db->timebound_cache->Size());
+
+  auto scan = [&](int64_t min_wall_time, int64_t max_wall_time, IteratorStats* stats) {
+    DBIterator* iter = DBNewTimeBoundIter(db, DBTimestamp{min_wall_time, 0},
+                                          DBTimestamp{max_wall_time, 0}, true /* with_stats */);
+    int keys = 0;
+    for (DBIterState state = DBIterSeekToFirst(iter); state.valid;
+         state = DBIterNext(iter, false /* skip_current_key_versions */)) {
+      keys++;
+    }
+    *stats = DBIterStats(iter);
+    DBIterDestroy(iter);
+    return keys;
+  };
+
+  IteratorStats stats;
+  EXPECT_EQ(3, scan(0, 100, &stats));
+  EXPECT_EQ(0, stats.timebound_num_ssts_pruned);
+  EXPECT_EQ(3, stats.timebound_num_ssts);
+  EXPECT_EQ(1, scan(15, 25, &stats));
+  EXPECT_EQ(2, stats.timebound_num_ssts_pruned);
+  EXPECT_EQ(1, stats.timebound_num_ssts);
+  EXPECT_EQ(0, scan(40, 50, &stats));
+  EXPECT_EQ(3, stats.timebound_num_ssts_pruned);
+  EXPECT_EQ(0, stats.timebound_num_ssts);
+
+  // The compaction output is added to the cache.
+  EXPECT_STREQ(DBCompact(db).data, NULL);
+  std::vector<rocksdb::LiveFileMetaData> files;
+  db->rep->GetLiveFilesMetaData(&files);
+  for (const auto& f : files) {
+    uint64_t number;
+    ASSERT_TRUE(ParseTableFileNumber(f.name, &number));
+    EXPECT_NE(nullptr, db->timebound_cache->Get(number)) << f.name;
+  }
+  EXPECT_EQ(1, scan(15, 25, &stats));
+  EXPECT_EQ(0, stats.timebound_num_ssts_pruned);
+
+  DBClose(db);
+}
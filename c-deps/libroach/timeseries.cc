@@ -0,0 +1,455 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "timeseries.h"
+#include <algorithm>
+#include <limits>
+#include <string.h>
+
+namespace cockroach {
+
+namespace {
+
+const uint8_t kTimeSeriesAllColumns = kTimeSeriesColumnCount | kTimeSeriesColumnSum |
+                                      kTimeSeriesColumnMax | kTimeSeriesColumnMin |
+                                      kTimeSeriesColumnFirst | kTimeSeriesColumnVariance;
+
+uint64_t ZigZagEncode(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+
+int64_t ZigZagDecode(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+void PutVarint(std::string* buf, uint64_t v) {
+  while (v >= 0x80) {
+    buf->push_back(char(v | 0x80));
+    v >>= 7;
+  }
+  buf->push_back(char(v));
+}
+
+WARN_UNUSED_RESULT bool GetVarint(rocksdb::Slice* buf, uint64_t* v) {
+  uint64_t result = 0;
+  for (int shift = 0; shift <= 63 && !buf->empty(); shift += 7) {
+    const uint8_t b = (*buf)[0];
+    buf->remove_prefix(1);
+    result |= uint64_t(b & 0x7f) << shift;
+    if (b < 0x80) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t DoubleBits(double d) {
+  uint64_t v;
+  memcpy(&v, &d, sizeof(v));
+  return v;
+}
+
+double BitsDouble(uint64_t v) {
+  double d;
+  memcpy(&d, &v, sizeof(d));
+  return d;
+}
+
+int LeadingZeros(uint64_t v) { return v == 0 ? 64 : __builtin_clzll(v); }
+
+int TrailingZeros(uint64_t v) { return v == 0 ? 64 : __builtin_ctzll(v); }
+
+// BitWriter appends a big-endian bitstream to a string.
+class BitWriter {
+ public:
+  explicit BitWriter(std::string* buf) : buf_(buf), free_(0) {}
+
+  // Write appends the low nbits (at most 64) of v.
+  void Write(uint64_t v, int nbits) {
+    while (nbits > 0) {
+      if (free_ == 0) {
+        buf_->push_back(0);
+        free_ = 8;
+      }
+      const int n = std::min(nbits, free_);
+      const uint8_t bits = uint8_t((v >> (nbits - n)) & ((1u << n) - 1));
+      buf_->back() |= char(bits << (free_ - n));
+      free_ -= n;
+      nbits -= n;
+    }
+  }
+
+  void WriteBit(bool b) { Write(b ? 1 : 0, 1); }
+
+ private:
+  std::string* const buf_;
+  // The number of unused low bits in the last byte of buf_.
+  int free_;
+};
+
+// BitReader consumes a bitstream written by BitWriter.
+class BitReader {
+ public:
+  explicit BitReader(rocksdb::Slice buf) : buf_(buf), pos_(0) {}
+
+  WARN_UNUSED_RESULT bool Read(int nbits, uint64_t* v) {
+    if (nbits > Remaining()) {
+      return false;
+    }
+    uint64_t result = 0;
+    while (nbits > 0) {
+      const int avail = 8 - int(pos_ & 7);
+      const int n = std::min(nbits, avail);
+      const uint8_t b = buf_[pos_ >> 3];
+      result = (result << n) | ((b >> (avail - n)) & ((1u << n) - 1));
+      pos_ += n;
+      nbits -= n;
+    }
+    *v = result;
+    return true;
+  }
+
+  WARN_UNUSED_RESULT bool ReadBit(bool* b) {
+    uint64_t v;
+    if (!Read(1, &v)) {
+      return false;
+    }
+    *b = v != 0;
+    return true;
+  }
+
+  uint64_t Remaining() const { return uint64_t(buf_.size()) * 8 - pos_; }
+
+ private:
+  const rocksdb::Slice buf_;
+  uint64_t pos_;
+};
+
+// IntColumnEncoder encodes a sequence of integers as delta-of-deltas. A zero
+// delta-of-delta, which is the common case for regularly spaced offsets and
+// stable counts, takes a single bit. Other values are zig-zag encoded into
+// buckets of increasing width, each prefixed by a unary bucket selector.
+class IntColumnEncoder {
+ public:
+  explicit IntColumnEncoder(BitWriter* w) : w_(w), prev_(0), prev_delta_(0) {}
+
+  void Append(int64_t v) {
+    const int64_t delta = v - prev_;
+    const uint64_t dod = ZigZagEncode(delta - prev_delta_);
+    prev_ = v;
+    prev_delta_ = delta;
+    if (dod == 0) {
+      w_->Write(0x0, 1);
+    } else if (dod < (1 << 7)) {
+      w_->Write(0x2, 2);
+      w_->Write(dod, 7);
+    } else if (dod < (1 << 9)) {
+      w_->Write(0x6, 3);
+      w_->Write(dod, 9);
+    } else if (dod < (1 << 12)) {
+      w_->Write(0xe, 4);
+      w_->Write(dod, 12);
+    } else {
+      w_->Write(0xf, 4);
+      w_->Write(dod, 64);
+    }
+  }
+
+ private:
+  BitWriter* const w_;
+  int64_t prev_;
+  int64_t prev_delta_;
+};
+
+class IntColumnDecoder {
+ public:
+  explicit IntColumnDecoder(BitReader* r) : r_(r), prev_(0), prev_delta_(0) {}
+
+  WARN_UNUSED_RESULT bool Next(int64_t* v) {
+    static const int kWidths[] = {7, 9, 12, 64};
+    int bucket = 0;
+    while (bucket < 4) {
+      bool b;
+      if (!r_->ReadBit(&b)) {
+        return false;
+      }
+      if (!b) {
+        break;
+      }
+      bucket++;
+    }
+    uint64_t dod = 0;
+    if (bucket > 0 && !r_->Read(kWidths[bucket - 1], &dod)) {
+      return false;
+    }
+    // Use unsigned arithmetic so that corrupt input wraps instead of
+    // overflowing; out of range results are rejected by the caller.
+    prev_delta_ = int64_t(uint64_t(prev_delta_) + uint64_t(ZigZagDecode(dod)));
+    prev_ = int64_t(uint64_t(prev_) + uint64_t(prev_delta_));
+    *v = prev_;
+    return true;
+  }
+
+ private:
+  BitReader* const r_;
+  int64_t prev_;
+  int64_t prev_delta_;
+};
+
+// FloatColumnEncoder encodes a sequence of doubles by XOR'ing each value with
+// its predecessor. Identical values take a single bit. Otherwise only the
+// meaningful (non-zero) bits of the XOR are stored, reusing the previous
+// leading/trailing zero window when the new bits fit inside it.
+class FloatColumnEncoder {
+ public:
+  explicit FloatColumnEncoder(BitWriter* w) : w_(w), prev_(0), leading_(-1), trailing_(0) {}
+
+  void Append(double d) {
+    const uint64_t v = DoubleBits(d);
+    const uint64_t x = v ^ prev_;
+    prev_ = v;
+    if (x == 0) {
+      w_->WriteBit(false);
+      return;
+    }
+    w_->WriteBit(true);
+
+    const int leading = std::min(LeadingZeros(x), 31);
+    const int trailing = TrailingZeros(x);
+    if (leading_ >= 0 && leading >= leading_ && trailing >= trailing_) {
+      w_->WriteBit(false);
+      w_->Write(x >> trailing_, 64 - leading_ - trailing_);
+      return;
+    }
+    const int length = 64 - leading - trailing;
+    w_->WriteBit(true);
+    w_->Write(leading, 5);
+    w_->Write(length - 1, 6);
+    w_->Write(x >> trailing, length);
+    leading_ = leading;
+    trailing_ = trailing;
+  }
+
+ private:
+  BitWriter* const w_;
+  uint64_t prev_;
+  int leading_;
+  int trailing_;
+};
+
+class FloatColumnDecoder {
+ public:
+  explicit FloatColumnDecoder(BitReader* r) : r_(r), prev_(0), leading_(-1), trailing_(0) {}
+
+  WARN_UNUSED_RESULT bool Next(double* d) {
+    bool b;
+    if (!r_->ReadBit(&b)) {
+      return false;
+    }
+    if (b) {
+      if (!r_->ReadBit(&b)) {
+        return false;
+      }
+      if (b) {
+        uint64_t leading, length;
+        if (!r_->Read(5, &leading) || !r_->Read(6, &length)) {
+          return false;
+        }
+        length++;
+        if (leading + length > 64) {
+          return false;
+        }
+        leading_ = int(leading);
+        trailing_ = 64 - int(leading + length);
+      } else if (leading_ < 0) {
+        return false;
+      }
+      uint64_t x;
+      if (!r_->Read(64 - leading_ - trailing_, &x)) {
+        return false;
+      }
+      prev_ ^= x << trailing_;
+    }
+    *d = BitsDouble(prev_);
+    return true;
+  }
+
+ private:
+  BitReader* const r_;
+  uint64_t prev_;
+  int leading_;
+  int trailing_;
+};
+
+template <typename T>
+void EncodeFloatColumn(BitWriter* w, const google::protobuf::RepeatedField<T>& col) {
+  FloatColumnEncoder enc(w);
+  for (auto v : col) {
+    enc.Append(v);
+  }
+}
+
+WARN_UNUSED_RESULT bool DecodeFloatColumn(BitReader* r, uint64_t n,
+                                          google::protobuf::RepeatedField<double>* col) {
+  FloatColumnDecoder dec(r);
+  col->Reserve(n);
+  for (uint64_t i = 0; i < n; i++) {
+    double d;
+    if (!dec.Next(&d)) {
+      return false;
+    }
+    col->Add(d);
+  }
+  return true;
+}
+
+template <typename T>
+WARN_UNUSED_RESULT bool DecodeIntColumn(BitReader* r, uint64_t n,
+                                        google::protobuf::RepeatedField<T>* col) {
+  IntColumnDecoder dec(r);
+  col->Reserve(n);
+  for (uint64_t i = 0; i < n; i++) {
+    int64_t v;
+    if (!dec.Next(&v)) {
+      return false;
+    }
+    if (v < int64_t(std::numeric_limits<T>::min()) ||
+        v > int64_t(std::numeric_limits<T>::max())) {
+      return false;
+    }
+    col->Add(T(v));
+  }
+  return true;
+}
+
+}  // namespace
+
+bool EncodeCompressedTimeSeries(const roachpb::InternalTimeSeriesData& data, std::string* buf) {
+  if (data.samples_size() > 0) {
+    return false;
+  }
+  const int n = data.offset_size();
+  if (data.last_size() != n) {
+    return false;
+  }
+
+  uint8_t columns = 0;
+  const struct {
+    int size;
+    uint8_t bit;
+  } rollups[] = {
+      {data.count_size(), kTimeSeriesColumnCount},
+      {data.sum_size(), kTimeSeriesColumnSum},
+      {data.max_size(), kTimeSeriesColumnMax},
+      {data.min_size(), kTimeSeriesColumnMin},
+      {data.first_size(), kTimeSeriesColumnFirst},
+      {data.variance_size(), kTimeSeriesColumnVariance},
+  };
+  for (const auto& c : rollups) {
+    if (c.size == 0) {
+      continue;
+    }
+    if (c.size != n) {
+      return false;
+    }
+    columns |= c.bit;
+  }
+
+  buf->push_back(char(kTimeSeriesCompressedVersion));
+  buf->push_back(char(columns));
+  PutVarint(buf, ZigZagEncode(data.start_timestamp_nanos()));
+  PutVarint(buf, ZigZagEncode(data.sample_duration_nanos()));
+  PutVarint(buf, n);
+
+  BitWriter w(buf);
+  {
+    IntColumnEncoder enc(&w);
+    for (auto v : data.offset()) {
+      enc.Append(v);
+    }
+  }
+  EncodeFloatColumn(&w, data.last());
+  if (columns & kTimeSeriesColumnCount) {
+    IntColumnEncoder enc(&w);
+    for (auto v : data.count()) {
+      enc.Append(v);
+    }
+  }
+  if (columns & kTimeSeriesColumnSum) {
+    EncodeFloatColumn(&w, data.sum());
+  }
+  if (columns & kTimeSeriesColumnMax) {
+    EncodeFloatColumn(&w, data.max());
+  }
+  if (columns & kTimeSeriesColumnMin) {
+    EncodeFloatColumn(&w, data.min());
+  }
+  if (columns & kTimeSeriesColumnFirst) {
+    EncodeFloatColumn(&w, data.first());
+  }
+  if (columns & kTimeSeriesColumnVariance) {
+    EncodeFloatColumn(&w, data.variance());
+  }
+  return true;
+}
+
+bool DecodeCompressedTimeSeries(rocksdb::Slice buf, roachpb::InternalTimeSeriesData* data) {
+  data->Clear();
+  if (buf.size() < 2 || uint8_t(buf[0]) != kTimeSeriesCompressedVersion) {
+    return false;
+  }
+  const uint8_t columns = buf[1];
+  if ((columns & ~kTimeSeriesAllColumns) != 0) {
+    return false;
+  }
+  buf.remove_prefix(2);
+
+  uint64_t start, duration, n;
+  if (!GetVarint(&buf, &start) || !GetVarint(&buf, &duration) || !GetVarint(&buf, &n)) {
+    return false;
+  }
+  // Every sample takes at least one bit in each column. Check this up front so
+  // that a corrupt count cannot trigger a huge allocation.
+  if (n > uint64_t(buf.size()) * 8) {
+    return false;
+  }
+  data->set_start_timestamp_nanos(ZigZagDecode(start));
+  data->set_sample_duration_nanos(ZigZagDecode(duration));
+
+  BitReader r(buf);
+  if (!DecodeIntColumn(&r, n, data->mutable_offset()) ||
+      !DecodeFloatColumn(&r, n, data->mutable_last())) {
+    return false;
+  }
+  if ((columns & kTimeSeriesColumnCount) && !DecodeIntColumn(&r, n, data->mutable_count())) {
+    return false;
+  }
+  if ((columns & kTimeSeriesColumnSum) && !DecodeFloatColumn(&r, n, data->mutable_sum())) {
+    return false;
+  }
+  if ((columns & kTimeSeriesColumnMax) && !DecodeFloatColumn(&r, n, data->mutable_max())) {
+    return false;
+  }
+  if ((columns & kTimeSeriesColumnMin) && !DecodeFloatColumn(&r, n, data->mutable_min())) {
+    return false;
+  }
+  if ((columns & kTimeSeriesColumnFirst) && !DecodeFloatColumn(&r, n, data->mutable_first())) {
+    return false;
+  }
+  if ((columns & kTimeSeriesColumnVariance) &&
+      !DecodeFloatColumn(&r, n, data->mutable_variance())) {
+    return false;
+  }
+  // Only padding bits in the final byte may remain.
+  return r.Remaining() < 8;
+}
+
+}  // namespace cockroach
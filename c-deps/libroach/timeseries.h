@@ -0,0 +1,62 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <rocksdb/slice.h>
+#include <string>
+#include "defines.h"
+#include "protos/roachpb/internal.pb.h"
+
+namespace cockroach {
+
+// Compressed time series values (tag TIMESERIES_COMPRESSED) hold columnar
+// InternalTimeSeriesData in a compact encoding modeled on Facebook's Gorilla
+// paper:
+//
+//   <version:1><columns:1><start_timestamp_nanos:varint>
+//   <sample_duration_nanos:varint><num_samples:varint><bitstream>
+//
+// The columns byte is a bitmask of the optional rollup columns that are
+// present (see kTimeSeriesColumn*). The bitstream contains the offset column
+// encoded as delta-of-deltas, followed by the "last" column and each present
+// rollup column in field number order. Integer columns (offset, count) use
+// delta-of-delta encoding with variable width buckets; float columns XOR each
+// value with its predecessor and store only the meaningful bits. Regularly
+// spaced samples with slowly changing values thus cost a few bits each instead
+// of the 4-12 bytes per column taken by the packed protobuf encoding.
+const uint8_t kTimeSeriesCompressedVersion = 1;
+
+const uint8_t kTimeSeriesColumnCount = 1 << 0;
+const uint8_t kTimeSeriesColumnSum = 1 << 1;
+const uint8_t kTimeSeriesColumnMax = 1 << 2;
+const uint8_t kTimeSeriesColumnMin = 1 << 3;
+const uint8_t kTimeSeriesColumnFirst = 1 << 4;
+const uint8_t kTimeSeriesColumnVariance = 1 << 5;
+
+// EncodeCompressedTimeSeries appends the compressed encoding of data to
+// buf. The data must be in columnar format and every present column must have
+// the same length as the offset column. Returns false (leaving buf untouched)
+// if the data cannot be represented, in which case the caller should fall back
+// to the protobuf encoding.
+WARN_UNUSED_RESULT bool EncodeCompressedTimeSeries(const roachpb::InternalTimeSeriesData& data,
+                                                   std::string* buf);
+
+// DecodeCompressedTimeSeries decodes a value produced by
+// EncodeCompressedTimeSeries into data, which is cleared first. Returns false
+// if buf is malformed.
+WARN_UNUSED_RESULT bool DecodeCompressedTimeSeries(rocksdb::Slice buf,
+                                                   roachpb::InternalTimeSeriesData* data);
+
+}  // namespace cockroach
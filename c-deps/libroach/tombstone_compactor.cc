@@ -0,0 +1,154 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "tombstone_compactor.h"
+#include <algorithm>
+#include <iterator>
+
+namespace cockroach {
+
+void TombstoneSpan::Extend(const rocksdb::Slice& key) {
+  if (empty) {
+    start.assign(key.data(), key.size());
+    end.assign(key.data(), key.size());
+    empty = false;
+  } else if (key.compare(start) < 0) {
+    start.assign(key.data(), key.size());
+  } else if (key.compare(end) > 0) {
+    end.assign(key.data(), key.size());
+  }
+}
+
+TombstoneCompactor::Options::Options()
+    : threshold(10000),
+      min_interval(std::chrono::seconds(10)),
+      window(std::chrono::minutes(10)),
+      max_spans(1024) {}
+
+TombstoneCompactor::TombstoneCompactor(CompactFn compact, const Options& opts)
+    : compact_(std::move(compact)),
+      opts_(opts),
+      running_(false),
+      stopping_(false),
+      compactions_(0),
+      thread_(&TombstoneCompactor::run, this) {}
+
+TombstoneCompactor::~TombstoneCompactor() {
+  {
+    std::lock_guard<std::mutex> guard(mu_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void TombstoneCompactor::Record(const TombstoneSpan& span) {
+  if (span.empty || span.skipped == 0) {
+    return;
+  }
+  const clock::time_point now = clock::now();
+  Span merged = {span.start, span.end};
+  Tracked t = {"", span.skipped, now};
+
+  std::lock_guard<std::mutex> guard(mu_);
+  // Merge all tracked spans overlapping [start, end].
+  auto it = tracked_.upper_bound(merged.start);
+  if (it != tracked_.begin() && std::prev(it)->second.end >= merged.start) {
+    --it;
+  }
+  while (it != tracked_.end() && it->first <= span.end) {
+    if (it->first < merged.start) {
+      merged.start = it->first;
+    }
+    if (it->second.end > merged.end) {
+      merged.end = it->second.end;
+    }
+    if (now - it->second.since < opts_.window) {
+      t.skipped += it->second.skipped;
+      t.since = std::min(t.since, it->second.since);
+    }
+    it = tracked_.erase(it);
+  }
+
+  if (t.skipped >= opts_.threshold) {
+    scheduleLocked(std::move(merged));
+    return;
+  }
+
+  t.end = std::move(merged.end);
+  tracked_[merged.start] = std::move(t);
+  if (tracked_.size() > opts_.max_spans) {
+    auto victim = tracked_.begin();
+    for (auto i = tracked_.begin(); i != tracked_.end(); ++i) {
+      if (i->second.skipped < victim->second.skipped) {
+        victim = i;
+      }
+    }
+    tracked_.erase(victim);
+  }
+}
+
+void TombstoneCompactor::scheduleLocked(Span span) {
+  if (running_ && running_span_.start <= span.start && span.end <= running_span_.end) {
+    // The tombstones were likely skipped before the running compaction
+    // removed them.
+    return;
+  }
+  for (auto it = pending_.begin(); it != pending_.end();) {
+    if (it->start <= span.end && span.start <= it->end) {
+      span.start = std::min(span.start, it->start);
+      span.end = std::max(span.end, it->end);
+      it = pending_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  pending_.push_back(std::move(span));
+  cv_.notify_all();
+}
+
+void TombstoneCompactor::run() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+    if (stopping_) {
+      return;
+    }
+    running_ = true;
+    running_span_ = std::move(pending_.front());
+    pending_.pop_front();
+
+    lock.unlock();
+    // Errors are logged by compact_. The tombstones will be recorded
+    // again if they are still being skipped.
+    compact_(running_span_.start, running_span_.end);
+    lock.lock();
+
+    running_ = false;
+    ++compactions_;
+    cv_.wait_for(lock, opts_.min_interval, [this] { return stopping_; });
+  }
+}
+
+size_t TombstoneCompactor::NumTracked() const {
+  std::lock_guard<std::mutex> guard(mu_);
+  return tracked_.size();
+}
+
+uint64_t TombstoneCompactor::NumCompactions() const {
+  std::lock_guard<std::mutex> guard(mu_);
+  return compactions_;
+}
+
+}  // namespace cockroach
@@ -0,0 +1,124 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <rocksdb/slice.h>
+#include <rocksdb/status.h>
+#include <string>
+#include <thread>
+
+namespace cockroach {
+
+// TombstoneSpan accumulates the number of deletion tombstones an
+// iterator skipped over and the span of user keys [start, end] (both
+// inclusive) they were skipped in.
+struct TombstoneSpan {
+  TombstoneSpan() : skipped(0), empty(true) {}
+
+  // Extend widens the span to include key.
+  void Extend(const rocksdb::Slice& key);
+
+  std::string start;
+  std::string end;
+  uint64_t skipped;
+  bool empty;
+};
+
+// TombstoneCompactor aggregates the deletion tombstones skipped by
+// iterators by key span and compacts the spans in which more than a
+// threshold of tombstones were skipped. Scans over queue-like key spans
+// otherwise keep skipping the same tombstones until RocksDB happens to
+// compact the sstables containing them.
+//
+// Compactions are run one at a time on a background thread, at most
+// one per min_interval. Overlapping hot spans are merged before they
+// are compacted, and spans within the span being compacted are dropped.
+class TombstoneCompactor {
+ public:
+  // CompactFn compacts the user keys in [start, end].
+  typedef std::function<rocksdb::Status(const std::string& start, const std::string& end)>
+      CompactFn;
+
+  struct Options {
+    Options();
+
+    // The number of skipped tombstones after which a span is compacted.
+    uint64_t threshold;
+    // The minimum time between the end of a compaction and the start of
+    // the next one.
+    std::chrono::milliseconds min_interval;
+    // Skipped tombstones are forgotten if their span didn't reach the
+    // threshold within this window.
+    std::chrono::milliseconds window;
+    // The maximum number of spans tracked. The span with the fewest
+    // skipped tombstones is forgotten when a new span exceeds the limit.
+    size_t max_spans;
+  };
+
+  TombstoneCompactor(CompactFn compact, const Options& opts);
+  // Waits for a running compaction to finish. Pending compactions are
+  // dropped.
+  ~TombstoneCompactor();
+
+  // Record adds the tombstones skipped by an iterator.
+  void Record(const TombstoneSpan& span);
+
+  // NumTracked returns the number of spans which haven't reached the
+  // threshold yet.
+  size_t NumTracked() const;
+  // NumCompactions returns the number of compactions run so far.
+  uint64_t NumCompactions() const;
+
+ private:
+  typedef std::chrono::steady_clock clock;
+
+  struct Tracked {
+    std::string end;
+    uint64_t skipped;
+    clock::time_point since;
+  };
+
+  struct Span {
+    std::string start;
+    std::string end;
+  };
+
+  void scheduleLocked(Span span);
+  void run();
+
+  const CompactFn compact_;
+  const Options opts_;
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  // The spans below the threshold, keyed by start key. The spans are
+  // disjoint.
+  std::map<std::string, Tracked> tracked_;
+  // The disjoint spans waiting to be compacted.
+  std::deque<Span> pending_;
+  bool running_;
+  Span running_span_;
+  bool stopping_;
+  uint64_t compactions_;
+  std::thread thread_;
+};
+
+}  // namespace cockroach
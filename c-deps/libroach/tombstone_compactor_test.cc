@@ -0,0 +1,195 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <string>
+#include <vector>
+#include "db.h"
+#include "engine.h"
+#include "include/libroach.h"
+#include "testutils.h"
+#include "tombstone_compactor.h"
+
+using namespace cockroach;
+using namespace testutils;
+
+namespace {
+
+TombstoneSpan span(const std::string& start, const std::string& end, uint64_t skipped) {
+  TombstoneSpan s;
+  s.Extend(start);
+  s.Extend(end);
+  s.skipped = skipped;
+  return s;
+}
+
+// compactions records the spans compacted by a TombstoneCompactor.
+struct compactions {
+  std::mutex mu;
+  std::condition_variable cv;
+  std::vector<std::string> spans;
+
+  TombstoneCompactor::CompactFn Fn() {
+    return [this](const std::string& start, const std::string& end) {
+      std::lock_guard<std::mutex> guard(mu);
+      spans.push_back(start + "-" + end);
+      cv.notify_all();
+      return rocksdb::Status::OK();
+    };
+  }
+
+  // Wait waits until n spans were compacted and returns them.
+  std::vector<std::string> Wait(size_t n) {
+    std::unique_lock<std::mutex> lock(mu);
+    cv.wait_for(lock, std::chrono::seconds(10), [&] { return spans.size() >= n; });
+    return spans;
+  }
+};
+
+}  // namespace
+
+TEST(Libroach, TombstoneSpan) {
+  TombstoneSpan s;
+  EXPECT_TRUE(s.empty);
+  s.Extend("c");
+  EXPECT_EQ("c", s.start);
+  EXPECT_EQ("c", s.end);
+  s.Extend("e");
+  s.Extend("a");
+  s.Extend("b");
+  EXPECT_FALSE(s.empty);
+  EXPECT_EQ("a", s.start);
+  EXPECT_EQ("e", s.end);
+}
+
+TEST(Libroach, TombstoneCompactor) {
+  compactions c;
+  TombstoneCompactor::Options opts;
+  opts.threshold = 100;
+  opts.min_interval = std::chrono::milliseconds(0);
+  opts.max_spans = 2;
+  TombstoneCompactor compactor(c.Fn(), opts);
+
+  // Spans without skipped tombstones are ignored.
+  compactor.Record(TombstoneSpan());
+  compactor.Record(span("a", "b", 0));
+  EXPECT_EQ(0, compactor.NumTracked());
+
+  // Overlapping spans are merged, disjoint spans are tracked separately.
+  compactor.Record(span("b", "c", 40));
+  compactor.Record(span("c", "d", 40));
+  compactor.Record(span("x", "y", 10));
+  EXPECT_EQ(2, compactor.NumTracked());
+
+  // The span with the fewest skipped tombstones is forgotten.
+  compactor.Record(span("m", "n", 20));
+  EXPECT_EQ(2, compactor.NumTracked());
+
+  // The merged span exceeds the threshold and is compacted.
+  compactor.Record(span("a", "b", 20));
+  EXPECT_EQ(1, compactor.NumTracked());
+  EXPECT_EQ(std::vector<std::string>({"a-d"}), c.Wait(1));
+
+  compactor.Record(span("m", "m", 80));
+  EXPECT_EQ(0, compactor.NumTracked());
+  EXPECT_EQ(std::vector<std::string>({"a-d", "m-n"}), c.Wait(2));
+}
+
+TEST(Libroach, TombstoneCompactorDedup) {
+  std::mutex mu;
+  std::condition_variable cv;
+  bool blocked = false;
+  bool unblock = false;
+  std::vector<std::string> spans;
+  TombstoneCompactor::Options opts;
+  opts.threshold = 1;
+  opts.min_interval = std::chrono::milliseconds(0);
+
+  std::unique_ptr<TombstoneCompactor> compactor(new TombstoneCompactor(
+      [&](const std::string& start, const std::string& end) {
+        std::unique_lock<std::mutex> lock(mu);
+        spans.push_back(start + "-" + end);
+        blocked = true;
+        cv.notify_all();
+        cv.wait(lock, [&] { return unblock; });
+        return rocksdb::Status::OK();
+      },
+      opts));
+
+  // Block the first compaction while more hot spans are recorded.
+  compactor->Record(span("a", "e", 1));
+  {
+    std::unique_lock<std::mutex> lock(mu);
+    cv.wait(lock, [&] { return blocked; });
+  }
+  // Within the running compaction.
+  compactor->Record(span("b", "c", 1));
+  // Overlapping pending spans are merged.
+  compactor->Record(span("d", "g", 1));
+  compactor->Record(span("f", "h", 1));
+  compactor->Record(span("x", "y", 1));
+  {
+    std::lock_guard<std::mutex> guard(mu);
+    unblock = true;
+    cv.notify_all();
+  }
+
+  for (int i = 0; i < 1000 && compactor->NumCompactions() < 3; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  compactor.reset();
+  EXPECT_EQ(std::vector<std::string>({"a-e", "d-h", "x-y"}), spans);
+}
+
+TEST(Libroach, DBTombstoneCompaction) {
+  DBOptions db_opts = defaultDBOptions();
+  DBEngine* db;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+  // Tombstones are only counted if requested.
+  EXPECT_EQ(nullptr, db->tombstone_compactor);
+  DBClose(db);
+
+  db_opts.compact_tombstones = true;
+  EXPECT_STREQ(DBOpen(&db, DBSlice(), db_opts).data, NULL);
+  ASSERT_NE(nullptr, db->tombstone_compactor);
+
+  // Write and delete a queue of keys and push the tombstones below the
+  // memtable so that iterators have to skip them.
+  for (int i = 0; i < 20000; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "q%06d", i);
+    DBKey k = {ToDBSlice(key), 0, 0};
+    EXPECT_STREQ(DBPut(db, k, ToDBSlice("value")).data, NULL);
+    EXPECT_STREQ(DBDelete(db, k).data, NULL);
+  }
+  EXPECT_STREQ(DBFlush(db).data, NULL);
+  const DBKey live = {ToDBSlice("r"), 0, 0};
+  EXPECT_STREQ(DBPut(db, live, ToDBSlice("value")).data, NULL);
+
+  // The seek skips all tombstones to get to the live key.
+  DBIterator* iter = DBNewIter(db, false /* prefix */, false /* stats */);
+  const DBKey start = {ToDBSlice("q"), 0, 0};
+  EXPECT_TRUE(DBIterSeek(iter, start).valid);
+  DBIterDestroy(iter);
+
+  for (int i = 0; i < 1000 && db->tombstone_compactor->NumCompactions() == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(1, db->tombstone_compactor->NumCompactions());
+
+  DBStatsResult stats;
+  EXPECT_STREQ(DBGetStats(db, &stats).data, NULL);
+  EXPECT_EQ(1, stats.tombstone_compactions);
+
+  DBClose(db);
+}
@@ -167,27 +167,7 @@ var _ db.Comparer = cockroachComparer{}
 
 // Compare implements the db.Comparer interface.
 func (cockroachComparer) Compare(a, b []byte) int {
-	keyA, tsA, okA := engine.SplitMVCCKey(a)
-	keyB, tsB, okB := engine.SplitMVCCKey(b)
-	if !okA || !okB {
-		// This should never happen unless there is some sort of corruption of
-		// the keys. This is a little bizarre, but the behavior exactly matches
-		// engine/db.cc:DBComparator.
-		return bytes.Compare(a, b)
-	}
-
-	if c := bytes.Compare(keyA, keyB); c != 0 {
-		return c
-	}
-	if len(tsA) == 0 {
-		if len(tsB) == 0 {
-			return 0
-		}
-		return -1
-	} else if len(tsB) == 0 {
-		return 1
-	}
-	return bytes.Compare(tsB, tsA)
+	return engine.CompareMVCCKeys(a, b)
 }
 
 func (cockroachComparer) Name() string {
@@ -386,6 +386,16 @@ func (v *Value) SetInt(i int64) {
 	v.setTag(ValueType_INT)
 }
 
+// SetCounter encodes the specified int64 counter delta into the bytes field of
+// the receiver, sets the tag and clears the checksum. COUNTER values are summed
+// by the merge operator, so a Merge of a COUNTER value performs a blind
+// increment.
+func (v *Value) SetCounter(i int64) {
+	v.RawBytes = make([]byte, headerSize+8)
+	binary.LittleEndian.PutUint64(v.RawBytes[headerSize:], uint64(i))
+	v.setTag(ValueType_COUNTER)
+}
+
 // SetProto encodes the specified proto message into the bytes field of the
 // receiver and clears the checksum. If the proto message is an
 // InternalTimeSeriesData, the tag will be set to TIMESERIES rather than BYTES.
@@ -507,6 +517,20 @@ func (v Value) GetInt() (int64, error) {
 	return i, nil
 }
 
+// GetCounter decodes an int64 counter from the bytes field of the receiver. If
+// the bytes field is not 8 bytes in length or the tag is not COUNTER an error
+// will be returned.
+func (v Value) GetCounter() (int64, error) {
+	if tag := v.GetTag(); tag != ValueType_COUNTER {
+		return 0, fmt.Errorf("value type is not %s: %s", ValueType_COUNTER, tag)
+	}
+	dataBytes := v.dataBytes()
+	if len(dataBytes) != 8 {
+		return 0, fmt.Errorf("counter value should be exactly 8 bytes: %d", len(dataBytes))
+	}
+	return int64(binary.LittleEndian.Uint64(dataBytes)), nil
+}
+
 // GetProto unmarshals the bytes field of the receiver into msg. If
 // unmarshalling fails or the tag is not BYTES, an error will be
 // returned.
@@ -514,7 +538,10 @@ func (v Value) GetProto(msg protoutil.Message) error {
 	expectedTag := ValueType_BYTES
 
 	// Special handling for ts data.
-	if _, ok := msg.(*InternalTimeSeriesData); ok {
+	if ts, ok := msg.(*InternalTimeSeriesData); ok {
+		if v.GetTag() == ValueType_TIMESERIES_COMPRESSED {
+			return decodeCompressedTimeSeries(v.dataBytes(), ts)
+		}
 		expectedTag = ValueType_TIMESERIES
 	}
 
@@ -555,7 +582,7 @@ func (v Value) GetDecimal() (apd.Decimal, error) {
 
 // GetTimeseries decodes an InternalTimeSeriesData value from the bytes
 // field of the receiver. An error will be returned if the tag is not
-// TIMESERIES or if decoding fails.
+// TIMESERIES or TIMESERIES_COMPRESSED or if decoding fails.
 func (v Value) GetTimeseries() (InternalTimeSeriesData, error) {
 	ts := InternalTimeSeriesData{}
 	// GetProto mutates its argument. `return ts, v.GetProto(&ts)`
@@ -648,6 +675,10 @@ func (v Value) PrettyPrint() string {
 		var i int64
 		i, err = v.GetInt()
 		buf.WriteString(strconv.FormatInt(i, 10))
+	case ValueType_COUNTER:
+		var i int64
+		i, err = v.GetCounter()
+		buf.WriteString(strconv.FormatInt(i, 10))
 	case ValueType_FLOAT:
 		var f float64
 		f, err = v.GetFloat()
@@ -348,6 +348,14 @@ func TestSetGetChecked(t *testing.T) {
 		t.Errorf("set %d on a value and extracted it, expected %d back, but got %d", i, i, r)
 	}
 
+	c := int64(-42)
+	v.SetCounter(c)
+	if r, err := v.GetCounter(); err != nil {
+		t.Fatal(err)
+	} else if c != r {
+		t.Errorf("set %d on a value and extracted it, expected %d back, but got %d", c, c, r)
+	}
+
 	dec := apd.New(11, -1)
 	if err := v.SetDecimal(dec); err != nil {
 		t.Fatal(err)
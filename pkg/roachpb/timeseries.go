@@ -0,0 +1,255 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+package roachpb
+
+import (
+	"encoding/binary"
+	"math"
+
+	"github.com/pkg/errors"
+)
+
+// The compressed time series encoding (tag TIMESERIES_COMPRESSED) is
+// produced by the merge operator in c-deps/libroach/timeseries.cc, which
+// documents the format. The constants below must be kept in sync with
+// c-deps/libroach/timeseries.h.
+const (
+	timeSeriesCompressedVersion = 1
+
+	timeSeriesColumnCount    = 1 << 0
+	timeSeriesColumnSum      = 1 << 1
+	timeSeriesColumnMax      = 1 << 2
+	timeSeriesColumnMin      = 1 << 3
+	timeSeriesColumnFirst    = 1 << 4
+	timeSeriesColumnVariance = 1 << 5
+
+	timeSeriesAllColumns = timeSeriesColumnCount | timeSeriesColumnSum | timeSeriesColumnMax |
+		timeSeriesColumnMin | timeSeriesColumnFirst | timeSeriesColumnVariance
+)
+
+var errMalformedCompressedTimeSeries = errors.New("malformed compressed time series data")
+
+// bitReader consumes a big-endian bitstream.
+type bitReader struct {
+	buf []byte
+	pos uint64
+}
+
+func (r *bitReader) remaining() uint64 {
+	return uint64(len(r.buf))*8 - r.pos
+}
+
+// read returns the next n (at most 64) bits.
+func (r *bitReader) read(n int) (uint64, bool) {
+	if uint64(n) > r.remaining() {
+		return 0, false
+	}
+	var v uint64
+	for n > 0 {
+		avail := 8 - int(r.pos&7)
+		k := n
+		if k > avail {
+			k = avail
+		}
+		b := r.buf[r.pos>>3]
+		v = v<<uint(k) | uint64(b>>uint(avail-k))&(1<<uint(k)-1)
+		r.pos += uint64(k)
+		n -= k
+	}
+	return v, true
+}
+
+func zigZagDecode(v uint64) int64 {
+	return int64(v>>1) ^ -int64(v&1)
+}
+
+// intColumnDecoder decodes integers stored as delta-of-deltas. Each
+// delta-of-delta is prefixed by a unary bucket selector: a zero bit for a
+// delta-of-delta of zero, followed by zig-zag encoded buckets of 7, 9, 12
+// and 64 bits.
+type intColumnDecoder struct {
+	r         *bitReader
+	prev      int64
+	prevDelta int64
+}
+
+var intColumnWidths = [...]int{7, 9, 12, 64}
+
+func (d *intColumnDecoder) next() (int64, bool) {
+	bucket := 0
+	for bucket < len(intColumnWidths) {
+		b, ok := d.r.read(1)
+		if !ok {
+			return 0, false
+		}
+		if b == 0 {
+			break
+		}
+		bucket++
+	}
+	var dod uint64
+	if bucket > 0 {
+		var ok bool
+		if dod, ok = d.r.read(intColumnWidths[bucket-1]); !ok {
+			return 0, false
+		}
+	}
+	d.prevDelta += zigZagDecode(dod)
+	d.prev += d.prevDelta
+	return d.prev, true
+}
+
+// floatColumnDecoder decodes doubles stored as the XOR with their
+// predecessor. A zero bit denotes an unchanged value. Otherwise the
+// meaningful bits of the XOR follow, either within the previous window of
+// leading and trailing zeros or with a new 5-bit leading zero count and
+// 6-bit length.
+type floatColumnDecoder struct {
+	r        *bitReader
+	prev     uint64
+	leading  int
+	trailing int
+}
+
+func (d *floatColumnDecoder) next() (float64, bool) {
+	changed, ok := d.r.read(1)
+	if !ok {
+		return 0, false
+	}
+	if changed == 1 {
+		newWindow, ok := d.r.read(1)
+		if !ok {
+			return 0, false
+		}
+		if newWindow == 1 {
+			leading, ok1 := d.r.read(5)
+			length, ok2 := d.r.read(6)
+			if !ok1 || !ok2 {
+				return 0, false
+			}
+			length++
+			if leading+length > 64 {
+				return 0, false
+			}
+			d.leading = int(leading)
+			d.trailing = 64 - int(leading+length)
+		} else if d.leading < 0 {
+			return 0, false
+		}
+		x, ok := d.r.read(64 - d.leading - d.trailing)
+		if !ok {
+			return 0, false
+		}
+		d.prev ^= x << uint(d.trailing)
+	}
+	return math.Float64frombits(d.prev), true
+}
+
+func decodeFloatColumn(r *bitReader, n int) ([]float64, bool) {
+	d := floatColumnDecoder{r: r, leading: -1}
+	col := make([]float64, n)
+	for i := range col {
+		var ok bool
+		if col[i], ok = d.next(); !ok {
+			return nil, false
+		}
+	}
+	return col, true
+}
+
+// decodeCompressedTimeSeries decodes a TIMESERIES_COMPRESSED value into
+// data, overwriting its contents.
+func decodeCompressedTimeSeries(b []byte, data *InternalTimeSeriesData) error {
+	*data = InternalTimeSeriesData{}
+	if len(b) < 2 || b[0] != timeSeriesCompressedVersion {
+		return errMalformedCompressedTimeSeries
+	}
+	columns := b[1]
+	if columns&^timeSeriesAllColumns != 0 {
+		return errMalformedCompressedTimeSeries
+	}
+	b = b[2:]
+
+	var header [3]uint64
+	for i := range header {
+		v, n := binary.Uvarint(b)
+		if n <= 0 {
+			return errMalformedCompressedTimeSeries
+		}
+		header[i] = v
+		b = b[n:]
+	}
+	// Every sample takes at least one bit in each column.
+	if header[2] > uint64(len(b))*8 {
+		return errMalformedCompressedTimeSeries
+	}
+	n := int(header[2])
+	data.StartTimestampNanos = zigZagDecode(header[0])
+	data.SampleDurationNanos = zigZagDecode(header[1])
+	if n == 0 {
+		if len(b) != 0 {
+			return errMalformedCompressedTimeSeries
+		}
+		return nil
+	}
+
+	r := &bitReader{buf: b}
+	data.Offset = make([]int32, n)
+	offsets := intColumnDecoder{r: r}
+	for i := range data.Offset {
+		v, ok := offsets.next()
+		if !ok || v < math.MinInt32 || v > math.MaxInt32 {
+			return errMalformedCompressedTimeSeries
+		}
+		data.Offset[i] = int32(v)
+	}
+	var ok bool
+	if data.Last, ok = decodeFloatColumn(r, n); !ok {
+		return errMalformedCompressedTimeSeries
+	}
+	if columns&timeSeriesColumnCount != 0 {
+		data.Count = make([]uint32, n)
+		counts := intColumnDecoder{r: r}
+		for i := range data.Count {
+			v, ok := counts.next()
+			if !ok || v < 0 || v > math.MaxUint32 {
+				return errMalformedCompressedTimeSeries
+			}
+			data.Count[i] = uint32(v)
+		}
+	}
+	for _, c := range []struct {
+		bit uint8
+		col *[]float64
+	}{
+		{timeSeriesColumnSum, &data.Sum},
+		{timeSeriesColumnMax, &data.Max},
+		{timeSeriesColumnMin, &data.Min},
+		{timeSeriesColumnFirst, &data.First},
+		{timeSeriesColumnVariance, &data.Variance},
+	} {
+		if columns&c.bit == 0 {
+			continue
+		}
+		if *c.col, ok = decodeFloatColumn(r, n); !ok {
+			return errMalformedCompressedTimeSeries
+		}
+	}
+	// Only padding bits in the final byte may remain.
+	if r.remaining() >= 8 {
+		return errMalformedCompressedTimeSeries
+	}
+	return nil
+}
@@ -0,0 +1,95 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+package roachpb
+
+import (
+	"reflect"
+	"testing"
+)
+
+func makeCompressedTimeSeriesValue(b []byte) Value {
+	var v Value
+	v.SetBytes(b)
+	v.setTag(ValueType_TIMESERIES_COMPRESSED)
+	return v
+}
+
+// TestDecodeCompressedTimeSeries decodes values produced by the libroach
+// encoder (EncodeCompressedTimeSeries in c-deps/libroach/timeseries.cc).
+func TestDecodeCompressedTimeSeries(t *testing.T) {
+	rollup := InternalTimeSeriesData{
+		StartTimestampNanos: 1500000000000000000,
+		SampleDurationNanos: 10000000000,
+	}
+	offsets := []int32{0, 1, 2, 4, 5, 300}
+	last := []float64{1.5, 1.5, 2.25, -7, 1e300, 0}
+	counts := []uint32{1, 1, 2, 3, 3, 100000}
+	for i := range offsets {
+		rollup.Offset = append(rollup.Offset, offsets[i])
+		rollup.Last = append(rollup.Last, last[i])
+		rollup.Count = append(rollup.Count, counts[i])
+		rollup.Sum = append(rollup.Sum, last[i]*float64(counts[i]))
+		rollup.Max = append(rollup.Max, last[i]+1)
+		rollup.Min = append(rollup.Min, last[i]-1)
+		rollup.First = append(rollup.First, last[i]/2)
+		rollup.Variance = append(rollup.Variance, float64(i)*0.1)
+	}
+
+	testCases := []struct {
+		encoded  string
+		expected InternalTimeSeriesData
+	}{
+		{
+			encoded: "\x01\x3f\x80\x80\xb0\xb1\xaf\x83\x89\xd1\x29\x80\x90\xdf\xc0\x4a\x06\x40\x90\x28" +
+				"\x0f\x12\x66\x22\xbf\xfb\x09\xbf\xfe\xe0\x3a\x00\x7e\x0f\x6f\x8a\xf9\x0f\x22\x00" +
+				"\x1d\x67\x9f\x8d\xf9\x0f\x22\x00\x1d\x67\x81\x40\x60\x48\x0f\x80\x00\x00\x00\x00" +
+				"\x01\x86\x9d\x62\x2b\xff\xb0\x9b\xff\xae\x03\xe0\x09\xf0\x7f\x7c\xc9\xd6\x5a\xcc" +
+				"\x00\xb0\x6b\x3f\x28\xf5\x96\xb3\x00\x2c\x1a\xe1\x32\x00\x2d\x81\x7c\x07\x40\x09" +
+				"\xc1\xed\xf1\x7f\x21\xe4\x40\x03\xac\xf2\x0e\x3f\x21\xe4\x40\x03\xac\xf8\x88\xff" +
+				"\xb5\x85\x70\x1b\xff\xae\x0f\x6f\x85\xf9\x0f\x22\x00\x1d\x67\xb0\x71\xf9\x0f\x22" +
+				"\x00\x1d\x67\xc4\x57\xfd\x6b\x0f\x70\x1d\xff\xff\x07\xb7\xc5\x7c\x87\x91\x00\x0e" +
+				"\xb3\xcf\xc4\xfc\x87\x91\x00\x0e\xb3\xb1\x79\xfd\xcc\xcc\xcc\xcc\xcc\xcc\xd8\x07" +
+				"\x00\x00\x00\x00\x00\x00\x10\x03\x55\x55\x55\x55\x55\x55\xe0\x02\xaa\xaa\xaa\xaa" +
+				"\xaa\xab\xc0\x1c\xcc\xcc\xcc\xcc\xcc\xcd",
+			expected: rollup,
+		},
+		{
+			encoded: "\x01\x00\x09\x0e\x01\x83\x61\x3a\x02\x28",
+			expected: InternalTimeSeriesData{
+				StartTimestampNanos: -5,
+				SampleDurationNanos: 7,
+				Offset:              []int32{3},
+				Last:                []float64{42},
+			},
+		},
+	}
+	for i, c := range testCases {
+		ts, err := makeCompressedTimeSeriesValue([]byte(c.encoded)).GetTimeseries()
+		if err != nil {
+			t.Fatalf("%d: %s", i, err)
+		}
+		if !reflect.DeepEqual(c.expected, ts) {
+			t.Errorf("%d: expected %+v, got %+v", i, c.expected, ts)
+		}
+
+		// Truncated values are rejected.
+		for n := 0; n < len(c.encoded); n++ {
+			v := makeCompressedTimeSeriesValue([]byte(c.encoded[:n]))
+			if _, err := v.GetTimeseries(); err == nil {
+				t.Errorf("%d: expected error decoding %d bytes", i, n)
+			}
+		}
+	}
+}
@@ -15,9 +15,12 @@
 package engine
 
 import (
+	"bytes"
 	"encoding/binary"
 	"fmt"
+	"math"
 
+	"github.com/cockroachdb/cockroach/pkg/util/encoding"
 	"github.com/cockroachdb/cockroach/pkg/util/hlc"
 	"github.com/pkg/errors"
 )
@@ -335,26 +338,91 @@ func SplitMVCCKey(mvccKey []byte) (key []byte, ts []byte, ok bool) {
 // DecodeKey decodes an engine.MVCCKey from its serialized representation. This
 // decoding must match engine/db.cc:DecodeKey().
 func DecodeKey(encodedKey []byte) (MVCCKey, error) {
-	key, ts, ok := SplitMVCCKey(encodedKey)
+	key, encodedTS, ok := SplitMVCCKey(encodedKey)
 	if !ok {
 		return MVCCKey{}, errors.Errorf("invalid encoded mvcc key: %x", encodedKey)
 	}
 
 	mvccKey := MVCCKey{Key: key}
-	switch len(ts) {
-	case 0:
-		// No-op.
-	case 8:
-		mvccKey.Timestamp.WallTime = int64(binary.BigEndian.Uint64(ts[0:8]))
-	case 12:
-		mvccKey.Timestamp.WallTime = int64(binary.BigEndian.Uint64(ts[0:8]))
-		mvccKey.Timestamp.Logical = int32(binary.BigEndian.Uint32(ts[8:12]))
+	if len(encodedTS) > 0 {
+		if mvccKey.Timestamp, ok = decodeMVCCTimestamp(encodedTS); !ok {
+			return MVCCKey{}, errors.Errorf(
+				"invalid encoded mvcc key: %x bad timestamp %x", encodedKey, encodedTS)
+		}
+	}
+	return mvccKey, nil
+}
+
+// decodeMVCCTimestamp decodes the timestamp portion of an encoded MVCC key
+// (excluding the sentinel byte). The logical component is either a fixed
+// 4-byte big-endian value (whose first byte is always < 0x80) or an
+// encoding.EncodeUvarintAscending varint (whose first byte is always >= 0x80).
+// This decoding must match engine/encoding.cc:DecodeTimestamp().
+func decodeMVCCTimestamp(ts []byte) (hlc.Timestamp, bool) {
+	if len(ts) < 8 {
+		return hlc.Timestamp{}, false
+	}
+	t := hlc.Timestamp{WallTime: int64(binary.BigEndian.Uint64(ts[0:8]))}
+	logical := ts[8:]
+	switch {
+	case len(logical) == 0:
+	case logical[0] >= 0x80:
+		rest, l, err := encoding.DecodeUvarintAscending(logical)
+		if err != nil || len(rest) != 0 || l > math.MaxInt32 {
+			return hlc.Timestamp{}, false
+		}
+		t.Logical = int32(l)
+	case len(logical) == 4:
+		t.Logical = int32(binary.BigEndian.Uint32(logical))
 	default:
-		return MVCCKey{}, errors.Errorf(
-			"invalid encoded mvcc key: %x bad timestamp %x", encodedKey, ts)
+		return hlc.Timestamp{}, false
 	}
+	return t, true
+}
 
-	return mvccKey, nil
+// compareMVCCTimestamps compares the timestamp portions of two encoded MVCC
+// keys, which may use different logical formats (see decodeMVCCTimestamp).
+// This must match engine/encoding.cc:CompareTimestamps().
+func compareMVCCTimestamps(a, b []byte) int {
+	if len(a) <= 8 || len(b) <= 8 || (a[8] >= 0x80) == (b[8] >= 0x80) {
+		return bytes.Compare(a, b)
+	}
+	tsA, okA := decodeMVCCTimestamp(a)
+	tsB, okB := decodeMVCCTimestamp(b)
+	if !okA || !okB {
+		return bytes.Compare(a, b)
+	}
+	if tsA.Less(tsB) {
+		return -1
+	} else if tsB.Less(tsA) {
+		return 1
+	}
+	return 0
+}
+
+// CompareMVCCKeys compares two encoded MVCC keys. This must match
+// engine/comparator.cc:DBComparator::Compare().
+func CompareMVCCKeys(a, b []byte) int {
+	keyA, tsA, okA := SplitMVCCKey(a)
+	keyB, tsB, okB := SplitMVCCKey(b)
+	if !okA || !okB {
+		// This should never happen unless there is some sort of corruption of
+		// the keys.
+		return bytes.Compare(a, b)
+	}
+
+	if c := bytes.Compare(keyA, keyB); c != 0 {
+		return c
+	}
+	if len(tsA) == 0 {
+		if len(tsB) == 0 {
+			return 0
+		}
+		return -1
+	} else if len(tsB) == 0 {
+		return 1
+	}
+	return compareMVCCTimestamps(tsB, tsA)
 }
 
 // Decode the header of RocksDB batch repr, returning both the count of the
@@ -16,6 +16,7 @@ package engine
 
 import (
 	"context"
+	"time"
 
 	"github.com/cockroachdb/cockroach/pkg/roachpb"
 	"github.com/cockroachdb/cockroach/pkg/storage/engine/enginepb"
@@ -61,6 +62,25 @@ type SimpleIterator interface {
 type IteratorStats struct {
 	InternalDeleteSkippedCount int
 	TimeBoundNumSSTs           int
+	TimeBoundNumSSTsPruned     int
+	// The number of blocks found in the block cache and the number, size
+	// and read time of the blocks read from sstables (i.e. the block
+	// cache misses).
+	BlockCacheHitCount      int
+	BlockReadCount          int
+	BlockReadBytes          int
+	BlockReadDuration       time.Duration
+	BlockDecompressDuration time.Duration
+	// The number of sstable bloom filter checks which did (hit) or did
+	// not (miss) match.
+	BloomSSTHitCount  int
+	BloomSSTMissCount int
+	// The time spent seeking the memtable and sstable iterators and
+	// stepping over them to the next visible key.
+	SeekDuration time.Duration
+	NextDuration time.Duration
+	// The bytes read from files.
+	BytesRead int
 }
 
 // Iterator is an interface for iterating over key/value pairs in an
@@ -345,6 +365,23 @@ type Stats struct {
 	Compactions                    int64
 	TableReadersMemEstimate        int64
 	PendingCompactionBytesEstimate int64
+	// RateLimitBytesPerSec is the current auto-tuned rate of the flush and
+	// compaction rate limiter. RateLimiterFlushBytes and
+	// RateLimiterCompactionBytes are the bytes written through it by flushes
+	// and compactions, and RateLimiterDrains is the number of times writers
+	// were throttled because it ran out of budget. All are zero when rate
+	// limiting is disabled.
+	RateLimitBytesPerSec       int64
+	RateLimiterFlushBytes      int64
+	RateLimiterCompactionBytes int64
+	RateLimiterDrains          int64
+	// TombstoneCompactions is the number of compactions run for key spans in
+	// which iterators skipped many deletion tombstones, and
+	// TombstoneSpansTracked is the number of key spans which haven't reached
+	// the threshold yet. Both are zero unless COCKROACH_ROCKSDB_COMPACT_TOMBSTONES
+	// is set.
+	TombstoneCompactions  int64
+	TombstoneSpansTracked int64
 }
 
 // EnvStats is a set of RocksDB env stats, including encryption status.
@@ -80,6 +80,52 @@ var rocksdbConcurrency = envutil.EnvOrDefaultInt(
 		return max
 	}())
 
+// rocksdbPartitionedIndexFilters enables partitioned index and filter blocks
+// for sstables written by this process. This bounds the memory used by index
+// and filter blocks on large stores at the cost of additional block cache
+// lookups. Existing sstables are unaffected until they are rewritten by
+// compactions.
+var rocksdbPartitionedIndexFilters = envutil.EnvOrDefaultBool(
+	"COCKROACH_ROCKSDB_PARTITIONED_INDEX_FILTERS", false)
+
+// rocksdbTieredCompression enables a per-level compression policy which
+// compresses the bottommost level with ZSTD and trained dictionaries. Opening
+// the engine fails if the RocksDB library was built without ZSTD support.
+var rocksdbTieredCompression = envutil.EnvOrDefaultBool(
+	"COCKROACH_ROCKSDB_TIERED_COMPRESSION", false)
+
+// rocksdbCacheHighPriPoolRatio is the fraction of the block cache reserved
+// for index and filter blocks. Only partitioned index and filter blocks are
+// stored in the block cache (see COCKROACH_ROCKSDB_PARTITIONED_INDEX_FILTERS),
+// so nothing is reserved by default otherwise. Data blocks may use the
+// reserved space while it is not needed by index and filter blocks.
+var rocksdbCacheHighPriPoolRatio = envutil.EnvOrDefaultFloat64(
+	"COCKROACH_ROCKSDB_CACHE_HIGH_PRI_POOL_RATIO",
+	func() float64 {
+		if rocksdbPartitionedIndexFilters {
+			return 0.1
+		}
+		return 0
+	}())
+
+// rocksdbClockCache selects RocksDB's CLOCK cache for the block cache. Its
+// lookups do not take a mutex, which reduces contention on machines with many
+// cores. It is only available if RocksDB was built with TBB; otherwise a
+// warning is logged and an LRU cache is used.
+var rocksdbClockCache = envutil.EnvOrDefaultBool("COCKROACH_ROCKSDB_CLOCK_CACHE", false)
+
+// rocksdbRateLimit is the maximum rate (in bytes/sec) at which flushes and
+// compactions may write to disk. RocksDB auto-tunes the effective rate below
+// this limit based on the compaction backlog. Zero disables rate limiting.
+// The limit can be changed at runtime with RocksDB.SetRateLimit.
+var rocksdbRateLimit = envutil.EnvOrDefaultBytes("COCKROACH_ROCKSDB_RATE_LIMIT", 0)
+
+// rocksdbCompactTombstones makes iterators count the deletion tombstones they
+// skip and compacts the key spans in which many are skipped. Counting enables
+// the RocksDB perf context on every iterator operation.
+var rocksdbCompactTombstones = envutil.EnvOrDefaultBool(
+	"COCKROACH_ROCKSDB_COMPACT_TOMBSTONES", false)
+
 // Set to true to perform expensive iterator debug leak checking. In normal
 // operation, we perform inexpensive iterator leak checking but those checks do
 // not indicate where the leak arose. The expensive checking tracks the stack
@@ -123,8 +169,16 @@ const (
 type SSTableInfo struct {
 	Level int
 	Size  int64
-	Start MVCCKey
-	End   MVCCKey
+	// RawSize is the uncompressed size of the keys and values in the table.
+	RawSize int64
+	// IndexSize, TopLevelIndexSize and FilterSize are the on-disk sizes of the
+	// index blocks, the top-level index block (partitioned indexes only) and
+	// the filter blocks of the table.
+	IndexSize         int64
+	TopLevelIndexSize int64
+	FilterSize        int64
+	Start             MVCCKey
+	End               MVCCKey
 }
 
 // SSTableInfos is a slice of SSTableInfo structures.
@@ -153,6 +207,39 @@ func (s SSTableInfos) Less(i, j int) bool {
 	}
 }
 
+// CompressionRatios returns the compression ratio (uncompressed over on-disk
+// size) of each level, indexed by level. Levels without tables have a ratio of
+// 0.
+func (s SSTableInfos) CompressionRatios() []float64 {
+	var size, rawSize []int64
+	for _, t := range s {
+		for len(size) <= t.Level {
+			size = append(size, 0)
+			rawSize = append(rawSize, 0)
+		}
+		size[t.Level] += t.Size
+		rawSize[t.Level] += t.RawSize
+	}
+	ratios := make([]float64, len(size))
+	for i := range ratios {
+		if size[i] > 0 {
+			ratios[i] = float64(rawSize[i]) / float64(size[i])
+		}
+	}
+	return ratios
+}
+
+// IndexAndFilterSizes returns the total on-disk sizes of the index blocks, the
+// top-level index blocks and the filter blocks of the tables.
+func (s SSTableInfos) IndexAndFilterSizes() (index, topLevelIndex, filter int64) {
+	for _, t := range s {
+		index += t.IndexSize
+		topLevelIndex += t.TopLevelIndexSize
+		filter += t.FilterSize
+	}
+	return index, topLevelIndex, filter
+}
+
 func (s SSTableInfos) String() string {
 	const (
 		KB = 1 << 10
@@ -405,11 +492,25 @@ type RocksDBCache struct {
 	cache *C.DBCache
 }
 
-// NewRocksDBCache creates a new cache of the specified size. Note that the
-// cache is refcounted internally and starts out with a refcount of one (i.e.
-// Release() should be called after having used the cache).
+// NewRocksDBCache creates a new cache of the specified size. The cache is
+// sharded according to the number of CPUs. Note that the cache is refcounted
+// internally and starts out with a refcount of one (i.e. Release() should be
+// called after having used the cache).
 func NewRocksDBCache(cacheSize int64) RocksDBCache {
-	return RocksDBCache{cache: C.DBNewCache(C.uint64_t(cacheSize))}
+	opts := C.DBCacheOptions{
+		size:                C.uint64_t(cacheSize),
+		num_cpu:             C.int(runtime.NumCPU()),
+		high_pri_pool_ratio: C.double(rocksdbCacheHighPriPoolRatio),
+		use_clock_cache:     C.bool(rocksdbClockCache),
+	}
+	cache := C.DBNewCache(opts)
+	if cache == nil {
+		log.Warningf(context.TODO(), "COCKROACH_ROCKSDB_CLOCK_CACHE is set but RocksDB "+
+			"was built without CLOCK cache support; using an LRU cache")
+		opts.use_clock_cache = C.bool(false)
+		cache = C.DBNewCache(opts)
+	}
+	return RocksDBCache{cache: cache}
 }
 
 func (c RocksDBCache) ref() RocksDBCache {
@@ -606,14 +707,18 @@ func (r *RocksDB) open() error {
 
 	status := C.DBOpen(&r.rdb, goToCSlice([]byte(r.cfg.Dir)),
 		C.DBOptions{
-			cache:             r.cache.cache,
-			num_cpu:           C.int(rocksdbConcurrency),
-			max_open_files:    C.int(maxOpenFiles),
-			use_file_registry: C.bool(newVersion == versionCurrent),
-			must_exist:        C.bool(r.cfg.MustExist),
-			read_only:         C.bool(r.cfg.ReadOnly),
-			rocksdb_options:   goToCSlice([]byte(r.cfg.RocksDBOptions)),
-			extra_options:     goToCSlice(r.cfg.ExtraOptions),
+			cache:                     r.cache.cache,
+			num_cpu:                   C.int(rocksdbConcurrency),
+			max_open_files:            C.int(maxOpenFiles),
+			use_file_registry:         C.bool(newVersion == versionCurrent),
+			must_exist:                C.bool(r.cfg.MustExist),
+			read_only:                 C.bool(r.cfg.ReadOnly),
+			partitioned_index_filters: C.bool(rocksdbPartitionedIndexFilters),
+			tiered_compression:        C.bool(rocksdbTieredCompression),
+			rate_limit_bytes_per_sec:  C.int64_t(rocksdbRateLimit),
+			compact_tombstones:        C.bool(rocksdbCompactTombstones),
+			rocksdb_options:           goToCSlice([]byte(r.cfg.RocksDBOptions)),
+			extra_options:             goToCSlice(r.cfg.ExtraOptions),
 		})
 	if err := statusToError(status); err != nil {
 		return errors.Wrap(err, "could not open rocksdb instance")
@@ -786,6 +891,19 @@ func (r *RocksDB) ClearRange(start, end MVCCKey) error {
 	return dbClearRange(r.rdb, start, end)
 }
 
+// ClearRangeAndFiles removes a set of entries, from start (inclusive) to end
+// (exclusive), like ClearRange, but first deletes the sstables which lie
+// entirely within the range. This frees the space of large ranges almost
+// immediately. Unlike ClearRange it is not atomic and ignores snapshots, so it
+// must only be used on ranges which are no longer read or written.
+func (r *RocksDB) ClearRangeAndFiles(start, end MVCCKey) error {
+	err := statusToError(C.DBDeleteFilesAndRange(r.rdb, goToCKey(start), goToCKey(end)))
+	if err != nil {
+		return err
+	}
+	return dbClearRangeBounds(r.rdb, start, end)
+}
+
 // ClearIterRange removes a set of entries, from start (inclusive) to end
 // (exclusive).
 func (r *RocksDB) ClearIterRange(iter Iterator, start, end MVCCKey) error {
@@ -879,6 +997,28 @@ func (r *RocksDB) Capacity() (roachpb.StoreCapacity, error) {
 	}, nil
 }
 
+// SetOptions changes mutable RocksDB column family options at runtime, such
+// as level0_slowdown_writes_trigger or write_buffer_size. The options use the
+// same "key1=value1;key2=value2" syntax as RocksDBConfig.RocksDBOptions. The
+// changes are validated before any of them are applied and are lost when the
+// engine is reopened.
+func (r *RocksDB) SetOptions(opts string) error {
+	return statusToError(C.DBSetOptions(r.rdb, goToCSlice([]byte(opts))))
+}
+
+// SetDBOptions changes mutable RocksDB database-wide options at runtime, such
+// as max_background_jobs. See SetOptions.
+func (r *RocksDB) SetDBOptions(opts string) error {
+	return statusToError(C.DBSetDBOptions(r.rdb, goToCSlice([]byte(opts))))
+}
+
+// SetRateLimit changes the maximum rate (in bytes/sec) of flush and compaction
+// writes. It returns an error if the engine was opened without rate limiting
+// (see COCKROACH_ROCKSDB_RATE_LIMIT).
+func (r *RocksDB) SetRateLimit(bytesPerSec int64) error {
+	return statusToError(C.DBSetRateLimit(r.rdb, C.int64_t(bytesPerSec)))
+}
+
 // Compact forces compaction over the entire database.
 func (r *RocksDB) Compact() error {
 	return statusToError(C.DBCompact(r.rdb))
@@ -1081,6 +1221,10 @@ func (r *RocksDB) GetSSTables() SSTableInfos {
 		tv := tableVal(i)
 		r.Level = int(tv.level)
 		r.Size = int64(tv.size)
+		r.RawSize = int64(tv.raw_size)
+		r.IndexSize = int64(tv.index_size)
+		r.TopLevelIndexSize = int64(tv.top_level_index_size)
+		r.FilterSize = int64(tv.filter_size)
 		r.Start = cToGoKey(tv.start_key)
 		r.End = cToGoKey(tv.end_key)
 		if ptr := tv.start_key.key.data; ptr != nil {
@@ -1129,6 +1273,12 @@ func (r *RocksDB) GetStats() (*Stats, error) {
 		Compactions:                    int64(s.compactions),
 		TableReadersMemEstimate:        int64(s.table_readers_mem_estimate),
 		PendingCompactionBytesEstimate: int64(s.pending_compaction_bytes_estimate),
+		RateLimitBytesPerSec:           int64(s.rate_limit_bytes_per_sec),
+		RateLimiterFlushBytes:          int64(s.rate_limiter_flush_bytes),
+		RateLimiterCompactionBytes:     int64(s.rate_limiter_compaction_bytes),
+		RateLimiterDrains:              int64(s.rate_limiter_drains),
+		TombstoneCompactions:           int64(s.tombstone_compactions),
+		TombstoneSpansTracked:          int64(s.tombstone_spans_tracked),
 	}, nil
 }
 
@@ -1154,6 +1304,115 @@ func (r *RocksDB) GetEnvStats() (*EnvStats, error) {
 	}, nil
 }
 
+// WriteStallCondition is the state of RocksDB's write throttling.
+type WriteStallCondition int32
+
+// The values of WriteStallCondition, matching DBWriteStallStats.
+const (
+	WriteStallNormal WriteStallCondition = iota
+	WriteStallDelayed
+	WriteStallStopped
+)
+
+// WriteStallStats contains the signals which lead up to RocksDB slowing
+// down or stopping writes.
+type WriteStallStats struct {
+	// L0FileCount is the number of sstables in L0.
+	L0FileCount int64
+	// ImmutableMemtableCount is the number of memtables waiting to be
+	// flushed.
+	ImmutableMemtableCount int64
+	// PendingCompactionBytes is the estimated number of bytes compactions
+	// need to rewrite to bring all levels down to their target size.
+	PendingCompactionBytes int64
+	// Condition is the current write stall condition.
+	Condition WriteStallCondition
+	// ConditionChanged is the time Condition last changed, or the zero
+	// time if it never changed.
+	ConditionChanged time.Time
+	// Slowdowns and Stops are the number of times writes were slowed down
+	// or stopped.
+	Slowdowns int64
+	Stops     int64
+}
+
+// GetWriteStallStats returns the write stall and compaction debt
+// signals of the RocksDB instance. It only loads a few atomics and is
+// cheap enough to be called for every request.
+func (r *RocksDB) GetWriteStallStats() (WriteStallStats, error) {
+	var s C.DBWriteStallStats
+	if err := statusToError(C.DBGetWriteStallStats(r.rdb, &s)); err != nil {
+		return WriteStallStats{}, err
+	}
+	stats := WriteStallStats{
+		L0FileCount:            int64(s.l0_file_count),
+		ImmutableMemtableCount: int64(s.immutable_memtable_count),
+		PendingCompactionBytes: int64(s.pending_compaction_bytes),
+		Condition:              WriteStallCondition(s.stall_condition),
+		Slowdowns:              int64(s.slowdowns),
+		Stops:                  int64(s.stops),
+	}
+	if s.stall_condition_nanos != 0 {
+		stats.ConditionChanged = timeutil.Unix(0, int64(s.stall_condition_nanos))
+	}
+	return stats, nil
+}
+
+// LatencyHistogram summarizes the latencies of a libroach operation.
+// The quantiles are accurate to within 1/8 of their value.
+type LatencyHistogram struct {
+	Count int64
+	Sum   time.Duration
+	Max   time.Duration
+	P50   time.Duration
+	P90   time.Duration
+	P99   time.Duration
+	P999  time.Duration
+}
+
+// LatencyHistograms contains the latencies of libroach operations,
+// measured inside libroach and thus excluding the cgo overhead.
+type LatencyHistograms struct {
+	Get                 LatencyHistogram
+	MVCCGet             LatencyHistogram
+	MVCCScan            LatencyHistogram
+	CommitBatch         LatencyHistogram
+	ApplyBatchRepr      LatencyHistogram
+	IngestExternalFiles LatencyHistogram
+	SstFileWriterFinish LatencyHistogram
+}
+
+func latencyHistogram(h C.DBHistogram) LatencyHistogram {
+	return LatencyHistogram{
+		Count: int64(h.count),
+		Sum:   time.Duration(h.sum_nanos),
+		Max:   time.Duration(h.max_nanos),
+		P50:   time.Duration(h.p50_nanos),
+		P90:   time.Duration(h.p90_nanos),
+		P99:   time.Duration(h.p99_nanos),
+		P999:  time.Duration(h.p999_nanos),
+	}
+}
+
+// GetLatencyHistograms returns the latency histograms of libroach
+// operations. The histograms are cumulative and shared by all RocksDB
+// instances of the process.
+func GetLatencyHistograms() (LatencyHistograms, error) {
+	var h C.DBHistogramsResult
+	if err := statusToError(C.DBGetHistograms(&h)); err != nil {
+		return LatencyHistograms{}, err
+	}
+	return LatencyHistograms{
+		Get:                 latencyHistogram(h.get),
+		MVCCGet:             latencyHistogram(h.mvcc_get),
+		MVCCScan:            latencyHistogram(h.mvcc_scan),
+		CommitBatch:         latencyHistogram(h.commit_batch),
+		ApplyBatchRepr:      latencyHistogram(h.apply_batch_repr),
+		IngestExternalFiles: latencyHistogram(h.ingest_external_files),
+		SstFileWriterFinish: latencyHistogram(h.sst_file_writer_finish),
+	}, nil
+}
+
 type rocksDBSnapshot struct {
 	parent *RocksDB
 	handle *C.DBEngine
@@ -1931,7 +2190,18 @@ func (r *rocksDBIterator) Stats() IteratorStats {
 	stats := C.DBIterStats(r.iter)
 	return IteratorStats{
 		TimeBoundNumSSTs:           int(C.ulonglong(stats.timebound_num_ssts)),
+		TimeBoundNumSSTsPruned:     int(C.ulonglong(stats.timebound_num_ssts_pruned)),
 		InternalDeleteSkippedCount: int(C.ulonglong(stats.internal_delete_skipped_count)),
+		BlockCacheHitCount:         int(C.ulonglong(stats.block_cache_hit_count)),
+		BlockReadCount:             int(C.ulonglong(stats.block_read_count)),
+		BlockReadBytes:             int(C.ulonglong(stats.block_read_bytes)),
+		BlockReadDuration:          time.Duration(stats.block_read_nanos),
+		BlockDecompressDuration:    time.Duration(stats.block_decompress_nanos),
+		BloomSSTHitCount:           int(C.ulonglong(stats.bloom_sst_hit_count)),
+		BloomSSTMissCount:          int(C.ulonglong(stats.bloom_sst_miss_count)),
+		SeekDuration:               time.Duration(stats.seek_nanos),
+		NextDuration:               time.Duration(stats.next_nanos),
+		BytesRead:                  int(C.ulonglong(stats.bytes_read)),
 	}
 }
 
@@ -2433,6 +2703,10 @@ func dbClearRange(rdb *C.DBEngine, start, end MVCCKey) error {
 	if err := statusToError(C.DBDeleteRange(rdb, goToCKey(start), goToCKey(end))); err != nil {
 		return err
 	}
+	return dbClearRangeBounds(rdb, start, end)
+}
+
+func dbClearRangeBounds(rdb *C.DBEngine, start, end MVCCKey) error {
 	// This is a serious hack. RocksDB generates sstables which cover an
 	// excessively large amount of the key space when range tombstones are
 	// present. The crux of the problem is that the logic for determining sstable
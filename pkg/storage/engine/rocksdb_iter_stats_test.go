@@ -15,6 +15,7 @@
 package engine
 
 import (
+	"fmt"
 	"testing"
 
 	"github.com/cockroachdb/cockroach/pkg/roachpb"
@@ -105,3 +106,43 @@ func TestIterStats(t *testing.T) {
 		})
 	}
 }
+
+func TestIterStatsPerfContext(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	db := setupMVCCInMemRocksDB(t, "test_iter_stats_perf_context")
+	defer db.Close()
+
+	for i := 0; i < 100; i++ {
+		k := MVCCKey{
+			Key:       roachpb.Key(fmt.Sprintf("key%03d", i)),
+			Timestamp: hlc.Timestamp{WallTime: 1},
+		}
+		if err := db.Put(k, []byte("value")); err != nil {
+			t.Fatal(err)
+		}
+	}
+	if err := db.Flush(); err != nil {
+		t.Fatal(err)
+	}
+
+	iter := db.NewIterator(IterOptions{WithStats: true})
+	defer iter.Close()
+	if _, numKvs, _, err := iter.MVCCScan(
+		roachpb.KeyMin, roachpb.KeyMax, 0, hlc.Timestamp{WallTime: 2}, nil, true, false, false,
+	); err != nil {
+		t.Fatal(err)
+	} else if numKvs != 100 {
+		t.Fatalf("expected 100 keys, but found %d", numKvs)
+	}
+
+	// The data is in an sstable, so the scan reads at least one block,
+	// either from the block cache or from the sstable.
+	stats := iter.Stats()
+	if stats.BlockCacheHitCount+stats.BlockReadCount == 0 {
+		t.Errorf("expected block reads, but found %+v", stats)
+	}
+	if stats.BlockReadCount > 0 && stats.BlockReadBytes == 0 {
+		t.Errorf("expected bytes read for block reads, but found %+v", stats)
+	}
+}
@@ -23,6 +23,7 @@ import (
 	"math/rand"
 	"os"
 	"path/filepath"
+	"reflect"
 	"sort"
 	"strconv"
 	"testing"
@@ -387,6 +388,55 @@ func TestRocksDBApproximateDiskBytes(t *testing.T) {
 	}
 }
 
+func TestRocksDBSetOptions(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	db := NewInMem(roachpb.Attributes{}, testCacheSize)
+	defer db.Close()
+
+	testCases := []struct {
+		db       bool
+		opts     string
+		expected string
+	}{
+		{false, "level0_slowdown_writes_trigger=24;level0_stop_writes_trigger=40", ""},
+		{false, "write_buffer_size=134217728", ""},
+		{false, "", "no options specified"},
+		{false, "unknown_option=1", "Invalid argument"},
+		{false, "level0_slowdown_writes_trigger=abc", "Invalid argument"},
+		{false, "level0_slowdown_writes_trigger=50", "must hold"},
+		{false, "num_levels=3", "Invalid argument"},
+		{true, "max_background_jobs=8", ""},
+		{true, "max_background_jobs=1", "must be at least 2"},
+	}
+	for _, c := range testCases {
+		var err error
+		if c.db {
+			err = db.SetDBOptions(c.opts)
+		} else {
+			err = db.SetOptions(c.opts)
+		}
+		if !testutils.IsError(err, c.expected) {
+			t.Errorf("%q: expected %q, but got %v", c.opts, c.expected, err)
+		}
+	}
+}
+
+func TestSSTableInfosCompressionRatios(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	tables := SSTableInfos{
+		{Level: 0, Size: 10, RawSize: 10},
+		{Level: 2, Size: 10, RawSize: 30},
+		{Level: 2, Size: 30, RawSize: 50},
+		{Level: 3, Size: 0, RawSize: 0},
+	}
+	expected := []float64{1, 0, 2, 0}
+	if ratios := tables.CompressionRatios(); !reflect.DeepEqual(expected, ratios) {
+		t.Fatalf("expected %v, but got %v", expected, ratios)
+	}
+}
+
 func TestSSTableInfosString(t *testing.T) {
 	defer leaktest.AfterTest(t)()
 
@@ -761,7 +811,7 @@ func TestRocksDBTimeBound(t *testing.T) {
 	batch := rocksdb.NewBatch()
 	defer batch.Close()
 
-	check := func(t *testing.T, tbi Iterator, keys, ssts int) {
+	check := func(t *testing.T, tbi Iterator, keys, ssts, pruned int) {
 		defer tbi.Close()
 		tbi.Seek(NilKey)
 
@@ -785,16 +835,19 @@ func TestRocksDBTimeBound(t *testing.T) {
 		if a := stats.TimeBoundNumSSTs; a != ssts {
 			t.Fatalf("touched %d SSTs, expected %d", a, ssts)
 		}
+		if a := stats.TimeBoundNumSSTsPruned; a != pruned {
+			t.Fatalf("pruned %d SSTs, expected %d", a, pruned)
+		}
 	}
 
 	testCases := []struct {
-		iter       Iterator
-		keys, ssts int
+		iter               Iterator
+		keys, ssts, pruned int
 	}{
 		// Completely to the right, not touching.
-		{iter: batch.NewTimeBoundIterator(maxTimestamp.Next(), maxTimestamp.Next().Next(), true /* withStats */), keys: 0, ssts: 0},
+		{iter: batch.NewTimeBoundIterator(maxTimestamp.Next(), maxTimestamp.Next().Next(), true /* withStats */), keys: 0, ssts: 0, pruned: 1},
 		// Completely to the left, not touching.
-		{iter: batch.NewTimeBoundIterator(minTimestamp.Prev().Prev(), minTimestamp.Prev(), true /* withStats */), keys: 0, ssts: 0},
+		{iter: batch.NewTimeBoundIterator(minTimestamp.Prev().Prev(), minTimestamp.Prev(), true /* withStats */), keys: 0, ssts: 0, pruned: 1},
 		// Touching on the right.
 		{iter: batch.NewTimeBoundIterator(maxTimestamp, maxTimestamp, true /* withStats */), keys: len(times), ssts: 1},
 		// Touching on the left.
@@ -804,7 +857,7 @@ func TestRocksDBTimeBound(t *testing.T) {
 
 	for _, test := range testCases {
 		t.Run("", func(t *testing.T) {
-			check(t, test.iter, test.keys, test.ssts)
+			check(t, test.iter, test.keys, test.ssts, test.pruned)
 		})
 	}
 
@@ -894,6 +947,131 @@ func TestRocksDBDeleteRangeBug(t *testing.T) {
 	iter.Close()
 }
 
+func TestRocksDBClearRangeAndFiles(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+	dir, dirCleanup := testutils.TempDir(t)
+	defer dirCleanup()
+
+	db, err := NewRocksDB(
+		RocksDBConfig{
+			Settings: cluster.MakeTestingClusterSettings(),
+			Dir:      dir,
+		},
+		RocksDBCache{},
+	)
+	if err != nil {
+		t.Fatalf("could not create new rocksdb db instance at %s: %v", dir, err)
+	}
+	defer db.Close()
+
+	put := func(prefix string) {
+		for i := 0; i < 100; i++ {
+			if err := db.Put(key(fmt.Sprintf("%s%03d", prefix, i)), []byte("v")); err != nil {
+				t.Fatal(err)
+			}
+		}
+	}
+	put("b")
+	if err := db.Compact(); err != nil {
+		t.Fatal(err)
+	}
+	put("a")
+	put("c")
+	if err := db.Flush(); err != nil {
+		t.Fatal(err)
+	}
+
+	if err := db.ClearRangeAndFiles(key("b"), key("c")); err != nil {
+		t.Fatal(err)
+	}
+	if ssts := db.GetSSTables(); len(ssts) != 1 {
+		t.Fatalf("expected 1 sstable, but found %d", len(ssts))
+	}
+
+	var keys []string
+	if err := db.Iterate(key("a"), key("d"), func(kv MVCCKeyValue) (bool, error) {
+		keys = append(keys, string(kv.Key.Key))
+		return false, nil
+	}); err != nil {
+		t.Fatal(err)
+	}
+	if len(keys) != 200 || keys[99] != "a099" || keys[100] != "c000" {
+		t.Fatalf("unexpected keys after clearing range: %d keys", len(keys))
+	}
+}
+
+func TestRocksDBWriteStallStats(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+	dir, dirCleanup := testutils.TempDir(t)
+	defer dirCleanup()
+
+	db, err := NewRocksDB(
+		RocksDBConfig{
+			Settings: cluster.MakeTestingClusterSettings(),
+			Dir:      dir,
+		},
+		RocksDBCache{},
+	)
+	if err != nil {
+		t.Fatalf("could not create new rocksdb db instance at %s: %v", dir, err)
+	}
+	defer db.Close()
+
+	if err := db.Put(key("a"), []byte("v")); err != nil {
+		t.Fatal(err)
+	}
+	if err := db.Flush(); err != nil {
+		t.Fatal(err)
+	}
+	stats, err := db.GetWriteStallStats()
+	if err != nil {
+		t.Fatal(err)
+	}
+	expected := WriteStallStats{L0FileCount: 1}
+	if stats != expected {
+		t.Fatalf("expected %+v, but found %+v", expected, stats)
+	}
+}
+
+func TestRocksDBLatencyHistograms(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+	dir, dirCleanup := testutils.TempDir(t)
+	defer dirCleanup()
+
+	db, err := NewRocksDB(
+		RocksDBConfig{
+			Settings: cluster.MakeTestingClusterSettings(),
+			Dir:      dir,
+		},
+		RocksDBCache{},
+	)
+	if err != nil {
+		t.Fatalf("could not create new rocksdb db instance at %s: %v", dir, err)
+	}
+	defer db.Close()
+
+	before, err := GetLatencyHistograms()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if err := db.Put(key("a"), []byte("v")); err != nil {
+		t.Fatal(err)
+	}
+	if _, err := db.Get(key("a")); err != nil {
+		t.Fatal(err)
+	}
+	after, err := GetLatencyHistograms()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if n := after.Get.Count - before.Get.Count; n != 1 {
+		t.Fatalf("expected 1 get, but found %d", n)
+	}
+	if after.Get.Max <= 0 || after.Get.P50 > after.Get.Max {
+		t.Fatalf("unexpected get latencies: %+v", after.Get)
+	}
+}
+
 func createTestSSTableInfos() SSTableInfos {
 	ssti := SSTableInfos{
 		// Level 0.
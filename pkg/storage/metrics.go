@@ -362,6 +362,60 @@ var (
 		Measurement: "Memory",
 		Unit:        metric.Unit_BYTES,
 	}
+	metaRdbIndexBlocksSize = metric.Metadata{
+		Name:        "rocksdb.index-blocks-size",
+		Help:        "Total on-disk size of the index blocks of all sstables",
+		Measurement: "Storage",
+		Unit:        metric.Unit_BYTES,
+	}
+	metaRdbTopLevelIndexSize = metric.Metadata{
+		Name:        "rocksdb.top-level-index-size",
+		Help:        "Total on-disk size of the top-level index blocks of all partitioned sstables",
+		Measurement: "Storage",
+		Unit:        metric.Unit_BYTES,
+	}
+	metaRdbFilterBlocksSize = metric.Metadata{
+		Name:        "rocksdb.filter-blocks-size",
+		Help:        "Total on-disk size of the bloom filter blocks of all sstables",
+		Measurement: "Storage",
+		Unit:        metric.Unit_BYTES,
+	}
+	metaRdbRateLimitBytesPerSec = metric.Metadata{
+		Name:        "rocksdb.rate-limit",
+		Help:        "Current auto-tuned rate limit of flush and compaction writes",
+		Measurement: "Bytes/sec",
+		Unit:        metric.Unit_BYTES,
+	}
+	metaRdbRateLimiterFlushBytes = metric.Metadata{
+		Name:        "rocksdb.rate-limiter.flush-bytes",
+		Help:        "Number of bytes written by flushes through the rate limiter",
+		Measurement: "Storage",
+		Unit:        metric.Unit_BYTES,
+	}
+	metaRdbRateLimiterCompactBytes = metric.Metadata{
+		Name:        "rocksdb.rate-limiter.compaction-bytes",
+		Help:        "Number of bytes written by compactions through the rate limiter",
+		Measurement: "Storage",
+		Unit:        metric.Unit_BYTES,
+	}
+	metaRdbRateLimiterDrains = metric.Metadata{
+		Name:        "rocksdb.rate-limiter.drains",
+		Help:        "Number of times flush or compaction writes were throttled by the rate limiter",
+		Measurement: "Throttles",
+		Unit:        metric.Unit_COUNT,
+	}
+	metaRdbTombstoneCompactions = metric.Metadata{
+		Name:        "rocksdb.tombstone-compactions",
+		Help:        "Number of compactions of key spans in which iterators skipped many deletion tombstones",
+		Measurement: "Compactions",
+		Unit:        metric.Unit_COUNT,
+	}
+	metaRdbTombstoneSpansTracked = metric.Metadata{
+		Name:        "rocksdb.tombstone-spans-tracked",
+		Help:        "Number of key spans tracked for skipped deletion tombstones",
+		Measurement: "Spans",
+		Unit:        metric.Unit_COUNT,
+	}
 	metaRdbReadAmplification = metric.Metadata{
 		Name:        "rocksdb.read-amplification",
 		Help:        "Number of disk reads per query",
@@ -977,6 +1031,15 @@ type StoreMetrics struct {
 	RdbFlushes                  *metric.Gauge
 	RdbCompactions              *metric.Gauge
 	RdbTableReadersMemEstimate  *metric.Gauge
+	RdbIndexBlocksSize          *metric.Gauge
+	RdbTopLevelIndexSize        *metric.Gauge
+	RdbFilterBlocksSize         *metric.Gauge
+	RdbRateLimitBytesPerSec     *metric.Gauge
+	RdbRateLimiterFlushBytes    *metric.Gauge
+	RdbRateLimiterCompactBytes  *metric.Gauge
+	RdbRateLimiterDrains        *metric.Gauge
+	RdbTombstoneCompactions     *metric.Gauge
+	RdbTombstoneSpansTracked    *metric.Gauge
 	RdbReadAmplification        *metric.Gauge
 	RdbNumSSTables              *metric.Gauge
 
@@ -1175,6 +1238,15 @@ func newStoreMetrics(histogramWindow time.Duration) *StoreMetrics {
 		RdbFlushes:                  metric.NewGauge(metaRdbFlushes),
 		RdbCompactions:              metric.NewGauge(metaRdbCompactions),
 		RdbTableReadersMemEstimate:  metric.NewGauge(metaRdbTableReadersMemEstimate),
+		RdbIndexBlocksSize:          metric.NewGauge(metaRdbIndexBlocksSize),
+		RdbTopLevelIndexSize:        metric.NewGauge(metaRdbTopLevelIndexSize),
+		RdbFilterBlocksSize:         metric.NewGauge(metaRdbFilterBlocksSize),
+		RdbRateLimitBytesPerSec:     metric.NewGauge(metaRdbRateLimitBytesPerSec),
+		RdbRateLimiterFlushBytes:    metric.NewGauge(metaRdbRateLimiterFlushBytes),
+		RdbRateLimiterCompactBytes:  metric.NewGauge(metaRdbRateLimiterCompactBytes),
+		RdbRateLimiterDrains:        metric.NewGauge(metaRdbRateLimiterDrains),
+		RdbTombstoneCompactions:     metric.NewGauge(metaRdbTombstoneCompactions),
+		RdbTombstoneSpansTracked:    metric.NewGauge(metaRdbTombstoneSpansTracked),
 		RdbReadAmplification:        metric.NewGauge(metaRdbReadAmplification),
 		RdbNumSSTables:              metric.NewGauge(metaRdbNumSSTables),
 
@@ -1358,6 +1430,12 @@ func (sm *StoreMetrics) updateRocksDBStats(stats engine.Stats) {
 	sm.RdbFlushes.Update(stats.Flushes)
 	sm.RdbCompactions.Update(stats.Compactions)
 	sm.RdbTableReadersMemEstimate.Update(stats.TableReadersMemEstimate)
+	sm.RdbRateLimitBytesPerSec.Update(stats.RateLimitBytesPerSec)
+	sm.RdbRateLimiterFlushBytes.Update(stats.RateLimiterFlushBytes)
+	sm.RdbRateLimiterCompactBytes.Update(stats.RateLimiterCompactionBytes)
+	sm.RdbRateLimiterDrains.Update(stats.RateLimiterDrains)
+	sm.RdbTombstoneCompactions.Update(stats.TombstoneCompactions)
+	sm.RdbTombstoneSpansTracked.Update(stats.TombstoneSpansTracked)
 }
 
 func (sm *StoreMetrics) leaseRequestComplete(success bool) {
@@ -4148,6 +4148,10 @@ func (s *Store) ComputeMetrics(ctx context.Context, tick int) error {
 		s.metrics.RdbNumSSTables.Update(int64(sstables.Len()))
 		readAmp := sstables.ReadAmplification()
 		s.metrics.RdbReadAmplification.Update(int64(readAmp))
+		indexSize, topLevelIndexSize, filterSize := sstables.IndexAndFilterSizes()
+		s.metrics.RdbIndexBlocksSize.Update(indexSize)
+		s.metrics.RdbTopLevelIndexSize.Update(topLevelIndexSize)
+		s.metrics.RdbFilterBlocksSize.Update(filterSize)
 		// Log this metric infrequently.
 		if tick%60 == 0 /* every 10m */ {
 			log.Infof(ctx, "sstables (read amplification = %d):\n%s", readAmp, sstables)